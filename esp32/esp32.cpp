@@ -1,12 +1,30 @@
 // ESP32: RX=16, TX=17 可改成你喜歡的硬體串口腳位
+// 速率需與 STM32 的 LINK_BAUD 相同；USB 端用同樣速率，透傳不會成為瓶頸（Tera Term 請設定相同 baud）
+#ifndef LINK_BAUD
+#define LINK_BAUD 460800
+#endif
+
 HardwareSerial bp(2);
 
+// Black Pill -> PC：UART 驅動收到資料（FIFO 達門檻或線路閒置）時由序列埠事件任務呼叫，不需輪詢
+void onBpReceive() {
+  uint8_t buf[256];
+  int n;
+  while ((n = bp.available()) > 0) {
+    if (n > (int)sizeof(buf)) n = sizeof(buf);
+    n = bp.readBytes(buf, n);
+    Serial.write(buf, n);
+  }
+}
+
 void setup() {
-  Serial.begin(9600);                  // ESP32 USB 給 Tera Term
-  bp.begin(9600, SERIAL_8N1, 16, 17);  // 連 Black Pill PA2/PA3
+  Serial.begin(LINK_BAUD);             // ESP32 USB 給 Tera Term
+  bp.setRxBufferSize(4096);            // 需在 begin() 之前設定
+  bp.begin(LINK_BAUD, SERIAL_8N1, 16, 17);  // 連 Black Pill PA2/PA3
+  bp.onReceive(onBpReceive);
 }
 
 void loop() {
-  while (bp.available()) Serial.write(bp.read());    // Black Pill -> PC
   while (Serial.available()) bp.write(Serial.read()); // PC -> Black Pill (可選)
-}
\ No newline at end of file
+  delay(1);
+}
@@ -2,79 +2,689 @@
 // 請依需求修改：Wi‑Fi SSID、密碼、PC IP、Port 以及硬體串口腳位
 
 #include <WiFi.h>
+#include <WiFiUdp.h>
+#include "driver/uart.h"
+#include "freertos/stream_buffer.h"
+#include "lwip/sockets.h"
 
 // ===== 請填寫網路與伺服器設定 =====
 const char *WIFI_SSID     = "TP-Link_B3FC";
 const char *WIFI_PASSWORD = "99879921";
 const char *SERVER_IP     = "192.168.1.104"; // PC 的 IP
-const uint16_t SERVER_PORT = 5001;           // PC 監聽的 TCP Port（Web 伺服器使用 5000）
+const uint16_t SERVER_PORT = 5001;           // PC 監聽的 TCP / UDP Port（Web 伺服器使用 5000）
+
+// ===== 傳輸方式 =====
+// TCP：可靠、依序，但 Wi-Fi 掉包時重傳會拖住後面所有資料（head-of-line blocking），監控端可能落後數秒
+// UDP：每批資料一個 datagram，前面加序號；掉了就不補，主機端依序號統計遺失，永遠只看最新的資料
+#define LINK_TRANSPORT_TCP 0
+#define LINK_TRANSPORT_UDP 1
+#ifndef LINK_TRANSPORT
+#define LINK_TRANSPORT LINK_TRANSPORT_TCP
+#endif
+
+// UDP datagram：'S' 'C' | version(1) | seq(u32) | t_ms(u32) | 完整的文字行/訊框（見下方批次轉送）
+// 多位元組欄位為 little-endian；格式同 python/telemetry_frame.py 的 decode_datagram
+const uint8_t UDP_MAGIC0 = 'S';
+const uint8_t UDP_MAGIC1 = 'C';
+const uint8_t UDP_VERSION = 1;
+const size_t UDP_HEADER_LEN = 11;
 
 // ===== 硬體串口：接到 Black Pill PA2/PA3 =====
-// 預設 RX=16, TX=17，可自行調整
-HardwareSerial bp(2);
+// 預設 RX=16, TX=17，可自行調整；速率需與 STM32 的 LINK_BAUD 相同
+// 9600 baud 約 960 bytes/s，只夠 8 FPS 左右的二進位遙測；460800 / 921600 請用短線直連
+#ifndef LINK_BAUD
+#define LINK_BAUD 460800
+#endif
+const uart_port_t BP_UART = UART_NUM_2;
 const int BP_RX = 16;
 const int BP_TX = 17;
-const uint32_t BP_BAUD = 9600;
+
+// ===== UART 接收任務 =====
+// 使用 ESP-IDF UART 驅動的事件佇列：資料到達（FIFO 達門檻或線路閒置）時喚醒 uartTask，
+// uartTask 固定在 APP_CPU（核心 1），Wi-Fi / lwIP 在 PRO_CPU（核心 0）；
+// 讀到的位元組放進 StreamBuffer 交給 loop() 批次送出，網路阻塞不會讓 UART 溢位
+const int UART_RX_BUF = 4096;           // 驅動 RX 緩衝區（460800 baud 約 90ms）
+const int UART_EVENT_QUEUE_LEN = 32;
+const size_t RX_STREAM_SIZE = 8192;     // UART 任務 -> loop() 的緩衝區
+const BaseType_t UART_TASK_CORE = 1;
+const UBaseType_t UART_TASK_PRIO = 10;  // 高於 loop()（1），低於 Wi-Fi 任務（23）
+
+QueueHandle_t uartQueue = NULL;
+StreamBufferHandle_t rxStream = NULL;
+volatile uint32_t uartOverflows = 0;    // 驅動 FIFO / 緩衝區溢位次數
+volatile uint32_t rxStreamDropped = 0;  // loop() 來不及取走而捨棄的位元組
+
+// ===== 批次轉送 =====
+// 串口資料先放進緩衝區，只在完整的文字行或二進位訊框（0xA5 0x5A | type | len | payload | crc16）
+// 結尾處切開，累積到 BATCH_BYTES 或最舊資料等待超過 BATCH_MAX_MS 時整批寫入 TCP，
+// 不再每個位元組一次 client.write()
+const size_t BATCH_CAPACITY = 1440;     // 加上追蹤訊框仍在一個 TCP 區段（MSS 1460）內，加上 UDP 表頭仍小於 1472（不分段）
+const size_t BATCH_BYTES = 512;         // 累積到此大小立即送出
+const uint32_t BATCH_MAX_MS = 20;       // 最舊資料最多等待時間
+const bool TCP_NO_DELAY = true;         // 已自行批次，關閉 Nagle 避免再等 ACK；false = 交給 Nagle 合併
+const uint8_t FRAME_SYNC0 = 0xA5;
+const uint8_t FRAME_SYNC1 = 0x5A;
+const uint8_t FRAME_MAX_PAYLOAD = 96;   // 與 stm32/telemetry_frame.h 相同
+
+// ===== 斷線暫存（store-and-forward）=====
+// 連線中斷時，原本要送出的資料包成 BACKLOG 訊框
+//   0xA5 0x5A | 0x04 | len | t_ms(u32, ESP32 收到的時間) + 原始資料 | crc16
+// 依序存入環形緩衝區，滿了捨棄最舊的訊框並計數。重新連線後以 REPLAY_BYTES_PER_SEC 限速補送，
+// 與即時資料穿插（即時資料不必排在補送之後），主機端依訊框種類分辨補送的資料
+const uint8_t FRAME_TYPE_BACKLOG = 0x04;
+const size_t BACKLOG_HEADER = 4;                        // t_ms
+const size_t BACKLOG_CHUNK = FRAME_MAX_PAYLOAD - BACKLOG_HEADER;
+const size_t BACKLOG_FRAME_MAX = 4 + FRAME_MAX_PAYLOAD + 2;
+const size_t BACKLOG_RAM_BYTES = 48 * 1024;             // 約 20 秒的遙測
+const size_t BACKLOG_PSRAM_BYTES = 2 * 1024 * 1024;     // 有 PSRAM 時改用（約 15 分鐘）
+const uint32_t REPLAY_BYTES_PER_SEC = 16384;            // 需大於遙測速率才追得上
+const uint32_t REPLAY_BURST = 1024;                     // 每次最多補送的位元組
+
+// ===== 延遲追蹤 =====
+// 批次內有 STM32 的 TRACE 訊框時，在該批資料前加上 ESP_TRACE 訊框：
+//   0xA5 0x5A | 0x0A | 8 | rx_us(u32, 該 TRACE 訊框由 UART 收到的時間) | tx_us(u32, 送出時間) | crc16
+// 時間為 micros()；主機以 TIME_SYNC_ESP 指令（ESP32 攔截，不轉送）估計與主機的時鐘偏移。
+// STM32 的 SYNC 回覆不等批次湊滿立即送出，來回路徑才接近對稱
+const uint8_t FRAME_TYPE_SYNC = 0x08;   // 與 stm32/telemetry_frame.h 相同
+const uint8_t FRAME_TYPE_TRACE = 0x09;
+const uint8_t FRAME_TYPE_ESP_TRACE = 0x0A;
+const uint8_t FRAME_CMD_TIME_SYNC_ESP = 0x84;
+const uint8_t SYNC_SOURCE_ESP32 = 1;
+const size_t ESP_TRACE_FRAME_LEN = 4 + 8 + 2;
+
+// ===== 裝置識別 =====
+// 每次連上主機先送 HELLO 訊框，多支手杖連到同一台主機（python/cane_hub.py）時以 MAC 區分：
+//   0xA5 0x5A | 0x0B | 10 | mac[6] | connects(u32) | crc16
+const uint8_t FRAME_TYPE_HELLO = 0x0B;
+
+volatile uint32_t uartRxUs = 0;         // UART 任務最後一次收到資料的時間
+bool batchHasTrace = false;             // 緩衝區內已有完整的 TRACE 訊框
+uint32_t batchTraceUs = 0;              // 該 TRACE 訊框由 UART 收到的時間
+
+uint8_t *backlogBuf = NULL;
+size_t backlogSize = 0;
+size_t backlogHead = 0;                 // 下一個寫入位置
+size_t backlogUsed = 0;
+uint32_t backlogStored = 0;             // 存入 / 捨棄 / 補送的訊框數
+uint32_t backlogDropped = 0;
+uint32_t backlogReplayed = 0;
+uint32_t replayTokens = 0;
+unsigned long replayMs = 0;
+
+// ===== 連線管理 =====
+// 非阻塞狀態機：Wi-Fi 事件（另一個任務）只設旗標，loop() 每圈推進一步，不會等待連線；
+// 失敗後以指數退避重試。無論連線狀態為何，loop() 都持續從 UART 取資料
+const uint32_t WIFI_CONNECT_TIMEOUT_MS = 15000;
+const uint32_t SERVER_CONNECT_TIMEOUT_MS = 3000;
+const uint32_t BACKOFF_MIN_MS = 500;
+const uint32_t BACKOFF_MAX_MS = 30000;
+
+enum LinkState {
+  LINK_WIFI_WAIT,          // 退避中，時間到呼叫 WiFi.begin()
+  LINK_WIFI_CONNECTING,    // 等待 GOT_IP 事件
+  LINK_SERVER_WAIT,        // Wi-Fi 已連線，退避中（TCP）
+  LINK_SERVER_CONNECTING,  // 非阻塞 connect() 進行中（TCP）
+  LINK_UP,
+};
+const char *const LINK_STATE_NAMES[] = {"wifi wait", "wifi connecting", "server wait", "server connecting", "up"};
+
+LinkState linkState = LINK_WIFI_WAIT;
+unsigned long linkStateMs = 0;          // 進入目前狀態的時間
+unsigned long nextAttemptMs = 0;
+uint32_t backoffMs = BACKOFF_MIN_MS;
+volatile bool wifiGotIp = false;        // 由 Wi-Fi 事件設定，loop() 清除
+volatile bool wifiLost = false;
+int connectFd = -1;                     // 進行中的 TCP socket
+uint32_t statConnects = 0;
+uint32_t statOfflineBytes = 0;          // 斷線期間無法送出的位元組
 
 WiFiClient client;
-unsigned long lastRetryMs = 0;
+WiFiUDP udp;
+uint32_t udpSeq = 0;
 
-void connectWiFi() {
-  WiFi.mode(WIFI_STA);
-  WiFi.begin(WIFI_SSID, WIFI_PASSWORD);
-  Serial.print("連線 Wi-Fi 中");
-  while (WiFi.status() != WL_CONNECTED) {
-    Serial.print(".");
-    delay(500);
+uint8_t batchBuf[BATCH_CAPACITY];
+size_t batchLen = 0;                    // 緩衝區內的位元組數
+size_t batchBoundary = 0;               // 最後一個完整行/訊框的結尾位置
+unsigned long batchFirstMs = 0;         // 緩衝區內最舊資料的時間
+uint32_t statWrites = 0;                // TCP 寫入次數（統計用）
+uint32_t statBytes = 0;
+unsigned long statMs = 0;
+
+// 行/訊框邊界偵測
+enum BoundaryState { B_TEXT, B_SYNC1, B_TYPE, B_LEN, B_BODY };
+BoundaryState boundaryState = B_TEXT;
+int bodyLeft = 0;
+uint8_t boundaryType = 0;               // 目前（或剛結束的）訊框種類
+
+// 餵入一個位元組，回傳是否剛好結束一行或一個訊框
+bool boundaryFeed(uint8_t c) {
+  switch (boundaryState) {
+    case B_TEXT:
+      if (c == FRAME_SYNC0) boundaryState = B_SYNC1;
+      return c == '\n';
+    case B_SYNC1:
+      boundaryState = (c == FRAME_SYNC1) ? B_TYPE : B_TEXT;
+      return c == '\n';
+    case B_TYPE:
+      boundaryType = c;
+      boundaryState = B_LEN;
+      return false;
+    case B_LEN:
+      if (c > FRAME_MAX_PAYLOAD) {      // 不是訊框，當作文字繼續找換行
+        boundaryState = B_TEXT;
+        return false;
+      }
+      bodyLeft = c + 2;                 // payload + crc16
+      boundaryState = B_BODY;
+      return false;
+    case B_BODY:
+      if (--bodyLeft > 0) return false;
+      boundaryState = B_TEXT;
+      return true;
   }
-  Serial.println("\nWi-Fi 已連線");
-  Serial.print("IP: "); Serial.println(WiFi.localIP());
+  return false;
 }
 
-bool connectServer() {
-  Serial.printf("連線伺服器 %s:%u ...\n", SERVER_IP, SERVER_PORT);
-  if (client.connect(SERVER_IP, SERVER_PORT)) {
-    Serial.println("伺服器連線成功");
-    return true;
+// 送出一批資料：TCP 直接寫入串流，UDP 加上序號表頭成為一個 datagram
+bool linkSend(const uint8_t *data, size_t n) {
+#if LINK_TRANSPORT == LINK_TRANSPORT_UDP
+  uint8_t hdr[UDP_HEADER_LEN];
+  uint32_t seq = udpSeq++;
+  uint32_t t = millis();
+  hdr[0] = UDP_MAGIC0;
+  hdr[1] = UDP_MAGIC1;
+  hdr[2] = UDP_VERSION;
+  for (int i = 0; i < 4; i++) {
+    hdr[3 + i] = (uint8_t)(seq >> (8 * i));
+    hdr[7 + i] = (uint8_t)(t >> (8 * i));
   }
-  Serial.println("伺服器連線失敗");
-  return false;
+  if (!udp.beginPacket(SERVER_IP, SERVER_PORT)) return false;
+  udp.write(hdr, sizeof(hdr));
+  udp.write(data, n);
+  return udp.endPacket() == 1;
+#else
+  return client.write(data, n) == n;
+#endif
 }
 
-void setup() {
-  Serial.begin(9600);                   // ESP32 USB debug 改為 9600
-  bp.begin(BP_BAUD, SERIAL_8N1, BP_RX, BP_TX); // 與 Black Pill 連接
+// 連線是否可送資料（UDP 只需要 Wi-Fi）
+bool linkReady() {
+  return linkState == LINK_UP;
+}
 
-  connectWiFi();
-  connectServer();
+uint16_t crc16_ccitt(const uint8_t *data, size_t len) {       // 與 stm32/telemetry_frame.h 相同
+  uint16_t crc = 0xFFFF;
+  for (size_t i = 0; i < len; i++) {
+    crc ^= (uint16_t)data[i] << 8;
+    for (int b = 0; b < 8; b++) crc = (crc & 0x8000) ? (uint16_t)((crc << 1) ^ 0x1021) : (uint16_t)(crc << 1);
+  }
+  return crc;
 }
 
-void loop() {
-  // 若連線掉了，定期嘗試重連
-  if (!client.connected()) {
-    unsigned long now = millis();
-    if (now - lastRetryMs > 3000) {
-      lastRetryMs = now;
-      client.stop();
-      connectServer();
+void backlogBegin() {
+  if (psramFound()) {
+    backlogBuf = (uint8_t *)ps_malloc(BACKLOG_PSRAM_BYTES);
+    if (backlogBuf) backlogSize = BACKLOG_PSRAM_BYTES;
+  }
+  if (!backlogBuf) {
+    backlogBuf = (uint8_t *)malloc(BACKLOG_RAM_BYTES);
+    if (backlogBuf) backlogSize = BACKLOG_RAM_BYTES;
+  }
+  Serial.printf("Backlog: %u bytes (%s)\n", (unsigned)backlogSize, backlogSize == BACKLOG_PSRAM_BYTES ? "PSRAM" : "RAM");
+}
+
+// 從最舊的資料起算第 i 個位元組
+uint8_t backlogAt(size_t i) {
+  return backlogBuf[(backlogHead + backlogSize - backlogUsed + i) % backlogSize];
+}
+
+void backlogDropOldest() {
+  size_t len = 4 + backlogAt(3) + 2;
+  backlogUsed -= len;
+  backlogDropped++;
+}
+
+// 存入一段資料（完整的行 / 訊框），切成 BACKLOG 訊框
+// 組成訊框：payload 已放在 out + 4，補上訊框頭與 CRC，回傳訊框長度
+size_t frameFinish(uint8_t type, uint8_t len, uint8_t *out) {
+  out[0] = FRAME_SYNC0;
+  out[1] = FRAME_SYNC1;
+  out[2] = type;
+  out[3] = len;
+  uint16_t crc = crc16_ccitt(out + 2, 2 + len);
+  out[4 + len] = (uint8_t)crc;
+  out[5 + len] = (uint8_t)(crc >> 8);
+  return 4 + len + 2;
+}
+
+void putU32(uint8_t *p, uint32_t v) {
+  for (int i = 0; i < 4; i++) p[i] = (uint8_t)(v >> (8 * i));
+}
+
+void backlogStore(const uint8_t *data, size_t n, uint32_t t_ms) {
+  if (backlogSize == 0) return;
+  uint8_t f[BACKLOG_FRAME_MAX];
+  for (size_t off = 0; off < n; off += BACKLOG_CHUNK) {
+    size_t chunk = n - off < BACKLOG_CHUNK ? n - off : BACKLOG_CHUNK;
+    putU32(f + 4, t_ms);
+    memcpy(f + 4 + BACKLOG_HEADER, data + off, chunk);
+    size_t flen = frameFinish(FRAME_TYPE_BACKLOG, (uint8_t)(BACKLOG_HEADER + chunk), f);
+    while (backlogUsed + flen > backlogSize) backlogDropOldest();
+    for (size_t i = 0; i < flen; i++) {
+      backlogBuf[backlogHead] = f[i];
+      backlogHead = (backlogHead + 1) % backlogSize;
+    }
+    backlogUsed += flen;
+    backlogStored++;
+  }
+}
+
+// 連線後限速補送：每次送出 token 足夠的完整訊框，送成功才從緩衝區移除
+void replayPoll() {
+  unsigned long now = millis();
+  uint32_t add = (now - replayMs) * REPLAY_BYTES_PER_SEC / 1000;
+  if (!linkReady() || backlogUsed == 0) {
+    replayTokens = 0;
+    replayMs = now;
+    return;
+  }
+  if (add == 0) return;
+  replayMs = now;
+  replayTokens = replayTokens + add > REPLAY_BURST ? REPLAY_BURST : replayTokens + add;
+
+  uint8_t out[REPLAY_BURST];
+  size_t n = 0;
+  uint32_t frames = 0;
+  while (n < backlogUsed) {
+    size_t flen = 4 + backlogAt(n + 3) + 2;
+    if (n + flen > replayTokens) break;
+    for (size_t i = 0; i < flen; i++) out[n + i] = backlogAt(n + i);
+    n += flen;
+    frames++;
+  }
+  if (n == 0 || !linkSend(out, n)) return;
+  backlogUsed -= n;
+  backlogReplayed += frames;
+  replayTokens -= n;
+  statWrites++;
+  statBytes += n;
+}
+
+// 即時送出一批資料，批次內有 TRACE 訊框時在前面加上 ESP_TRACE 訊框（同一次寫入 / 同一個 datagram）
+bool batchSendLive(size_t n) {
+  if (!batchHasTrace) return linkSend(batchBuf, n);
+  static uint8_t out[ESP_TRACE_FRAME_LEN + BATCH_CAPACITY];
+  putU32(out + 4, batchTraceUs);
+  putU32(out + 8, micros());
+  size_t t = frameFinish(FRAME_TYPE_ESP_TRACE, 8, out);
+  memcpy(out + t, batchBuf, n);
+  return linkSend(out, t + n);
+}
+
+// 送出前 n 個位元組，剩餘（未完整的行/訊框）移到緩衝區開頭
+void batchFlush(size_t n) {
+  if (n == 0) return;
+  if (linkReady() && batchSendLive(n)) {
+    statWrites++;
+    statBytes += n;
+  } else {
+    statOfflineBytes += n;
+    backlogStore(batchBuf, n, batchFirstMs);
+  }
+  memmove(batchBuf, batchBuf + n, batchLen - n);
+  batchLen -= n;
+  batchBoundary = 0;
+  batchFirstMs = millis();
+  batchHasTrace = false;
+}
+
+void batchPush(uint8_t c) {
+  if (batchLen == 0) batchFirstMs = millis();
+  // 文字中出現訊框開頭：前面的資料已經完整（文字行未以換行結尾）
+  if (boundaryState == B_TEXT && c == FRAME_SYNC0) batchBoundary = batchLen;
+  batchBuf[batchLen++] = c;
+  bool frameEnd = boundaryState == B_BODY;       // 結束的是訊框（不是文字行）
+  if (boundaryFeed(c)) {
+    batchBoundary = batchLen;
+    if (frameEnd && boundaryType == FRAME_TYPE_TRACE && !batchHasTrace) {
+      batchHasTrace = true;
+      batchTraceUs = uartRxUs;
+    }
+    if (frameEnd && boundaryType == FRAME_TYPE_SYNC) {
+      batchFlush(batchBoundary);
+      return;
+    }
+  }
+  if (batchLen == BATCH_CAPACITY) batchFlush(batchBoundary > 0 ? batchBoundary : batchLen);
+}
+
+// 依大小或等待時間送出已完整的部分；長時間沒有邊界（雜訊）時整批送出
+void batchPoll() {
+  if (batchLen == 0) return;
+  unsigned long age = millis() - batchFirstMs;
+  if (batchBoundary >= BATCH_BYTES || (batchBoundary > 0 && age >= BATCH_MAX_MS)) {
+    batchFlush(batchBoundary);
+  } else if (batchBoundary == 0 && age >= BATCH_MAX_MS * 5) {
+    batchFlush(batchLen);
+  }
+}
+
+void uartTask(void *) {
+  uint8_t buf[256];
+  uart_event_t ev;
+  for (;;) {
+    if (xQueueReceive(uartQueue, &ev, portMAX_DELAY) != pdTRUE) continue;
+    switch (ev.type) {
+      case UART_DATA: {
+        size_t left = ev.size;
+        while (left > 0) {
+          int n = uart_read_bytes(BP_UART, buf, left < sizeof(buf) ? left : sizeof(buf), 0);
+          if (n <= 0) break;
+          left -= n;
+          uartRxUs = micros();
+          size_t sent = xStreamBufferSend(rxStream, buf, n, 0);
+          rxStreamDropped += n - sent;
+        }
+        break;
+      }
+      case UART_FIFO_OVF:
+      case UART_BUFFER_FULL:
+        // 溢位後驅動緩衝區內的資料已不連續，清空重新同步
+        uartOverflows++;
+        uart_flush_input(BP_UART);
+        xQueueReset(uartQueue);
+        break;
+      default:
+        break;
+    }
+  }
+}
+
+void uartBegin() {
+  uart_config_t cfg = {};
+  cfg.baud_rate = LINK_BAUD;
+  cfg.data_bits = UART_DATA_8_BITS;
+  cfg.parity = UART_PARITY_DISABLE;
+  cfg.stop_bits = UART_STOP_BITS_1;
+  cfg.flow_ctrl = UART_HW_FLOWCTRL_DISABLE;
+  uart_driver_install(BP_UART, UART_RX_BUF, 0, UART_EVENT_QUEUE_LEN, &uartQueue, 0);
+  uart_param_config(BP_UART, &cfg);
+  uart_set_pin(BP_UART, BP_TX, BP_RX, UART_PIN_NO_CHANGE, UART_PIN_NO_CHANGE);
+  uart_set_rx_timeout(BP_UART, 2);      // 線路閒置 2 個字元時間即通知，不等 FIFO 滿
+  rxStream = xStreamBufferCreate(RX_STREAM_SIZE, 1);
+  xTaskCreatePinnedToCore(uartTask, "bp_uart", 4096, NULL, UART_TASK_PRIO, NULL, UART_TASK_CORE);
+}
+
+void onWiFiEvent(arduino_event_id_t event, arduino_event_info_t) {
+  if (event == ARDUINO_EVENT_WIFI_STA_GOT_IP) wifiGotIp = true;
+  if (event == ARDUINO_EVENT_WIFI_STA_DISCONNECTED) wifiLost = true;
+}
+
+void linkEnter(LinkState st) {
+  linkState = st;
+  linkStateMs = millis();
+  Serial.printf("Link: %s\n", LINK_STATE_NAMES[st]);
+}
+
+// 失敗：等待 backoffMs（加上最多 1/4 的隨機量，避免多台同時重試）後再試，下次加倍
+void linkRetryLater(LinkState st) {
+  nextAttemptMs = millis() + backoffMs + random(backoffMs / 4 + 1);
+  backoffMs = backoffMs * 2 > BACKOFF_MAX_MS ? BACKOFF_MAX_MS : backoffMs * 2;
+  linkEnter(st);
+}
+
+void serverClose() {
+  if (connectFd >= 0) {
+    close(connectFd);
+    connectFd = -1;
+  }
+  client.stop();
+}
+
+// 開始非阻塞 TCP 連線（connect() 立即回傳 EINPROGRESS）
+bool serverConnectStart() {
+  IPAddress ip;
+  if (!ip.fromString(SERVER_IP)) return false;
+  int fd = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+  if (fd < 0) return false;
+  fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) | O_NONBLOCK);
+  struct sockaddr_in addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(SERVER_PORT);
+  addr.sin_addr.s_addr = (uint32_t)ip;
+  if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0 && errno != EINPROGRESS) {
+    close(fd);
+    return false;
+  }
+  connectFd = fd;
+  return true;
+}
+
+// 檢查連線結果：1 = 已連線（交給 client），0 = 進行中，-1 = 失敗
+int serverConnectPoll() {
+  fd_set wfds;
+  FD_ZERO(&wfds);
+  FD_SET(connectFd, &wfds);
+  struct timeval tv = {0, 0};
+  int r = select(connectFd + 1, NULL, &wfds, NULL, &tv);
+  if (r == 0) return 0;
+  int err = 0;
+  socklen_t len = sizeof(err);
+  if (r < 0 || getsockopt(connectFd, SOL_SOCKET, SO_ERROR, &err, &len) < 0 || err != 0) {
+    serverClose();
+    return -1;
+  }
+  // 與 WiFiClient::connect() 相同：連線後改回阻塞模式
+  fcntl(connectFd, F_SETFL, fcntl(connectFd, F_GETFL, 0) & ~O_NONBLOCK);
+  client = WiFiClient(connectFd);
+  connectFd = -1;
+  client.setNoDelay(TCP_NO_DELAY);
+  return 1;
+}
+
+void linkSendHello() {
+  uint8_t f[4 + 10 + 2];
+  WiFi.macAddress(f + 4);
+  putU32(f + 10, statConnects);
+  linkSend(f, frameFinish(FRAME_TYPE_HELLO, 10, f));
+}
+
+// 每圈推進一步，不阻塞
+void linkPoll() {
+  unsigned long now = millis();
+  if (wifiLost) {
+    wifiLost = false;
+    wifiGotIp = false;
+    if (linkState != LINK_WIFI_WAIT) {
+      serverClose();
+      WiFi.disconnect();
+      linkRetryLater(LINK_WIFI_WAIT);
     }
-    delay(10);
     return;
   }
+  switch (linkState) {
+    case LINK_WIFI_WAIT:
+      if ((long)(now - nextAttemptMs) < 0) break;
+      WiFi.begin(WIFI_SSID, WIFI_PASSWORD);
+      linkEnter(LINK_WIFI_CONNECTING);
+      break;
+    case LINK_WIFI_CONNECTING:
+      if (wifiGotIp) {
+        wifiGotIp = false;
+        backoffMs = BACKOFF_MIN_MS;
+        Serial.print("IP: "); Serial.println(WiFi.localIP());
+#if LINK_TRANSPORT == LINK_TRANSPORT_UDP
+        linkEnter(LINK_UP);
+        linkSendHello();
+#else
+        nextAttemptMs = now;
+        linkEnter(LINK_SERVER_WAIT);
+#endif
+      } else if (now - linkStateMs >= WIFI_CONNECT_TIMEOUT_MS) {
+        WiFi.disconnect();
+        linkRetryLater(LINK_WIFI_WAIT);
+      }
+      break;
+    case LINK_SERVER_WAIT:
+      if ((long)(now - nextAttemptMs) < 0) break;
+      if (serverConnectStart()) {
+        linkEnter(LINK_SERVER_CONNECTING);
+      } else {
+        linkRetryLater(LINK_SERVER_WAIT);
+      }
+      break;
+    case LINK_SERVER_CONNECTING: {
+      int r = serverConnectPoll();
+      if (r > 0) {
+        backoffMs = BACKOFF_MIN_MS;
+        statConnects++;
+        linkEnter(LINK_UP);
+        linkSendHello();
+      } else if (r < 0 || now - linkStateMs >= SERVER_CONNECT_TIMEOUT_MS) {
+        serverClose();
+        linkRetryLater(LINK_SERVER_WAIT);
+      }
+      break;
+    }
+    case LINK_UP:
+#if LINK_TRANSPORT == LINK_TRANSPORT_TCP
+      if (!client.connected()) {
+        serverClose();
+        linkRetryLater(LINK_SERVER_WAIT);
+      }
+#endif
+      break;
+  }
+}
+
+// ===== 下行指令 =====
+// PC -> Black Pill 的位元組原樣轉送給 STM32，只攔截 TIME_SYNC_ESP 訊框由 ESP32 自己回覆
+enum DownlinkState { D_IDLE, D_SYNC1, D_TYPE, D_LEN, D_BODY };
+DownlinkState dlState = D_IDLE;
+uint8_t dlBuf[4 + FRAME_MAX_PAYLOAD + 2];
+size_t dlLen = 0;
+size_t dlLeft = 0;
 
-  // 從 Black Pill 讀資料 -> 傳到 PC
-  while (bp.available()) {
-    int c = bp.read();
-    client.write((uint8_t)c);
+void downlinkReplySync(uint32_t rx_us) {
+  uint8_t f[4 + 13 + 2];
+  memcpy(f + 4, dlBuf + 4, 4);          // token
+  f[8] = SYNC_SOURCE_ESP32;
+  putU32(f + 9, rx_us);
+  putU32(f + 13, micros());
+  linkSend(f, frameFinish(FRAME_TYPE_SYNC, 13, f));
+}
+
+// 收集一個可能的訊框；不是訊框的位元組與其他訊框照常轉送
+void downlinkFeed(uint8_t c, uint32_t rx_us) {
+  dlBuf[dlLen++] = c;
+  switch (dlState) {
+    case D_IDLE:
+      if (c == FRAME_SYNC0) {
+        dlState = D_SYNC1;
+        return;
+      }
+      break;
+    case D_SYNC1:
+      if (c == FRAME_SYNC1) {
+        dlState = D_TYPE;
+        return;
+      }
+      break;
+    case D_TYPE:
+      dlState = D_LEN;
+      return;
+    case D_LEN:
+      if (c > FRAME_MAX_PAYLOAD) break;
+      dlLeft = c + 2;
+      dlState = D_BODY;
+      return;
+    case D_BODY:
+      if (--dlLeft > 0) return;
+      if (dlBuf[2] == FRAME_CMD_TIME_SYNC_ESP && dlBuf[3] == 4 &&
+          crc16_ccitt(dlBuf + 2, 2 + dlBuf[3]) == (uint16_t)(dlBuf[dlLen - 2] | (dlBuf[dlLen - 1] << 8))) {
+        downlinkReplySync(rx_us);
+        dlLen = 0;
+      }
+      break;
   }
+  if (dlLen > 0) uart_write_bytes(BP_UART, (const char *)dlBuf, dlLen);
+  dlLen = 0;
+  dlState = D_IDLE;
+}
 
-  // 如需將 PC 指令回傳給 Black Pill，可取消註解以下
-  // while (client.available()) {
-  //   int c = client.read();
-  //   bp.write((uint8_t)c);
-  // }
+void setup() {
+  Serial.begin(115200);                 // ESP32 USB debug
+  uartBegin();                          // 與 Black Pill 連接
+  backlogBegin();
+  Serial.printf("Black Pill UART: %u baud\n", (unsigned)LINK_BAUD);
 
-  // 讓循環稍作休息
-  delay(2);
+  // Wi-Fi 重連由 linkPoll() 依退避時間處理
+  WiFi.mode(WIFI_STA);
+  WiFi.setAutoReconnect(false);
+  WiFi.onEvent(onWiFiEvent);
+#if LINK_TRANSPORT == LINK_TRANSPORT_UDP
+  udp.begin(SERVER_PORT);
+  Serial.printf("UDP -> %s:%u\n", SERVER_IP, SERVER_PORT);
+#else
+  Serial.printf("TCP -> %s:%u\n", SERVER_IP, SERVER_PORT);
+#endif
+  linkEnter(LINK_WIFI_WAIT);
+}
+
+void loop() {
+  // 連線狀態機（非阻塞）；斷線時仍照常取走 UART 資料
+  linkPoll();
+
+  // 從 UART 任務取資料放入批次緩衝區，湊成完整行/訊框後才傳到 PC
+  // 第一次等待最多 1ms（取代固定 delay），有資料時立即處理
+  uint8_t chunk[256];
+  size_t n;
+  TickType_t wait = pdMS_TO_TICKS(1);
+  while ((n = xStreamBufferReceive(rxStream, chunk, sizeof(chunk), wait)) > 0) {
+    for (size_t i = 0; i < n; i++) batchPush(chunk[i]);
+    wait = 0;
+  }
+  batchPoll();
+  replayPoll();
+
+  // 每 10 秒於 USB debug 回報平均每次寫入的位元組數
+  if (millis() - statMs >= 10000) {
+    statMs = millis();
+    if (statWrites > 0) {
+      Serial.printf("%s: %lu bytes in %lu writes (%.1f bytes/write)\n",
+                    LINK_TRANSPORT == LINK_TRANSPORT_UDP ? "UDP" : "TCP", (unsigned long)statBytes,
+                    (unsigned long)statWrites, (float)statBytes / statWrites);
+    }
+    if (uartOverflows > 0 || rxStreamDropped > 0) {
+      Serial.printf("UART: %lu overflows, %lu bytes dropped\n", (unsigned long)uartOverflows,
+                    (unsigned long)rxStreamDropped);
+    }
+    if (statOfflineBytes > 0 || linkState != LINK_UP) {
+      Serial.printf("Link: %s, %lu bytes while offline, %lu connects\n", LINK_STATE_NAMES[linkState],
+                    (unsigned long)statOfflineBytes, (unsigned long)statConnects);
+    }
+    if (backlogUsed > 0 || backlogStored > 0) {
+      Serial.printf("Backlog: %u/%u bytes (%.1f%%), %lu stored, %lu dropped, %lu replayed frames\n",
+                    (unsigned)backlogUsed, (unsigned)backlogSize, 100.0f * backlogUsed / backlogSize,
+                    (unsigned long)backlogStored, (unsigned long)backlogDropped, (unsigned long)backlogReplayed);
+    }
+    statWrites = 0;
+    statBytes = 0;
+    statOfflineBytes = 0;
+  }
+
+  // PC -> Black Pill：指令訊框（見 stm32/param_table.h）轉送給 STM32 解析與回覆，時鐘同步由 ESP32 回覆
+  if (linkReady()) {
+    uint8_t cmd[128];
+    int m = 0;
+#if LINK_TRANSPORT == LINK_TRANSPORT_UDP
+    if (udp.parsePacket() > 0) m = udp.read(cmd, sizeof(cmd));
+#else
+    if (client.available() > 0) m = client.read(cmd, sizeof(cmd));
+#endif
+    uint32_t rx_us = micros();
+    for (int i = 0; i < m; i++) downlinkFeed(cmd[i], rx_us);
+  }
 }
 
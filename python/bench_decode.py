@@ -0,0 +1,113 @@
+"""解碼吞吐量比較：文字行解析、逐訊框解碼（FrameDecoder）與 NumPy 整批解碼（BulkFrameDecoder）。
+
+以合成的遙測串流（取樣訊框，穿插少量文字行與事件訊框）依 ESP32 批次大小切段餵入，
+回報每秒解出的取樣數；整批解碼的結果會與逐訊框解碼逐欄比對。
+
+    python bench_decode.py [--samples 100000] [--chunk 1460]
+"""
+import argparse
+import random
+import struct
+import time
+
+from bulk_decode import HAVE_NUMPY, BulkFrameDecoder, distance_cm
+from mpu6050_viewer_wifi import parse_distance, parse_mpu
+from telemetry_frame import (FRAME_TYPE_EVENT, FRAME_TYPE_SAMPLE, SAMPLE_STRUCT, FrameDecoder, decode_sample,
+                             encode_frame)
+
+
+def make_streams(n: int, seed: int = 1):
+    rng = random.Random(seed)
+    text = bytearray()
+    binary = bytearray()
+    for i in range(n):
+        ax, ay, az, gx, gy, gz = (rng.randint(-20000, 20000) for _ in range(6))
+        echo_us = rng.randint(0, 20000)
+        text += f"distance: {echo_us * 0.017:.2f} cm\n".encode()
+        text += f"ax:{ax}, ay:{ay}, az:{az}, gx:{gx}, gy:{gy}, gz:{gz}\n".encode()
+        binary += encode_frame(FRAME_TYPE_SAMPLE, SAMPLE_STRUCT.pack(i & 0xFFFF, i * 5, ax, ay, az, gx, gy, gz,
+                                                                     echo_us, 0x03))
+        if i % 1000 == 0:
+            binary += b"PB12 calibrated\n"
+            binary += encode_frame(FRAME_TYPE_EVENT, struct.pack("<IBB", i * 5, 3, 0))
+    return bytes(text), bytes(binary)
+
+
+def chunks(data: bytes, size: int):
+    for i in range(0, len(data), size):
+        yield data[i:i + size]
+
+
+def bench_text(data: bytes, chunk: int) -> int:
+    dec = FrameDecoder()
+    count = 0
+    for part in chunks(data, chunk):
+        for kind, line in dec.feed(part):
+            if kind != "text":
+                continue
+            if parse_distance(line) is not None:
+                continue
+            if parse_mpu(line) is not None:
+                count += 1
+    return count
+
+
+def bench_scalar(data: bytes, chunk: int):
+    dec = FrameDecoder()
+    out = []
+    for part in chunks(data, chunk):
+        for kind, item in dec.feed(part):
+            if kind == "frame" and item[0] == FRAME_TYPE_SAMPLE:
+                out.append(decode_sample(item[1]))
+    return out
+
+
+def bench_bulk(data: bytes, chunk: int):
+    dec = BulkFrameDecoder()
+    parts = []
+    for part in chunks(data, chunk):
+        samples, _ = dec.feed(part)
+        if len(samples):
+            distance_cm(samples)
+            parts.append(samples)
+    return parts
+
+
+def timed(fn, *args):
+    t0 = time.perf_counter()
+    result = fn(*args)
+    return result, time.perf_counter() - t0
+
+
+def main() -> None:
+    ap = argparse.ArgumentParser()
+    ap.add_argument("--samples", type=int, default=100000)
+    ap.add_argument("--chunk", type=int, default=1460, help="每次餵入的位元組數（ESP32 批次大小）")
+    args = ap.parse_args()
+
+    text, binary = make_streams(args.samples)
+    print(f"{args.samples} samples, text {len(text)} bytes, binary {len(binary)} bytes, chunk {args.chunk}")
+
+    n, dt = timed(bench_text, text, args.chunk)
+    print(f"text parse_distance/parse_mpu: {n / dt:12.0f} samples/s")
+    ref, dt_scalar = timed(bench_scalar, binary, args.chunk)
+    print(f"FrameDecoder + decode_sample:  {len(ref) / dt_scalar:12.0f} samples/s")
+
+    if not HAVE_NUMPY:
+        print("BulkFrameDecoder: NumPy 未安裝，略過")
+        return
+    parts, dt_bulk = timed(bench_bulk, binary, args.chunk)
+    total = sum(len(p) for p in parts)
+    print(f"BulkFrameDecoder:              {total / dt_bulk:12.0f} samples/s "
+          f"({dt_scalar / dt_bulk:.1f}x FrameDecoder)")
+
+    import numpy as np
+    samples = np.concatenate(parts)
+    same = len(samples) == len(ref) and all(
+        np.array_equal(samples[k].astype(np.int64), np.array([r[k] for r in ref], dtype=np.int64))
+        for k in ("ax", "ay", "az", "gx", "gy", "gz", "echo_us"))
+    print("bulk == scalar:", same)
+
+
+if __name__ == "__main__":
+    main()
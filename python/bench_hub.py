@@ -0,0 +1,151 @@
+"""cane_hub.py 負載測試：模擬多支手杖（ESP32 + STM32）同時連線，回報集中伺服器的吞吐量與每支手杖的延遲。
+
+每支模擬手杖先送 HELLO，之後以 --rate 產生取樣訊框，像 ESP32 一樣每 20ms 批次送出；每 4 筆取樣附一個
+TRACE 訊框（回波時間 = 產生取樣的時間），並回覆主機的 TIME_SYNC / TIME_SYNC_ESP 指令。
+模擬手杖各有自己的時鐘偏移，延遲完全由 cane_hub 的時鐘同步與 TRACE 統計得出（含批次等待）。
+
+    python bench_hub.py [--devices 48] [--rate 50] [--seconds 20]
+預設在子行程啟動 cane_hub.py（--no-browser，使用 --port / --web-port）；--external 改為連到已在執行的 hub。
+"""
+import argparse
+import asyncio
+import json
+import os
+import random
+import struct
+import subprocess
+import sys
+import time
+import urllib.request
+
+from latency_trace import host_us
+from telemetry_frame import (FRAME_CMD_TIME_SYNC, FRAME_CMD_TIME_SYNC_ESP, FRAME_TYPE_HELLO, FRAME_TYPE_SAMPLE,
+                             FRAME_TYPE_SYNC, FRAME_TYPE_TRACE, HELLO_STRUCT, SAMPLE_FLAG_ECHO_VALID,
+                             SAMPLE_FLAG_MPU_OK, SAMPLE_STRUCT, SYNC_STRUCT, TRACE_STRUCT, FrameDecoder,
+                             encode_frame)
+
+BATCH_MS = 20  # 與 esp32_wifi_tcp.cpp 的 BATCH_MAX_MS 相同
+
+
+async def fake_cane(index: int, host: str, port: int, rate: float, stop_at: float, counters: dict) -> None:
+    rng = random.Random(index)
+    offsets = (rng.getrandbits(32), rng.getrandbits(32))  # STM32 / ESP32 時鐘相對主機的偏移
+    dev_us = lambda source: (host_us() + offsets[source]) & 0xFFFFFFFF
+    try:
+        reader, writer = await asyncio.open_connection(host, port)
+    except OSError as e:
+        print(f"cane {index}: {e}")
+        return
+    mac = bytes([0x02, 0xCA, 0x4E, 0x00, index >> 8, index & 0xFF])
+    writer.write(encode_frame(FRAME_TYPE_HELLO, HELLO_STRUCT.pack(mac, 1)))
+
+    async def downlink() -> None:
+        dec = FrameDecoder()
+        while True:
+            data = await reader.read(1024)
+            if not data:
+                return
+            rx = (dev_us(0), dev_us(1))
+            for kind, item in dec.feed(data):
+                if kind != "frame" or item[0] not in (FRAME_CMD_TIME_SYNC, FRAME_CMD_TIME_SYNC_ESP):
+                    continue
+                source = 1 if item[0] == FRAME_CMD_TIME_SYNC_ESP else 0
+                token = struct.unpack_from("<I", item[1])[0]
+                writer.write(encode_frame(FRAME_TYPE_SYNC,
+                                          SYNC_STRUCT.pack(token, source, rx[source], dev_us(source))))
+
+    reply_task = asyncio.ensure_future(downlink())
+    seq = 0
+    t0 = time.monotonic()
+    next_batch = t0
+    batch = bytearray()
+    try:
+        while time.monotonic() < stop_at:
+            next_batch += BATCH_MS / 1000.0
+            due = int((next_batch - t0) * rate)
+            while seq < due:
+                capture = dev_us(0)
+                echo = 4000 + int(1500 * rng.random())
+                batch += encode_frame(FRAME_TYPE_SAMPLE, SAMPLE_STRUCT.pack(
+                    seq & 0xFFFF, int((next_batch - t0) * 1000), *(rng.randint(-2000, 2000) for _ in range(6)),
+                    echo, SAMPLE_FLAG_ECHO_VALID | SAMPLE_FLAG_MPU_OK))
+                seq += 1
+                if seq % 4 == 0:
+                    batch += encode_frame(FRAME_TYPE_TRACE, TRACE_STRUCT.pack(seq & 0xFFFF, capture, dev_us(0)))
+            await asyncio.sleep(max(0.0, next_batch - time.monotonic()))
+            writer.write(bytes(batch))
+            counters["bytes"] += len(batch)
+            batch.clear()
+            await writer.drain()
+        counters["samples"] += seq
+    except (ConnectionResetError, OSError):
+        pass
+    finally:
+        reply_task.cancel()
+        writer.close()
+
+
+def fetch(url: str) -> dict:
+    with urllib.request.urlopen(url, timeout=5) as r:
+        return json.loads(r.read().decode("utf-8"))
+
+
+async def run(args) -> dict:
+    stop_at = time.monotonic() + args.seconds
+    counters = {"bytes": 0, "samples": 0}
+    tasks = [asyncio.ensure_future(fake_cane(i, args.host, args.port, args.rate, stop_at, counters))
+             for i in range(args.devices)]
+    # 統計期間結束前取一次 hub 的摘要（此時所有手杖仍在連線中）
+    await asyncio.sleep(max(0.0, args.seconds - 1.0))
+    summary = await asyncio.get_running_loop().run_in_executor(
+        None, fetch, f"http://{args.host}:{args.web_port}/api/devices")
+    await asyncio.gather(*tasks)
+    summary["sent"] = counters
+    return summary
+
+
+def main() -> None:
+    ap = argparse.ArgumentParser()
+    ap.add_argument("--devices", type=int, default=48)
+    ap.add_argument("--rate", type=float, default=50.0, help="每支手杖每秒的取樣訊框數")
+    ap.add_argument("--seconds", type=float, default=20.0, help="需大於 cane_hub 的 STATS_SEC 才有速率")
+    ap.add_argument("--host", default="127.0.0.1")
+    ap.add_argument("--port", type=int, default=5101)
+    ap.add_argument("--web-port", type=int, default=5100)
+    ap.add_argument("--external", action="store_true", help="連到已在執行的 cane_hub")
+    args = ap.parse_args()
+
+    hub = None
+    if not args.external:
+        here = os.path.dirname(os.path.abspath(__file__))
+        hub = subprocess.Popen([sys.executable, os.path.join(here, "cane_hub.py"), "--no-browser",
+                                "--port", str(args.port), "--web-port", str(args.web_port)],
+                               cwd=here, stdout=subprocess.DEVNULL)
+        time.sleep(1.0)
+    try:
+        summary = asyncio.run(run(args))
+    finally:
+        if hub is not None:
+            hub.terminate()
+            hub.wait()
+
+    h = summary["hub"]
+    sent = summary["sent"]
+    print(f"{args.devices} canes x {args.rate:.0f} samples/s for {args.seconds:.0f} s: "
+          f"sent {sent['samples']} samples, {sent['bytes'] / 1024:.0f} KiB")
+    print(f"hub: {h['connected']}/{h['devices']} connected, {h['samples_per_s']:.0f} samples/s, "
+          f"{h['bytes_per_s'] / 1024:.1f} KiB/s, loop lag p50/p99 "
+          f"{h['loop_lag_ms']['p50']:.2f}/{h['loop_lag_ms']['p99']:.2f} ms" if h["loop_lag_ms"] else "")
+    lags = [d["lag_ms"] for d in summary["devices"] if d["lag_ms"]]
+    if lags:
+        p50 = sorted(l["p50"] for l in lags)
+        p99 = sorted(l["p99"] for l in lags)
+        print(f"per-cane lag (capture -> hub): p50 median {p50[len(p50) // 2]:.1f} ms, "
+              f"p99 median {p99[len(p99) // 2]:.1f} ms, worst p99 {p99[-1]:.1f} ms ({len(lags)} canes)")
+    ages = [d["age_ms"] for d in summary["devices"] if d["age_ms"] is not None]
+    if ages:
+        print(f"data age at snapshot: max {max(ages):.0f} ms")
+
+
+if __name__ == "__main__":
+    main()
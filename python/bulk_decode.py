@@ -0,0 +1,174 @@
+"""大量二進位遙測解碼（NumPy）：整段串流一次處理，取樣訊框直接解成結構化陣列，不為每筆取樣建立物件。
+
+串流格式與 FrameDecoder 相同（見 telemetry_frame.py）。尋找同步字元、CRC 檢查（依長度分組，
+每組逐欄查表）與取樣欄位擷取都是向量運算；只有其他訊框（參數回覆、差量、事件…）與文字行逐一回傳，
+並附上「之前已有幾筆取樣」以保留先後順序。資料先複製進預先配置的緩衝區，不會隨輸入成長。
+
+差量訊框依賴前一個狀態，無法向量化，仍交給 SampleReconstructor；高取樣率下以 telemetry_delta=0
+（每筆都是完整取樣）最能發揮此路徑。未安裝 NumPy 時 HAVE_NUMPY = False，呼叫端改用 FrameDecoder。
+"""
+from typing import List, Tuple
+
+from telemetry_frame import (FRAME_CRC_LEN, FRAME_HEADER_LEN, FRAME_MAX_PAYLOAD, FRAME_TYPE_SAMPLE,
+                             MAX_TEXT_LINE, SAMPLE_STRUCT, US_TO_CM)
+
+try:
+    import numpy as np
+    HAVE_NUMPY = True
+except ImportError:  # pragma: no cover - 依環境而定
+    np = None
+    HAVE_NUMPY = False
+
+BULK_BUFFER_BYTES = 1 << 20  # 預先配置的輸入緩衝區；單次 feed 超過時分段處理
+
+# ("text", line, samples_before) 或 ("frame", (type, payload), samples_before)
+BulkItem = Tuple[str, object, int]
+
+if HAVE_NUMPY:
+    # 與 SAMPLE_STRUCT（"<HI6hHB"）相同的緊密排列：一列的 tobytes() 就是原始 payload
+    SAMPLE_DTYPE = np.dtype([("seq", "<u2"), ("t_ms", "<u4"),
+                             ("ax", "<i2"), ("ay", "<i2"), ("az", "<i2"),
+                             ("gx", "<i2"), ("gy", "<i2"), ("gz", "<i2"),
+                             ("echo_us", "<u2"), ("flags", "u1")])
+    assert SAMPLE_DTYPE.itemsize == SAMPLE_STRUCT.size
+
+    def _crc_table() -> "np.ndarray":
+        table = np.zeros(256, dtype=np.uint32)
+        for i in range(256):
+            crc = i << 8
+            for _ in range(8):
+                crc = ((crc << 1) ^ 0x1021) if crc & 0x8000 else (crc << 1)
+            table[i] = crc & 0xFFFF
+        return table
+
+    CRC_TABLE = _crc_table()
+    _SAMPLE_COLS = np.arange(SAMPLE_STRUCT.size)
+
+
+def crc16_rows(rows: "np.ndarray") -> "np.ndarray":
+    """每一列各算一個 CRC16-CCITT（與 telemetry_frame.crc16_ccitt 相同），rows 為 (k, n) uint8。"""
+    crc = np.full(rows.shape[0], 0xFFFF, dtype=np.uint32)
+    for j in range(rows.shape[1]):
+        crc = ((crc << 8) & 0xFFFF) ^ CRC_TABLE[((crc >> 8) ^ rows[:, j]) & 0xFF]
+    return crc
+
+
+def distance_cm(samples: "np.ndarray") -> "np.ndarray":
+    """回波時間換算距離（cm），無回波為 0。"""
+    return samples["echo_us"] * US_TO_CM
+
+
+def _text_lines(data: bytes) -> List[str]:
+    out = []
+    for part in data.split(b"\n"):
+        line = part.decode("utf-8", errors="ignore").strip()
+        if line:
+            out.append(line)
+    return out
+
+
+class BulkFrameDecoder:
+    """feed() 回傳 (samples, items)：samples 為 SAMPLE_DTYPE 陣列，items 為依序的其他訊框與文字行。"""
+
+    def __init__(self, capacity: int = BULK_BUFFER_BYTES) -> None:
+        if not HAVE_NUMPY:
+            raise RuntimeError("BulkFrameDecoder 需要 NumPy")
+        self.arr = np.zeros(capacity, dtype=np.uint8)
+        self.n = 0
+        self.frames = 0
+        self.samples = 0
+        self.crc_errors = 0
+
+    def feed(self, data: bytes) -> Tuple["np.ndarray", List[BulkItem]]:
+        src = np.frombuffer(data, dtype=np.uint8)
+        parts = []
+        items: List[BulkItem] = []
+        base = 0
+        off = 0
+        while off < len(src):
+            k = min(len(src) - off, len(self.arr) - self.n)
+            self.arr[self.n:self.n + k] = src[off:off + k]
+            self.n += k
+            off += k
+            samples, more = self._decode(base)
+            if len(samples):
+                parts.append(samples)
+                base += len(samples)
+            items.extend(more)
+        if not parts:
+            return np.empty(0, dtype=SAMPLE_DTYPE), items
+        return (parts[0] if len(parts) == 1 else np.concatenate(parts)), items
+
+    def _decode(self, base: int) -> Tuple["np.ndarray", List[BulkItem]]:
+        n = self.n
+        a = self.arr[:n]
+        empty = np.empty(0, dtype=np.int64)
+        starts = lens = ends = empty
+        pending = n
+        if n >= FRAME_HEADER_LEN:
+            cand = np.flatnonzero((a[:-1] == 0xA5) & (a[1:] == 0x5A))
+            cand = cand[cand + FRAME_HEADER_LEN <= n]
+            lens = a[cand + 3].astype(np.int64)
+            cand, lens = cand[lens <= FRAME_MAX_PAYLOAD], lens[lens <= FRAME_MAX_PAYLOAD]
+            ends = cand + FRAME_HEADER_LEN + lens + FRAME_CRC_LEN
+            complete = ends <= n
+            waiting = cand[~complete]
+            cand, lens, ends = cand[complete], lens[complete], ends[complete]
+
+            valid = np.zeros(len(cand), dtype=bool)
+            for length in np.unique(lens):
+                sel = np.flatnonzero(lens == length)
+                at = cand[sel]
+                rows = a[at[:, None] + 2 + np.arange(2 + length)]
+                got = a[at + 4 + length].astype(np.uint32) | (a[at + 5 + length].astype(np.uint32) << 8)
+                valid[sel] = crc16_rows(rows) == got
+            starts, lens, ends = cand[valid], lens[valid], ends[valid]
+            # payload 內剛好出現通過 CRC 的同步字元：捨棄與前面訊框重疊的
+            if len(starts) > 1:
+                keep = np.ones(len(starts), dtype=bool)
+                keep[1:] = starts[1:] >= np.maximum.accumulate(ends)[:-1]
+                starts, lens, ends = starts[keep], lens[keep], ends[keep]
+            last_end = int(ends[-1]) if len(ends) else 0
+            self.crc_errors += int(np.count_nonzero(~valid))
+            waiting = waiting[waiting >= last_end]
+            if len(waiting):
+                pending = int(waiting[0])
+
+        types = a[starts + 2]
+        is_sample = (types == FRAME_TYPE_SAMPLE) & (lens == SAMPLE_STRUCT.size)
+        counts = is_sample.astype(np.int64)
+        before = base + np.cumsum(counts) - counts   # 每個訊框之前的取樣數
+        total = base + int(counts.sum())
+        self.frames += len(starts)
+
+        sample_at = starts[is_sample]
+        samples = a[sample_at[:, None] + 4 + _SAMPLE_COLS].view(SAMPLE_DTYPE).reshape(-1)
+        self.samples += len(samples)
+
+        # 其他訊框與訊框之間的文字（通常很少）逐一取出，依位置排序
+        positioned = []
+        for i in np.flatnonzero(~is_sample):
+            s, length = int(starts[i]), int(lens[i])
+            positioned.append((s, ("frame", (int(types[i]), a[s + 4:s + 4 + length].tobytes()), int(before[i]))))
+        gap_from = np.concatenate(([0], ends))
+        gap_to = np.concatenate((starts, [pending]))
+        gap_before = np.concatenate((before, [total]))
+        consumed = pending
+        for g in np.flatnonzero(gap_to > gap_from):
+            g0, g1 = int(gap_from[g]), int(gap_to[g])
+            text = a[g0:g1].tobytes()
+            if g == len(starts) and pending == n:
+                # 最後一段：未以換行結束的部分留到下一次（過長視為雜訊丟棄）
+                nl = text.rfind(b"\n")
+                if n - (g0 + nl + 1) <= MAX_TEXT_LINE:
+                    consumed = g0 + nl + 1
+                text = text[:nl + 1]
+            for line in _text_lines(text):
+                positioned.append((g0, ("text", line, int(gap_before[g]))))
+        positioned.sort(key=lambda p: p[0])
+
+        rest = n - consumed
+        if rest:
+            self.arr[:rest] = self.arr[consumed:n].copy()
+        self.n = rest
+        return samples, [item for _, item in positioned]
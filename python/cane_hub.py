@@ -0,0 +1,605 @@
+"""多支手杖集中監看：單一 asyncio 事件迴圈同時接受多個 ESP32 連線（mpu6050_viewer_wifi.py 一次只服務一支）。
+
+每支手杖以 ESP32 連線時送出的 HELLO 訊框（MAC）識別，舊韌體沒有 HELLO 時以來源 IP 識別；
+重新連線沿用同一份狀態。每支手杖各自有：
+  - 解碼狀態（FrameDecoder + SampleReconstructor，每條連線重新開始）
+  - 最近 RING_LEN 筆取樣的環形緩衝（/api/device/<id>?n=）
+  - 即時推送（/api/stream?device=<id>，AsyncLiveFeed，慢的瀏覽器只捨棄舊狀態）
+  - 延遲追蹤（LatencyTracer：時鐘同步 + TRACE 訊框，回波 → 主機的 p50 / p99）
+  - 參數表指令（/api/device/<id>/params?name=&value=）
+總吞吐量（bytes / 訊框 / 取樣每秒）、事件迴圈延遲與每支手杖的資料年齡每 STATS_SEC 印出一次，
+也可由 /api/devices 與 /api/stream 取得。HTTP 與 SSE 同樣在這個事件迴圈內，不另開執行緒。
+
+    python cane_hub.py [--port 5001] [--web-port 5000] [--no-browser]
+
+負載測試見 bench_hub.py。只支援 TCP（ESP32 以 LINK_TRANSPORT_TCP 編譯）。
+"""
+import argparse
+import asyncio
+import json
+import os
+import time
+import webbrowser
+from collections import deque
+from typing import Deque, Dict, Optional, Tuple
+from urllib.parse import parse_qs, unquote, urlparse
+
+from latency_trace import HopStats, LatencyTracer, host_us
+from live_feed import AsyncLiveFeed, serve_sse_async, sse_message
+from telemetry_frame import (FRAME_TYPE_BACKLOG, FRAME_TYPE_DELTA, FRAME_TYPE_ESP_TRACE, FRAME_TYPE_EVENT,
+                             FRAME_TYPE_HELLO, FRAME_TYPE_PARAM, FRAME_TYPE_RANGES, FRAME_TYPE_SAMPLE,
+                             FRAME_TYPE_SYNC, FRAME_TYPE_TRACE, SAMPLE_FLAG_BUZZER, SAMPLE_FLAG_COOLDOWN,
+                             SAMPLE_FLAG_HIT, SAMPLE_FLAG_MOTOR, FrameDecoder, SampleReconstructor,
+                             decode_backlog, decode_esp_trace, decode_event, decode_hello, decode_param,
+                             decode_ranges, decode_sync, decode_trace, encode_param_get, encode_param_set)
+
+# --- 設定 ---
+TCP_HOST = "0.0.0.0"
+TCP_PORT = 5001            # 與 mpu6050_viewer_wifi.py 相同（ESP32 的 SERVER_PORT）
+WEB_PORT = 5000
+READ_SIZE = 4096
+RING_LEN = 2000            # 每支手杖保留的最近取樣數
+TEXT_LINES = 20            # 每支手杖保留的最近文字行
+IDLE_TIMEOUT_SEC = 10.0    # 這段時間沒有資料視為連線中斷（半開連線）
+COMMAND_POLL_SEC = 0.2     # 送出排入的指令與時鐘同步的間隔
+PUBLISH_MIN_SEC = 0.05     # 每支手杖推送狀態的最短間隔（瀏覽器最多約 20 fps）
+STATS_SEC = 5.0            # 吞吐量統計與終端輸出間隔
+LOOP_PROBE_SEC = 0.05      # 量測事件迴圈延遲的間隔
+BACKLOG_DIR = "backlog"    # 補送資料依手杖寫入 <dir>/<id>.jsonl；None = 不記錄
+BACKLOG_FLUSH_SEC = 1.0    # 補送資料累積多久寫檔一次（在執行緒池寫入，不阻塞事件迴圈）
+
+
+class RateMeter:
+    """計數器每 STATS_SEC 取一次差值換算每秒速率。"""
+
+    def __init__(self) -> None:
+        self.total = 0
+        self.mark = 0
+        self.mark_t = time.monotonic()
+        self.rate = 0.0
+
+    def add(self, n: int = 1) -> None:
+        self.total += n
+
+    def roll(self, now: float) -> None:
+        dt = now - self.mark_t
+        if dt > 0:
+            self.rate = (self.total - self.mark) / dt
+        self.mark, self.mark_t = self.total, now
+
+
+class Device:
+    def __init__(self, device_id: str, addr: str) -> None:
+        self.id = device_id
+        self.addr = addr
+        self.mac: Optional[str] = None
+        self.esp_connects: Optional[int] = None
+        self.connects = 0
+        self.connected = False
+        self.connected_since = 0.0
+        self.writer: Optional[asyncio.StreamWriter] = None
+        self.ring: Deque[Tuple[int, int, float, int]] = deque(maxlen=RING_LEN)  # (host_rx_us, t_ms, cm, flags)
+        self.lines: Deque[str] = deque(maxlen=TEXT_LINES)
+        self.last_sample: Optional[dict] = None
+        self.last_rx_us = 0
+        self.ranges_cm = None
+        self.events: Dict[str, int] = {}
+        self.params: Dict[str, dict] = {}
+        self.commands: list = []
+        self.backlog_items = 0
+        self.crc_errors = 0
+        self.desync = 0
+        self.rx_bytes = RateMeter()
+        self.rx_frames = RateMeter()
+        self.rx_samples = RateMeter()
+        self.tracer = LatencyTracer()
+        self.feed = AsyncLiveFeed()
+        self.last_publish = 0.0
+
+    def age_ms(self) -> Optional[float]:
+        return (host_us() - self.last_rx_us) / 1000.0 if self.last_rx_us else None
+
+    def summary(self) -> dict:
+        s = self.last_sample
+        flags = s["flags"] if s else 0
+        total = self.tracer.hops["total"].summary()
+        return {
+            "id": self.id, "addr": self.addr, "mac": self.mac, "connected": self.connected,
+            "connects": self.connects, "esp_connects": self.esp_connects,
+            "uptime_s": time.time() - self.connected_since if self.connected else None,
+            "bytes_per_s": self.rx_bytes.rate, "frames_per_s": self.rx_frames.rate,
+            "samples_per_s": self.rx_samples.rate, "samples": self.rx_samples.total,
+            "age_ms": self.age_ms(),
+            "lag_ms": {"p50": total["p50"], "p99": total["p99"]} if total else None,
+            "distance_cm": s["distance_cm"] if s else None,
+            "hit": bool(flags & SAMPLE_FLAG_HIT), "buzzer": bool(flags & SAMPLE_FLAG_BUZZER),
+            "motor": bool(flags & SAMPLE_FLAG_MOTOR), "cooldown": bool(flags & SAMPLE_FLAG_COOLDOWN),
+            "events": dict(self.events), "backlog_items": self.backlog_items,
+            "crc_errors": self.crc_errors, "desync": self.desync,
+        }
+
+    def snapshot(self) -> dict:
+        data = self.summary()
+        data.update(sample=self.last_sample, ranges_cm=self.ranges_cm, lines=list(self.lines),
+                    sample_id=self.last_rx_us, feed=self.feed.stats())
+        return data
+
+    def history(self, n: int) -> list:
+        items = list(self.ring)[-n:] if n > 0 else []
+        return [{"rx_us": r[0], "t_ms": r[1], "distance_cm": r[2], "flags": r[3]} for r in items]
+
+    def send(self, data: bytes) -> None:
+        if self.writer is not None and not self.writer.is_closing():
+            self.writer.write(data)
+
+
+class Hub:
+    def __init__(self) -> None:
+        self.devices: Dict[str, Device] = {}
+        self.hub_feed = AsyncLiveFeed()
+        self.rx_bytes = RateMeter()
+        self.rx_frames = RateMeter()
+        self.rx_samples = RateMeter()
+        self.loop_lag = HopStats()
+        self.started = time.time()
+        self.backlog_pending: Dict[str, list] = {}  # 檔名 -> 尚未寫入的補送紀錄
+
+    def connected(self) -> int:
+        return sum(1 for d in self.devices.values() if d.connected)
+
+    def summary(self) -> dict:
+        lag = self.loop_lag.summary()
+        return {
+            "hub": {
+                "devices": len(self.devices), "connected": self.connected(),
+                "bytes_per_s": self.rx_bytes.rate, "frames_per_s": self.rx_frames.rate,
+                "samples_per_s": self.rx_samples.rate, "samples": self.rx_samples.total,
+                "loop_lag_ms": {"p50": lag["p50"], "p99": lag["p99"]} if lag else None,
+                "uptime_s": time.time() - self.started,
+            },
+            "devices": [d.summary() for d in sorted(self.devices.values(), key=lambda d: d.id)],
+        }
+
+    # --- 裝置連線 ---
+
+    def bind(self, device_id: str, addr: str, writer: asyncio.StreamWriter) -> Device:
+        dev = self.devices.get(device_id)
+        if dev is None:
+            dev = self.devices[device_id] = Device(device_id, addr)
+        elif dev.connected and dev.writer is not writer and dev.writer is not None:
+            dev.writer.close()  # 同一支手杖重新連線時，舊連線（多半已半開）由新的取代
+        dev.addr = addr
+        dev.writer = writer
+        dev.connected = True
+        dev.connected_since = time.time()
+        dev.connects += 1
+        dev.tracer.reset_pending()
+        print(f"Device {device_id} connected from {addr} (#{dev.connects})")
+        return dev
+
+    async def handle_device(self, reader: asyncio.StreamReader, writer: asyncio.StreamWriter) -> None:
+        peer = writer.get_extra_info("peername")
+        addr = peer[0] if peer else "?"
+        decoder = FrameDecoder()
+        samples = SampleReconstructor()
+        backlog = (FrameDecoder(), SampleReconstructor())
+        dev: Optional[Device] = None
+        commands = None
+        try:
+            while True:
+                try:
+                    data = await asyncio.wait_for(reader.read(READ_SIZE), IDLE_TIMEOUT_SEC)
+                except asyncio.TimeoutError:
+                    print(f"Device {dev.id if dev else addr}: no data for {IDLE_TIMEOUT_SEC:.0f} s, closing")
+                    break
+                if not data:
+                    break
+                rx_us = host_us()
+                errors = decoder.crc_errors
+                items = decoder.feed(data)
+                if dev is None:
+                    # 第一個訊框是 HELLO 時以 MAC 識別，否則（舊韌體）以來源 IP 識別
+                    hello = None
+                    if items and items[0][0] == "frame" and items[0][1][0] == FRAME_TYPE_HELLO:
+                        hello = decode_hello(items[0][1][1])
+                    if hello is None and not items:
+                        continue
+                    dev = self.bind(hello["mac"] if hello else addr, addr, writer)
+                    commands = asyncio.ensure_future(self.command_loop(dev, writer))
+                dev.crc_errors += decoder.crc_errors - errors
+                dev.rx_bytes.add(len(data))
+                self.rx_bytes.add(len(data))
+                for kind, item in items:
+                    if kind == "text":
+                        dev.lines.append(item)
+                    else:
+                        self.handle_frame(dev, samples, backlog, item[0], item[1], rx_us)
+                dev.desync = samples.desync
+                self.publish(dev)
+        except (ConnectionResetError, OSError):
+            pass
+        finally:
+            if commands is not None:
+                commands.cancel()
+            if dev is not None and dev.writer is writer:
+                dev.connected = False
+                dev.writer = None
+                print(f"Device {dev.id} disconnected")
+                self.publish(dev, force=True)
+            writer.close()
+
+    def handle_frame(self, dev: Device, samples: SampleReconstructor, backlog, ftype: int,
+                     payload: bytes, rx_us: int) -> None:
+        dev.rx_frames.add()
+        self.rx_frames.add()
+        if ftype in (FRAME_TYPE_SAMPLE, FRAME_TYPE_DELTA):
+            sample = samples.feed(ftype, payload)
+            if sample is None:
+                return
+            dev.last_sample = sample
+            dev.last_rx_us = rx_us
+            dev.ring.append((rx_us, int(sample["t_ms"]), sample["distance_cm"], int(sample["flags"])))
+            dev.rx_samples.add()
+            self.rx_samples.add()
+        elif ftype == FRAME_TYPE_HELLO:
+            hello = decode_hello(payload)
+            if hello is not None:
+                dev.mac, dev.esp_connects = hello["mac"], hello["connects"]
+        elif ftype == FRAME_TYPE_SYNC:
+            reply = decode_sync(payload)
+            if reply is not None:
+                dev.tracer.on_sync(reply, rx_us)
+        elif ftype == FRAME_TYPE_TRACE:
+            trace = decode_trace(payload)
+            if trace is not None:
+                dev.tracer.on_trace(trace, rx_us)
+        elif ftype == FRAME_TYPE_ESP_TRACE:
+            trace = decode_esp_trace(payload)
+            if trace is not None:
+                dev.tracer.on_esp_trace(trace)
+        elif ftype == FRAME_TYPE_EVENT:
+            ev = decode_event(payload)
+            if ev is not None:
+                dev.events[ev["event"]] = dev.events.get(ev["event"], 0) + 1
+                self.publish(dev, force=True)  # 警示事件不等推送間隔
+        elif ftype == FRAME_TYPE_RANGES:
+            ranges = decode_ranges(payload)
+            if ranges is not None:
+                dev.ranges_cm = ranges
+        elif ftype == FRAME_TYPE_PARAM:
+            reply = decode_param(payload)
+            if reply is not None and reply["name"]:
+                dev.params[reply["name"]] = reply
+        elif ftype == FRAME_TYPE_BACKLOG:
+            self.handle_backlog(dev, backlog, payload)
+
+    def handle_backlog(self, dev: Device, backlog, payload: bytes) -> None:
+        """補送資料已是過去的數據：不更新即時狀態，只計數並排入 backlog_writer 寫入 BACKLOG_DIR。"""
+        decoded = decode_backlog(payload)
+        if decoded is None:
+            return
+        esp_t_ms, chunk = decoded
+        decoder, samples = backlog
+        records = []
+        for kind, item in decoder.feed(chunk):
+            if kind == "text":
+                records.append({"esp_t_ms": esp_t_ms, "text": item})
+                continue
+            ftype, body = item
+            if ftype in (FRAME_TYPE_SAMPLE, FRAME_TYPE_DELTA):
+                sample = samples.feed(ftype, body)
+                if sample is not None:
+                    records.append({"esp_t_ms": esp_t_ms, "sample": sample})
+            elif ftype == FRAME_TYPE_EVENT:
+                records.append({"esp_t_ms": esp_t_ms, "event": decode_event(body)})
+        dev.backlog_items += len(records)
+        if BACKLOG_DIR and records:
+            self.backlog_pending.setdefault(dev.id.replace(":", "") + ".jsonl", []).extend(records)
+
+    async def command_loop(self, dev: Device, writer: asyncio.StreamWriter) -> None:
+        """排入的參數指令與時鐘同步指令，與接收共用同一條連線。"""
+        while not writer.is_closing():
+            pending, dev.commands = dev.commands, []
+            for cmd in pending:
+                dev.send(cmd)
+            dev.tracer.poll_sync(dev.send)
+            await asyncio.sleep(COMMAND_POLL_SEC)
+
+    def publish(self, dev: Device, force: bool = False) -> None:
+        """有瀏覽器看著這支手杖時推送狀態；一般資料以 PUBLISH_MIN_SEC 限速。"""
+        if not dev.feed.has_clients():
+            return
+        now = time.monotonic()
+        if not force and now - dev.last_publish < PUBLISH_MIN_SEC:
+            return
+        dev.last_publish = now
+        dev.feed.publish("state", dev.snapshot())
+
+    # --- 背景工作 ---
+
+    async def stats_loop(self) -> None:
+        while True:
+            await asyncio.sleep(STATS_SEC)
+            now = time.monotonic()
+            for m in (self.rx_bytes, self.rx_frames, self.rx_samples):
+                m.roll(now)
+            for d in self.devices.values():
+                for m in (d.rx_bytes, d.rx_frames, d.rx_samples):
+                    m.roll(now)
+            lag = self.loop_lag.summary()
+            ages = [d.age_ms() for d in self.devices.values() if d.connected and d.last_rx_us]
+            print(f"Hub: {self.connected()}/{len(self.devices)} devices, {self.rx_samples.rate:.0f} samples/s, "
+                  f"{self.rx_frames.rate:.0f} frames/s, {self.rx_bytes.rate / 1024:.1f} KiB/s, "
+                  f"loop lag p99 {lag['p99'] if lag else 0:.1f} ms, max age {max(ages) if ages else 0:.0f} ms")
+
+    async def backlog_writer(self) -> None:
+        """唯一寫入補送檔的工作：每 BACKLOG_FLUSH_SEC 把累積的紀錄交給執行緒池寫入。"""
+        loop = asyncio.get_running_loop()
+        while True:
+            await asyncio.sleep(BACKLOG_FLUSH_SEC)
+            if not self.backlog_pending:
+                continue
+            pending, self.backlog_pending = self.backlog_pending, {}
+            try:
+                await loop.run_in_executor(None, write_backlog, pending)
+            except OSError as e:
+                print(f"Backlog write failed: {e}")
+
+    async def loop_probe(self) -> None:
+        """事件迴圈延遲：sleep 實際醒來比預定晚多少（處理太多資料時變大）。"""
+        loop = asyncio.get_running_loop()
+        while True:
+            t0 = loop.time()
+            await asyncio.sleep(LOOP_PROBE_SEC)
+            self.loop_lag.add(max(0.0, (loop.time() - t0 - LOOP_PROBE_SEC) * 1000.0))
+
+    # --- HTTP ---
+
+    async def handle_http(self, reader: asyncio.StreamReader, writer: asyncio.StreamWriter) -> None:
+        try:
+            request = await asyncio.wait_for(reader.readline(), 10.0)
+            parts = request.decode("latin-1").split()
+            while True:
+                header = await asyncio.wait_for(reader.readline(), 10.0)
+                if header in (b"\r\n", b"\n", b""):
+                    break
+            if len(parts) < 2 or parts[0] != "GET":
+                self.respond(writer, 405, b"", "text/plain")
+                return
+            url = urlparse(parts[1])
+            await self.route(writer, url.path, parse_qs(url.query))
+        except (asyncio.TimeoutError, ConnectionResetError, OSError):
+            pass
+        finally:
+            writer.close()
+
+    @staticmethod
+    def respond(writer: asyncio.StreamWriter, status: int, body: bytes, ctype: str = "application/json") -> None:
+        reason = {200: "OK", 400: "Bad Request", 404: "Not Found", 405: "Method Not Allowed"}.get(status, "")
+        writer.write(f"HTTP/1.1 {status} {reason}\r\nContent-Type: {ctype}\r\nContent-Length: {len(body)}\r\n"
+                     f"Access-Control-Allow-Origin: *\r\nConnection: close\r\n\r\n".encode("latin-1") + body)
+
+    def json(self, writer: asyncio.StreamWriter, data: object) -> None:
+        self.respond(writer, 200, json.dumps(data).encode("utf-8"))
+
+    async def route(self, writer: asyncio.StreamWriter, path: str, query: Dict[str, list]) -> None:
+        if path in ("/", "/index.html"):
+            self.respond(writer, 200, HUB_HTML.encode("utf-8"), "text/html; charset=utf-8")
+        elif path == "/api/devices":
+            self.json(writer, self.summary())
+        elif path == "/api/stream":
+            # 不指定 device：每秒推送所有手杖的摘要；指定 device：該手杖的即時狀態
+            device_id = query.get("device", [None])[0]
+            if device_id is None:
+                await serve_sse_async(writer, self.hub_feed, lambda: sse_message("devices", self.summary()))
+                return
+            dev = self.devices.get(device_id)
+            if dev is None:
+                self.respond(writer, 404, b"{}")
+                return
+            await serve_sse_async(writer, dev.feed, lambda: sse_message("latency", dev.tracer.summary()))
+        elif path.startswith("/api/device/"):
+            rest = path[len("/api/device/"):]
+            want_params = rest.endswith("/params")
+            dev = self.devices.get(unquote(rest[:-len("/params")] if want_params else rest))
+            if dev is None:
+                self.respond(writer, 404, b"{}")
+            elif want_params:
+                self.json(writer, self.params(dev, query))
+            else:
+                try:
+                    n = int(query.get("n", ["200"])[0])
+                except ValueError:
+                    self.respond(writer, 400, b'{"error": "n must be an integer"}')
+                    return
+                data = dev.snapshot()
+                data["history"] = dev.history(n)
+                data["latency"] = dev.tracer.summary()
+                self.json(writer, data)
+        else:
+            self.respond(writer, 404, b"", "text/plain")
+
+    @staticmethod
+    def params(dev: Device, query: Dict[str, list]) -> dict:
+        """參數表；name + value 時排入設定指令（回覆到達後更新），與 mpu6050_viewer_wifi.py 的 /api/params 相同。"""
+        result = {"queued": False}
+        if "name" in query and "value" in query:
+            info = dev.params.get(query["name"][0])
+            try:
+                value = float(query["value"][0])
+            except ValueError:
+                value = None
+            if info is not None and value is not None:
+                dev.commands.append(encode_param_set(info["id"], value))
+                result["queued"] = True
+        elif "refresh" in query or not dev.params:
+            dev.commands.append(encode_param_get())
+            result["queued"] = True
+        result["params"] = dev.params
+        return result
+
+
+def write_backlog(pending: Dict[str, list]) -> None:
+    """在執行緒池執行：依檔名附加寫入補送紀錄（與 mpu6050_viewer_wifi.py 相同格式）。"""
+    os.makedirs(BACKLOG_DIR, exist_ok=True)
+    for name, records in pending.items():
+        with open(os.path.join(BACKLOG_DIR, name), "a", encoding="utf-8") as f:
+            f.write("".join(json.dumps(r) + "\n" for r in records))
+
+
+HUB_HTML = """<!DOCTYPE html>
+<html lang="zh-TW">
+<head>
+    <meta charset="UTF-8">
+    <meta name="viewport" content="width=device-width, initial-scale=1.0">
+    <title>手杖集中監看</title>
+    <style>
+        * { margin: 0; padding: 0; box-sizing: border-box; }
+        body {
+            font-family: 'Microsoft JhengHei', 'Segoe UI', Arial, sans-serif;
+            background: linear-gradient(135deg, #667eea 0%, #764ba2 100%);
+            min-height: 100vh;
+            padding: 20px;
+        }
+        .container {
+            max-width: 1400px;
+            margin: 0 auto;
+            background: white;
+            border-radius: 24px;
+            box-shadow: 0 20px 60px rgba(0,0,0,0.3);
+            padding: 32px;
+        }
+        h1 { text-align: center; color: #2c3e50; margin-bottom: 12px; font-size: 2.2em; }
+        #hub { text-align: center; color: #555; margin-bottom: 24px; }
+        .grid { display: grid; grid-template-columns: repeat(auto-fill, minmax(220px, 1fr)); gap: 16px; }
+        .card {
+            background: linear-gradient(135deg, #667eea 0%, #764ba2 100%);
+            color: white; padding: 16px; border-radius: 14px; cursor: pointer;
+            box-shadow: 0 6px 16px rgba(0,0,0,0.15);
+        }
+        .card.offline { background: #95a5a6; }
+        .card.alert { background: linear-gradient(135deg, #e74c3c 0%, #c0392b 100%); }
+        .card.selected { outline: 4px solid #f1c40f; }
+        .card .name { font-weight: 700; font-size: 1.05em; margin-bottom: 6px; word-break: break-all; }
+        .card .dist { font-size: 2em; font-weight: 700; }
+        .card .meta { font-size: 0.85em; opacity: 0.9; margin-top: 4px; }
+        #detail { margin-top: 28px; display: none; }
+        #detail h2 { color: #2c3e50; margin-bottom: 12px; word-break: break-all; }
+        #plot { width: 100%; height: 200px; background: #f4f6fb; border-radius: 12px; }
+        #info { margin-top: 12px; color: #2c3e50; font-family: Consolas, monospace; font-size: 0.9em; white-space: pre-wrap; }
+    </style>
+</head>
+<body>
+    <div class="container">
+        <h1>手杖集中監看</h1>
+        <div id="hub">等待手杖連線…</div>
+        <div class="grid" id="grid"></div>
+        <div id="detail">
+            <h2 id="detail_title"></h2>
+            <canvas id="plot"></canvas>
+            <div id="info"></div>
+        </div>
+    </div>
+    <script>
+        const fmt = (v, d = 1) => (v === null || v === undefined) ? '--' : Number(v).toFixed(d);
+        let selected = null, deviceSource = null, history = [];
+
+        function renderHub(data) {
+            const h = data.hub;
+            document.getElementById('hub').textContent =
+                `${h.connected}/${h.devices} 支連線 · ${fmt(h.samples_per_s, 0)} 取樣/s · ` +
+                `${fmt(h.bytes_per_s / 1024)} KiB/s · 事件迴圈延遲 p99 ${h.loop_lag_ms ? fmt(h.loop_lag_ms.p99) : '--'} ms`;
+            const grid = document.getElementById('grid');
+            grid.innerHTML = '';
+            for (const d of data.devices) {
+                const card = document.createElement('div');
+                card.className = 'card' + (!d.connected ? ' offline' : (d.hit || d.buzzer) ? ' alert' : '') +
+                                 (d.id === selected ? ' selected' : '');
+                card.innerHTML = `<div class="name">${d.id}</div>` +
+                    `<div class="dist">${fmt(d.distance_cm)} cm</div>` +
+                    `<div class="meta">${fmt(d.samples_per_s, 0)} 取樣/s · 資料年齡 ${fmt(d.age_ms, 0)} ms</div>` +
+                    `<div class="meta">延遲 p50 / p99 ${d.lag_ms ? fmt(d.lag_ms.p50) + ' / ' + fmt(d.lag_ms.p99) : '--'} ms</div>`;
+                card.onclick = () => select(d.id);
+                grid.appendChild(card);
+            }
+        }
+
+        function select(id) {
+            selected = id;
+            if (deviceSource) deviceSource.close();
+            history = [];
+            document.getElementById('detail').style.display = 'block';
+            document.getElementById('detail_title').textContent = id;
+            fetch('/api/device/' + encodeURIComponent(id) + '?n=400').then(r => r.json()).then(d => {
+                history = d.history.map(s => s.distance_cm);
+                renderDevice(d);
+            });
+            deviceSource = new EventSource('/api/stream?device=' + encodeURIComponent(id));
+            deviceSource.addEventListener('state', e => {
+                const d = JSON.parse(e.data);
+                if (d.sample) {
+                    history.push(d.sample.distance_cm);
+                    if (history.length > 400) history.shift();
+                }
+                renderDevice(d);
+            });
+        }
+
+        function renderDevice(d) {
+            const c = document.getElementById('plot');
+            c.width = c.clientWidth;
+            c.height = c.clientHeight;
+            const g = c.getContext('2d');
+            g.clearRect(0, 0, c.width, c.height);
+            const max = Math.max(100, ...history);
+            g.strokeStyle = '#764ba2';
+            g.lineWidth = 2;
+            g.beginPath();
+            history.forEach((v, i) => {
+                const x = i * c.width / 400, y = c.height - v / max * (c.height - 10);
+                if (i) g.lineTo(x, y); else g.moveTo(x, y);
+            });
+            g.stroke();
+            document.getElementById('info').textContent =
+                `${d.connected ? '連線中' : '離線'}  ${d.addr}  連線 ${d.connects} 次\\n` +
+                `距離 ${fmt(d.distance_cm)} cm  警示 ${d.hit ? '是' : '否'}  蜂鳴器 ${d.buzzer ? '開' : '關'}  ` +
+                `馬達 ${d.motor ? '開' : '關'}  冷卻 ${d.cooldown ? '是' : '否'}\\n` +
+                `事件 ${JSON.stringify(d.events)}  補送 ${d.backlog_items}  CRC 錯誤 ${d.crc_errors}\\n` +
+                (d.lines && d.lines.length ? d.lines.slice(-5).join('\\n') : '');
+        }
+
+        const hubSource = new EventSource('/api/stream');
+        hubSource.addEventListener('devices', e => renderHub(JSON.parse(e.data)));
+    </script>
+</body>
+</html>
+"""
+
+
+async def serve(hub: Hub, port: int, web_port: int, open_browser: bool) -> None:
+    devices = await asyncio.start_server(hub.handle_device, TCP_HOST, port)
+    web = await asyncio.start_server(hub.handle_http, "0.0.0.0", web_port)
+    print(f"Cane hub: devices on TCP {port}, web on http://localhost:{web_port}")
+    if open_browser:
+        webbrowser.open(f"http://localhost:{web_port}")
+    asyncio.ensure_future(hub.stats_loop())
+    asyncio.ensure_future(hub.loop_probe())
+    asyncio.ensure_future(hub.backlog_writer())
+    async with devices, web:
+        await asyncio.gather(devices.serve_forever(), web.serve_forever())
+
+
+def main() -> None:
+    ap = argparse.ArgumentParser()
+    ap.add_argument("--port", type=int, default=TCP_PORT, help="ESP32 連線的 TCP 端口")
+    ap.add_argument("--web-port", type=int, default=WEB_PORT)
+    ap.add_argument("--no-browser", action="store_true")
+    args = ap.parse_args()
+    try:
+        asyncio.run(serve(Hub(), args.port, args.web_port, not args.no_browser))
+    except KeyboardInterrupt:
+        pass
+
+
+if __name__ == "__main__":
+    main()
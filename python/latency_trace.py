@@ -0,0 +1,168 @@
+"""端到端延遲追蹤：各段時間戳記換算到主機時鐘後統計每一段的 p50 / p99。
+
+時間點（見 stm32/telemetry_frame.h 的 TRACE / SYNC 訊框與 esp32/esp32_wifi_tcp.cpp 的 ESP_TRACE）：
+  capture  STM32 收到回波（us_ticker）
+  stm_tx   STM32 把訊框放入 UART 輸出佇列
+  esp_rx   ESP32 由 UART 收到該 TRACE 訊框（micros()）
+  esp_tx   ESP32 送出該批資料
+  host_rx  主機讀到資料（time.monotonic）
+  render   瀏覽器畫出含該取樣的畫面（由網頁回報）
+
+兩個裝置的時鐘各以 SYNC 指令估計偏移：主機記下送出 / 收到回覆的時間，裝置回覆收到 / 送出的時間，
+取最近幾次中來回時間最短的一次（路徑最接近對稱）。裝置時間都是會溢位的 u32 µs，
+換算時以接近的主機時間解開溢位。同一個時鐘內的段落（stm32、esp32）不需要同步就有結果。
+"""
+import threading
+import time
+from collections import deque
+from typing import Callable, Deque, Dict, Optional, Tuple
+
+from telemetry_frame import SYNC_SOURCES, encode_time_sync
+
+WRAP = 1 << 32
+SYNC_SEC = 1.0        # 每個裝置的同步間隔
+SYNC_WINDOW = 8       # 取最近幾次同步中來回最短的一次（補償時鐘漂移需要較短的視窗）
+SYNC_TIMEOUT_SEC = 5.0
+HOP_WINDOW = 500      # 每段保留的最近樣本數
+
+HOPS = ("stm32", "uart", "esp32", "wifi", "render", "total")  # total = capture -> host_rx
+HIST_EDGES_MS = (1, 2, 5, 10, 20, 50, 100, 200, 500)
+
+
+def host_us() -> int:
+    return time.monotonic_ns() // 1000
+
+
+def _signed32(v: float) -> float:
+    v %= WRAP
+    return v - WRAP if v >= WRAP // 2 else v
+
+
+class ClockSync:
+    """單一裝置相對主機的時鐘偏移（裝置時間 - 主機時間，mod 2^32）。"""
+
+    def __init__(self, window: int = SYNC_WINDOW) -> None:
+        self.samples: Deque[Tuple[float, float]] = deque(maxlen=window)  # (rtt_us, offset)
+        self.offset: Optional[float] = None
+        self.rtt_us: Optional[float] = None
+
+    def add(self, t0: int, rx_us: int, tx_us: int, t3: int) -> None:
+        """t0 / t3：主機送出指令與收到回覆的時間；rx_us / tx_us：裝置收到指令與送出回覆的時間。"""
+        a = (rx_us - t0) % WRAP
+        b = a + _signed32(tx_us - t3 - a)
+        rtt = (t3 - t0) - _signed32(tx_us - rx_us)
+        if rtt < 0:
+            return
+        self.samples.append((rtt, ((a + b) / 2) % WRAP))
+        self.rtt_us, self.offset = min(self.samples)
+
+    def to_host(self, dev_us: int, ref_host_us: int) -> Optional[float]:
+        """裝置時間換算為主機時間；ref_host_us 為接近該事件的主機時間（例如收到訊框的時間）。"""
+        if self.offset is None:
+            return None
+        return ref_host_us + _signed32(dev_us - self.offset - ref_host_us)
+
+
+class HopStats:
+    """一段延遲最近 HOP_WINDOW 筆的分位數與直方圖（ms）。"""
+
+    def __init__(self, window: int = HOP_WINDOW) -> None:
+        self.values: Deque[float] = deque(maxlen=window)
+
+    def add(self, ms: float) -> None:
+        self.values.append(ms)
+
+    def summary(self) -> Optional[Dict[str, object]]:
+        if not self.values:
+            return None
+        ordered = sorted(self.values)
+        n = len(ordered)
+
+        def pct(q: float) -> float:
+            return ordered[min(n - 1, int(round(q * (n - 1))))]
+
+        hist = [0] * (len(HIST_EDGES_MS) + 1)
+        for v in ordered:
+            i = 0
+            while i < len(HIST_EDGES_MS) and v >= HIST_EDGES_MS[i]:
+                i += 1
+            hist[i] += 1
+        return {"n": n, "p50": pct(0.50), "p99": pct(0.99), "hist": hist}
+
+
+class LatencyTracer:
+    """由讀取執行緒餵入 SYNC / TRACE / ESP_TRACE 訊框，網頁執行緒讀取統計與回報繪製延遲。"""
+
+    def __init__(self) -> None:
+        self.clocks = {s: ClockSync() for s in SYNC_SOURCES}
+        self.hops = {h: HopStats() for h in HOPS}
+        self.pending: Dict[int, Tuple[str, int]] = {}  # token -> (source, 送出時間)
+        self.token = 0
+        self.next_sync_us = 0
+        self.esp_trace: Optional[Dict[str, int]] = None
+        self.lock = threading.Lock()
+
+    def poll_sync(self, send: Callable[[bytes], object]) -> None:
+        """時間到時對每個裝置送出同步指令（在實際送出前記錄時間）。"""
+        now = host_us()
+        if now < self.next_sync_us:
+            return
+        self.next_sync_us = now + int(SYNC_SEC * 1e6)
+        for source in SYNC_SOURCES:
+            with self.lock:
+                self.token = (self.token + 1) & 0xFFFFFFFF
+                token = self.token
+                self.pending = {k: v for k, v in self.pending.items()
+                                if now - v[1] < SYNC_TIMEOUT_SEC * 1e6}
+                self.pending[token] = (source, host_us())
+            send(encode_time_sync(source, token))
+
+    def on_sync(self, reply: Dict[str, object], host_rx_us: int) -> None:
+        with self.lock:
+            req = self.pending.pop(reply["token"], None)
+            if req is None or req[0] != reply["source"]:
+                return
+            self.clocks[req[0]].add(req[1], reply["rx_us"], reply["tx_us"], host_rx_us)
+
+    def on_esp_trace(self, trace: Dict[str, int]) -> None:
+        """ESP_TRACE 緊接在含 TRACE 訊框的那批資料之前，留給下一個 TRACE 訊框。"""
+        with self.lock:
+            self.esp_trace = trace
+
+    def reset_pending(self) -> None:
+        """串流不連續（UDP 遺失、重新連線）時捨棄尚未配對的 ESP_TRACE。"""
+        with self.lock:
+            self.esp_trace = None
+
+    def on_trace(self, trace: Dict[str, int], host_rx_us: int) -> None:
+        with self.lock:
+            esp, self.esp_trace = self.esp_trace, None
+            self.hops["stm32"].add(_signed32(trace["tx_us"] - trace["capture_us"]) / 1000.0)
+            stm = self.clocks["stm32"]
+            capture = stm.to_host(trace["capture_us"], host_rx_us)
+            stm_tx = stm.to_host(trace["tx_us"], host_rx_us)
+            if capture is not None:
+                self.hops["total"].add((host_rx_us - capture) / 1000.0)
+            if esp is None:
+                return
+            self.hops["esp32"].add(_signed32(esp["tx_us"] - esp["rx_us"]) / 1000.0)
+            clock = self.clocks["esp32"]
+            esp_rx = clock.to_host(esp["rx_us"], host_rx_us)
+            esp_tx = clock.to_host(esp["tx_us"], host_rx_us)
+            if esp_tx is not None:
+                self.hops["wifi"].add((host_rx_us - esp_tx) / 1000.0)
+            if esp_rx is not None and stm_tx is not None:
+                self.hops["uart"].add((esp_rx - stm_tx) / 1000.0)
+
+    def on_render(self, ms: float) -> None:
+        with self.lock:
+            self.hops["render"].add(ms)
+
+    def summary(self) -> Dict[str, object]:
+        with self.lock:
+            return {
+                "hops": {h: s.summary() for h, s in self.hops.items()},
+                "hist_edges_ms": list(HIST_EDGES_MS),
+                "sync_rtt_ms": {s: (c.rtt_us / 1000.0 if c.rtt_us is not None else None)
+                                for s, c in self.clocks.items()},
+            }
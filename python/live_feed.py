@@ -0,0 +1,166 @@
+"""即時推送（Server-Sent Events）：讀取執行緒發布訊息，每個瀏覽器連線各有一個有界佇列。
+
+發布端永不阻塞：訊息只序列化一次，放進每個連線的佇列；佇列滿時捨棄該連線最舊的訊息並計數，
+慢的瀏覽器只會跳過幾個狀態，不會拖慢讀取執行緒或其他瀏覽器。每個連線由自己的 HTTP 執行緒送出。
+AsyncLiveFeed / serve_sse_async 是同樣行為的 asyncio 版本（cane_hub.py），發布與送出都在同一個事件迴圈。
+"""
+import asyncio
+import json
+import threading
+import time
+from collections import deque
+from typing import Callable, Deque, List, Optional
+
+FEED_QUEUE_LEN = 32        # 每個連線最多暫存的訊息數
+FEED_HEARTBEAT_SEC = 1.0   # periodic 訊息的間隔；沒有訊息時也以此間隔送出 keepalive
+
+
+def sse_message(event: str, data: object) -> bytes:
+    return f"event: {event}\ndata: {json.dumps(data, separators=(',', ':'))}\n\n".encode("utf-8")
+
+
+class FeedClient:
+    def __init__(self, maxlen: int) -> None:
+        self.queue: Deque[bytes] = deque(maxlen=maxlen)
+        self.cond = threading.Condition()
+        self.dropped = 0
+        self.sent = 0
+
+    def put(self, msg: bytes) -> None:
+        with self.cond:
+            if len(self.queue) == self.queue.maxlen:
+                self.dropped += 1  # deque 自動捨棄最舊的一筆
+            self.queue.append(msg)
+            self.cond.notify()
+
+    def get(self, timeout: float) -> Optional[bytes]:
+        with self.cond:
+            if not self.queue:
+                self.cond.wait(timeout)
+            return self.queue.popleft() if self.queue else None
+
+
+class AsyncFeedClient:
+    """FeedClient 的 asyncio 版本：只在事件迴圈內使用，等待以 asyncio.Event 取代 Condition。"""
+
+    def __init__(self, maxlen: int) -> None:
+        self.queue: Deque[bytes] = deque(maxlen=maxlen)
+        self.event = asyncio.Event()
+        self.dropped = 0
+        self.sent = 0
+
+    def put(self, msg: bytes) -> None:
+        if len(self.queue) == self.queue.maxlen:
+            self.dropped += 1
+        self.queue.append(msg)
+        self.event.set()
+
+    async def get(self, timeout: float) -> Optional[bytes]:
+        if not self.queue:
+            self.event.clear()
+            try:
+                await asyncio.wait_for(self.event.wait(), timeout)
+            except asyncio.TimeoutError:
+                pass
+        return self.queue.popleft() if self.queue else None
+
+
+class LiveFeed:
+    client_class = FeedClient
+
+    def __init__(self, queue_len: int = FEED_QUEUE_LEN) -> None:
+        self.queue_len = queue_len
+        self.clients: List[FeedClient] = []
+        self.lock = threading.Lock()
+        self.published = 0
+
+    def subscribe(self) -> FeedClient:
+        client = self.client_class(self.queue_len)
+        with self.lock:
+            self.clients.append(client)
+        return client
+
+    def unsubscribe(self, client: FeedClient) -> None:
+        with self.lock:
+            if client in self.clients:
+                self.clients.remove(client)
+
+    def has_clients(self) -> bool:
+        return bool(self.clients)
+
+    def publish(self, event: str, data: object) -> None:
+        with self.lock:
+            clients = list(self.clients)
+        if not clients:
+            return
+        msg = sse_message(event, data)
+        self.published += 1
+        for c in clients:
+            c.put(msg)
+
+    def stats(self) -> dict:
+        with self.lock:
+            return {"clients": len(self.clients), "published": self.published,
+                    "dropped": sum(c.dropped for c in self.clients)}
+
+
+class AsyncLiveFeed(LiveFeed):
+    """在事件迴圈內發布；鎖不會有競爭，保留只是為了共用 LiveFeed 的程式。"""
+    client_class = AsyncFeedClient
+
+
+def serve_sse(handler, feed: LiveFeed, periodic: Optional[Callable[[], Optional[bytes]]] = None) -> None:
+    """在 BaseHTTPRequestHandler 內送出 SSE 串流，直到瀏覽器斷線（需搭配 ThreadingHTTPServer）。
+
+    periodic：每 FEED_HEARTBEAT_SEC 在此連線的執行緒呼叫一次，可回傳一則低頻訊息（例如統計），
+    None 且期間沒有其他訊息時送出 keepalive 註解。
+    """
+    handler.send_response(200)
+    handler.send_header('Content-Type', 'text/event-stream')
+    handler.send_header('Cache-Control', 'no-cache')
+    handler.send_header('Access-Control-Allow-Origin', '*')
+    handler.end_headers()
+    client = feed.subscribe()
+    next_periodic = time.monotonic()
+    try:
+        while True:
+            wait = next_periodic - time.monotonic()
+            msg = client.get(wait) if wait > 0 else None
+            if msg is None:
+                next_periodic = time.monotonic() + FEED_HEARTBEAT_SEC
+                msg = (periodic() if periodic else None) or b": keepalive\n\n"
+            else:
+                client.sent += 1
+            handler.wfile.write(msg)
+            handler.wfile.flush()
+    except (BrokenPipeError, ConnectionResetError, OSError):
+        pass
+    finally:
+        feed.unsubscribe(client)
+
+
+SSE_HEADERS = (b"HTTP/1.1 200 OK\r\nContent-Type: text/event-stream\r\nCache-Control: no-cache\r\n"
+               b"Access-Control-Allow-Origin: *\r\nConnection: keep-alive\r\n\r\n")
+
+
+async def serve_sse_async(writer: asyncio.StreamWriter, feed: AsyncLiveFeed,
+                          periodic: Optional[Callable[[], Optional[bytes]]] = None) -> None:
+    """serve_sse 的 asyncio 版本：writer 為已讀完請求的 HTTP 連線，直到瀏覽器斷線。"""
+    writer.write(SSE_HEADERS)
+    client = feed.subscribe()
+    next_periodic = time.monotonic()
+    try:
+        while True:
+            wait = next_periodic - time.monotonic()
+            msg = await client.get(wait) if wait > 0 else None
+            if msg is None:
+                next_periodic = time.monotonic() + FEED_HEARTBEAT_SEC
+                msg = (periodic() if periodic else None) or b": keepalive\n\n"
+            else:
+                client.sent += 1
+            writer.write(msg)
+            await writer.drain()
+    except (BrokenPipeError, ConnectionResetError, OSError):
+        pass
+    finally:
+        feed.unsubscribe(client)
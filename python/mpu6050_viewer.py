@@ -13,7 +13,7 @@ import threading
 
 # --- 設定 ---
 COM_PORT = 'COM5'  # 請確認這是你的 STM32 Port
-BAUD_RATE = 9600
+BAUD_RATE = 460800  # 與 STM32 的 LINK_BAUD 相同
 LOOP_RATE = 20     # 更新頻率 (Hz)
 DT = 0.05          # 互補濾波時間步長
 DIST_WINDOW = 5    # 距離中值視窗
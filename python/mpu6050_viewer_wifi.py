@@ -8,13 +8,28 @@ import select
 from dataclasses import dataclass, field
 from typing import Dict, Optional
 import statistics as stats
-from http.server import HTTPServer, BaseHTTPRequestHandler
+from http.server import ThreadingHTTPServer, BaseHTTPRequestHandler
 from threading import Thread
 import threading
 
+from urllib.parse import parse_qs, urlparse
+from telemetry_frame import (FrameDecoder, FRAME_TYPE_BACKLOG, FRAME_TYPE_DELTA, FRAME_TYPE_ESP_TRACE,
+                             FRAME_TYPE_EVENT, FRAME_TYPE_PARAM, FRAME_TYPE_PROFILE, FRAME_TYPE_RANGES,
+                             FRAME_TYPE_SAMPLE, FRAME_TYPE_SYNC, FRAME_TYPE_TRACE, SAMPLE_FLAG_MPU_OK,
+                             SampleReconstructor, SeqGapTracker, decode_backlog, decode_datagram,
+                             decode_esp_trace, decode_event, decode_param, decode_profile, decode_ranges,
+                             decode_sync, decode_trace, encode_param_get, encode_param_set)
+from bulk_decode import HAVE_NUMPY, BulkFrameDecoder
+from latency_trace import LatencyTracer, host_us
+from live_feed import LiveFeed, serve_sse, sse_message
+
 # --- 設定 ---
 TCP_HOST = "0.0.0.0"  # 監聽所有介面
-TCP_PORT = 5001        # TCP 伺服器端口（ESP32 連接的端口）
+TCP_PORT = 5001        # TCP 伺服器端口（ESP32 連接的端口）；UDP 模式收同一個端口
+TRANSPORT = "tcp"      # "udp"：ESP32 以 LINK_TRANSPORT_UDP 編譯時使用
+UDP_STATS_SEC = 10.0   # UDP 遺失統計輸出間隔
+BULK_DECODE = True     # 有 NumPy 時以 bulk_decode 整批解碼取樣訊框（每批只以最新一筆更新畫面）
+BACKLOG_LOG = "backlog.jsonl"  # ESP32 斷線期間暫存、重新連線後補送的資料（每行一筆 JSON；None = 不記錄）
 LOOP_RATE = 20        # 更新頻率 (Hz)
 DT = 0.05             # 互補濾波時間步長
 DIST_WINDOW = 5       # 距離中值視窗
@@ -40,6 +55,14 @@ class SensorState:
     zero_roll_deg: float = 45.0  # Roll 角度基準（按下按鈕時會設為當前角度）
     obstacle_hit_count: int = 0  # 障礙物檢測連續次數（STM32 需要連續2次）
     last_distance_for_obstacle: Optional[float] = None  # 用於檢測障礙物的基準距離
+    ranges_cm: list[Optional[float]] = field(default_factory=list)  # 多感測器距離（通道 0 = 地面）
+    link_lost: int = 0  # UDP 模式：遺失的 datagram 數
+    link_loss_ratio: float = 0.0
+    backlog_items: int = 0  # 收到的補送資料筆數（不更新即時畫面）
+    params: Dict[str, dict] = field(default_factory=dict)  # STM32 參數表（名稱 -> 回覆內容）
+    alert_events: Dict[str, int] = field(default_factory=dict)  # 事件訊框累計次數
+    commands: list[bytes] = field(default_factory=list)  # 待送往 STM32 的指令訊框
+    sample_rx_us: int = 0  # 最新取樣由主機收到的時間（host_us），網頁以此回報繪製延遲
     lock: threading.Lock = field(default_factory=threading.Lock)
 
 
@@ -458,79 +481,151 @@ HTML_CONTENT = """<!DOCTYPE html>
             <div class="data-row">
                 <span class="data-label">陀螺儀 Z (gz):</span>
                 <span class="data-value" id="gz">--</span>
+            </div>
+                <h3>⏱ 延遲 p50 / p99 (ms)</h3>
+            <div class="data-row">
+                <span class="data-label">STM32（回波→送出）:</span>
+                <span class="data-value" id="lat_stm32">--</span>
+            </div>
+            <div class="data-row">
+                <span class="data-label">UART（→ESP32）:</span>
+                <span class="data-value" id="lat_uart">--</span>
+            </div>
+            <div class="data-row">
+                <span class="data-label">ESP32 批次:</span>
+                <span class="data-value" id="lat_esp32">--</span>
+            </div>
+            <div class="data-row">
+                <span class="data-label">WiFi（→主機）:</span>
+                <span class="data-value" id="lat_wifi">--</span>
+            </div>
+            <div class="data-row">
+                <span class="data-label">主機→畫面:</span>
+                <span class="data-value" id="lat_render">--</span>
+            </div>
+            <div class="data-row">
+                <span class="data-label">回波→主機:</span>
+                <span class="data-value" id="lat_total">--</span>
             </div>
             </div>
         </div>
         <div class="timestamp" id="timestamp">最後更新: --</div>
     </div>
     <script>
+        let lastSampleId = 0;
+        const HIST_BARS = '▁▂▃▄▅▆▇█';
+        function histText(hist) {
+            const max = Math.max(...hist);
+            return hist.map(c => c === 0 ? '·' : HIST_BARS[Math.min(7, Math.floor(c / max * 7.99))]).join('');
+        }
+        function updateLatency(lat) {
+            for (const [hop, s] of Object.entries(lat.hops)) {
+                const el = document.getElementById('lat_' + hop);
+                if (!el) continue;
+                el.textContent = s ? s.p50.toFixed(1) + ' / ' + s.p99.toFixed(1) + ' ' + histText(s.hist) : '--';
+            }
+        }
+        function applyData(data) {
+            document.getElementById('distance').textContent = 
+                data.dist_cm !== null ? data.dist_cm.toFixed(2) : '--';
+            document.getElementById('roll').textContent = 
+                (data.roll * 180 / Math.PI).toFixed(2);
+            if (data.mpu_vals) {
+                document.getElementById('ax').textContent = data.mpu_vals.ax.toFixed(0);
+                document.getElementById('ay').textContent = data.mpu_vals.ay.toFixed(0);
+                document.getElementById('az').textContent = data.mpu_vals.az.toFixed(0);
+                document.getElementById('gx').textContent = data.mpu_vals.gx.toFixed(0);
+                document.getElementById('gy').textContent = data.mpu_vals.gy.toFixed(0);
+                document.getElementById('gz').textContent = data.mpu_vals.gz.toFixed(0);
+            }
+            const now = new Date();
+            document.getElementById('timestamp').textContent = 
+                '最後更新: ' + now.toLocaleTimeString('zh-TW');
+            const eventBanner = document.getElementById('eventBanner');
+            if (data.event_msg && data.event_until > Date.now() / 1000) {
+                eventBanner.textContent = '🔔 ' + data.event_msg;
+                eventBanner.style.display = 'block';
+            } else {
+                eventBanner.style.display = 'none';
+            }
+            
+            // 更新按鈕狀態
+            const buttonSection = document.getElementById('buttonSection');
+            const buttonStatus = document.getElementById('buttonStatus');
+            
+            if (data.button_pressed) {
+                buttonStatus.textContent = '✅ 已按下';
+                buttonSection.classList.add('button-pressed');
+            } else {
+                buttonStatus.textContent = '未按下';
+                buttonSection.classList.remove('button-pressed');
+            }
+            
+            // 更新警報距離（初始值50，按下按鈕時會加上當前距離）
+            const alarmDistance = document.getElementById('alarmDistance');
+            alarmDistance.textContent = data.alarm_distance_cm.toFixed(2);
+            
+            // 更新角度補償值（只顯示需要增加或減少的數值）
+            const distanceComp = document.getElementById('distanceComp');
+            const roll_deg = data.roll * 180 / Math.PI;
+            
+            // 當角度超過 80 度時，顯示無限大
+            if (roll_deg > 80.0) {
+                distanceComp.textContent = '∞';
+            } else if (data.dist_comp_cm !== null && data.dist_comp_cm !== undefined) {
+                // 檢查是否為無限大（Infinity）
+                if (!isFinite(data.dist_comp_cm)) {
+                    distanceComp.textContent = '∞';
+                } else {
+                    // 顯示正負號，正值表示需要增加，負值表示需要減少
+                    const sign = data.dist_comp_cm >= 0 ? '+' : '';
+                    distanceComp.textContent = sign + data.dist_comp_cm.toFixed(2);
+                }
+            } else {
+                distanceComp.textContent = '0.00';
+            }
+        }
+        // 繪製延遲：取樣在主機上的等待 + 傳到瀏覽器（transitMs）+ 到畫面繪製
+        function reportRender(data, tRecv, transitMs) {
+            if (!data.sample_id || data.sample_id === lastSampleId || data.sample_age_ms === null) return;
+            lastSampleId = data.sample_id;
+            const ms = data.sample_age_ms + transitMs + (performance.now() - tRecv);
+            fetch('/api/render?ms=' + ms.toFixed(2));
+        }
+        // 推送的狀態可能比畫面更新還快：每個畫面只畫最新的一筆
+        let pendingRender = null;
+        function scheduleRender(data, tRecv, transitMs) {
+            const idle = pendingRender === null;
+            pendingRender = {data, tRecv, transitMs};
+            if (!idle) return;
+            requestAnimationFrame(() => {
+                const p = pendingRender;
+                pendingRender = null;
+                applyData(p.data);
+                reportRender(p.data, p.tRecv, p.transitMs);
+            });
+        }
+        // 輪詢（不支援 EventSource 時）：回應傳回約為半個來回
         function updateData() {
+            const t0 = performance.now();
+            let tResp = t0;
             fetch('/api/data')
-                .then(response => response.json())
+                .then(response => { tResp = performance.now(); return response.json(); })
                 .then(data => {
-                    document.getElementById('distance').textContent = 
-                        data.dist_cm !== null ? data.dist_cm.toFixed(2) : '--';
-                    document.getElementById('roll').textContent = 
-                        (data.roll * 180 / Math.PI).toFixed(2);
-                    if (data.mpu_vals) {
-                        document.getElementById('ax').textContent = data.mpu_vals.ax.toFixed(0);
-                        document.getElementById('ay').textContent = data.mpu_vals.ay.toFixed(0);
-                        document.getElementById('az').textContent = data.mpu_vals.az.toFixed(0);
-                        document.getElementById('gx').textContent = data.mpu_vals.gx.toFixed(0);
-                        document.getElementById('gy').textContent = data.mpu_vals.gy.toFixed(0);
-                        document.getElementById('gz').textContent = data.mpu_vals.gz.toFixed(0);
-                    }
-                    const now = new Date();
-                    document.getElementById('timestamp').textContent = 
-                        '最後更新: ' + now.toLocaleTimeString('zh-TW');
-                    const eventBanner = document.getElementById('eventBanner');
-                    if (data.event_msg && data.event_until > Date.now() / 1000) {
-                        eventBanner.textContent = '🔔 ' + data.event_msg;
-                        eventBanner.style.display = 'block';
-                    } else {
-                        eventBanner.style.display = 'none';
-                    }
-                    
-                    // 更新按鈕狀態
-                    const buttonSection = document.getElementById('buttonSection');
-                    const buttonStatus = document.getElementById('buttonStatus');
-                    
-                    if (data.button_pressed) {
-                        buttonStatus.textContent = '✅ 已按下';
-                        buttonSection.classList.add('button-pressed');
-                    } else {
-                        buttonStatus.textContent = '未按下';
-                        buttonSection.classList.remove('button-pressed');
-                    }
-                    
-                    // 更新警報距離（初始值50，按下按鈕時會加上當前距離）
-                    const alarmDistance = document.getElementById('alarmDistance');
-                    alarmDistance.textContent = data.alarm_distance_cm.toFixed(2);
-                    
-                    // 更新角度補償值（只顯示需要增加或減少的數值）
-                    const distanceComp = document.getElementById('distanceComp');
-                    const roll_deg = data.roll * 180 / Math.PI;
-                    
-                    // 當角度超過 80 度時，顯示無限大
-                    if (roll_deg > 80.0) {
-                        distanceComp.textContent = '∞';
-                    } else if (data.dist_comp_cm !== null && data.dist_comp_cm !== undefined) {
-                        // 檢查是否為無限大（Infinity）
-                        if (!isFinite(data.dist_comp_cm)) {
-                            distanceComp.textContent = '∞';
-                        } else {
-                            // 顯示正負號，正值表示需要增加，負值表示需要減少
-                            const sign = data.dist_comp_cm >= 0 ? '+' : '';
-                            distanceComp.textContent = sign + data.dist_comp_cm.toFixed(2);
-                        }
-                    } else {
-                        distanceComp.textContent = '0.00';
-                    }
+                    updateLatency(data.latency);
+                    scheduleRender(data, tResp, (tResp - t0) / 2);
                 })
                 .catch(error => console.error('更新數據失敗:', error));
         }
-        setInterval(updateData, 100);
         updateData();
+        if (window.EventSource) {
+            // 推送：每批收到的訊框更新一次狀態，延遲統計每秒一次
+            const stream = new EventSource('/api/stream');
+            stream.addEventListener('state', e => scheduleRender(JSON.parse(e.data), performance.now(), 0));
+            stream.addEventListener('latency', e => updateLatency(JSON.parse(e.data).latency));
+        } else {
+            setInterval(updateData, 100);
+        }
     </script>
 </body>
 </html>"""
@@ -545,31 +640,50 @@ class WebHandler(BaseHTTPRequestHandler):
             self.send_header('Content-type', 'text/html; charset=utf-8')
             self.end_headers()
             self.wfile.write(HTML_CONTENT.encode('utf-8'))
+        elif self.path.startswith('/api/params'):
+            # /api/params：目前參數表；/api/params?name=hit_need&value=3：設定參數（回覆到達後更新）
+            query = parse_qs(urlparse(self.path).query)
+            result = {'queued': False}
+            with state.lock:
+                if 'name' in query and 'value' in query:
+                    info = state.params.get(query['name'][0])
+                    try:
+                        value = float(query['value'][0])
+                    except ValueError:
+                        value = None
+                    if info is not None and value is not None:
+                        state.commands.append(encode_param_set(info['id'], value))
+                        result['queued'] = True
+                elif 'refresh' in query or not state.params:
+                    state.commands.append(encode_param_get())
+                    result['queued'] = True
+                result['params'] = state.params
+            self.send_response(200)
+            self.send_header('Content-type', 'application/json')
+            self.send_header('Access-Control-Allow-Origin', '*')
+            self.end_headers()
+            self.wfile.write(json.dumps(result).encode('utf-8'))
+        elif self.path.startswith('/api/render'):
+            # 網頁回報一個取樣從主機收到到畫面繪製的時間
+            query = parse_qs(urlparse(self.path).query)
+            try:
+                tracer.on_render(float(query['ms'][0]))
+            except (KeyError, ValueError):
+                pass
+            self.send_response(204)
+            self.end_headers()
+        elif self.path == '/api/stream':
+            # 推送：讀取執行緒每處理一批資料發布一次狀態（有界佇列，慢的瀏覽器捨棄舊狀態）
+            serve_sse(self, feed, lambda: sse_message('latency', {'latency': tracer.summary(),
+                                                                   'feed': feed.stats()}))
         elif self.path == '/api/data':
             self.send_response(200)
             self.send_header('Content-type', 'application/json')
             self.send_header('Access-Control-Allow-Origin', '*')
             self.end_headers()
-            
-            with state.lock:
-                now = time.time()
-                event_msg = None
-                if state.event_msg and now < state.event_until:
-                    event_msg = state.event_msg
-                
-                data = {
-                    'roll': state.roll,
-                    'dist_cm': state.dist_cm,
-                    'dist_comp_cm': state.dist_comp_cm,
-                    'mpu_vals': state.mpu_vals,
-                    'event_msg': event_msg,
-                    'event_until': state.event_until,
-                    'timestamp': now,
-                    'button_pressed': state.button_pressed,
-                    'button_press_count': state.button_press_count,
-                    'alarm_distance_cm': state.alarm_distance_cm
-                }
-            
+            data = snapshot()
+            data['latency'] = tracer.summary()
+            data['feed'] = feed.stats()
             self.wfile.write(json.dumps(data).encode('utf-8'))
         else:
             self.send_response(404)
@@ -579,9 +693,44 @@ class WebHandler(BaseHTTPRequestHandler):
         pass  # 不顯示日誌訊息
 
 
+def snapshot() -> dict:
+    """網頁顯示用的目前狀態（/api/data 與推送共用）。"""
+    with state.lock:
+        now = time.time()
+        event_msg = None
+        if state.event_msg and now < state.event_until:
+            event_msg = state.event_msg
+        
+        return {
+            'roll': state.roll,
+            'dist_cm': state.dist_cm,
+            'dist_comp_cm': state.dist_comp_cm,
+            'mpu_vals': state.mpu_vals,
+            'event_msg': event_msg,
+            'event_until': state.event_until,
+            'timestamp': now,
+            'button_pressed': state.button_pressed,
+            'button_press_count': state.button_press_count,
+            'alarm_distance_cm': state.alarm_distance_cm,
+            'ranges_cm': state.ranges_cm,
+            'link_lost': state.link_lost,
+            'link_loss_ratio': state.link_loss_ratio,
+            'backlog_items': state.backlog_items,
+            'alert_events': dict(state.alert_events),
+            'sample_id': state.sample_rx_us,
+            'sample_age_ms': (host_us() - state.sample_rx_us) / 1000.0 if state.sample_rx_us else None
+        }
+
+
+def publish_state() -> None:
+    """讀取執行緒處理完一批資料後推送目前狀態；沒有瀏覽器連著時不做任何事。"""
+    if feed.has_clients():
+        feed.publish('state', snapshot())
+
+
 def run_web_server():
     """在背景執行簡單的 Web 伺服器"""
-    server = HTTPServer(('0.0.0.0', WEB_PORT), WebHandler)
+    server = ThreadingHTTPServer(('0.0.0.0', WEB_PORT), WebHandler)  # 推送連線各佔一個執行緒
     # print(f"Web 伺服器已啟動: http://localhost:{WEB_PORT}")  # 已禁用終端輸出
     # 等待服务器启动后自动打开浏览器
     time.sleep(1)  # 给服务器一点时间启动
@@ -589,6 +738,272 @@ def run_web_server():
     server.serve_forever()
 
 
+def apply_distance(state: SensorState, dist_val: float) -> None:
+    """套用一筆距離量測（平滑、角度補償值、障礙物計數），呼叫前需持有 state.lock。"""
+    prev_dist = state.dist_cm
+    state.dist_cm = smooth_distance(state, dist_val)
+
+    # 計算角度補償值（只與 Roll 角度有關，與距離無關）
+    # 補償值 = Roll角度 - 基準角度
+    # 當角度超過 80 度時，補償值顯示為無限大
+    roll_deg = math.degrees(state.roll)
+    if roll_deg > 80.0:
+        state.dist_comp_cm = None  # 無限大（由前端根據角度判斷顯示）
+    else:
+        state.dist_comp_cm = roll_deg - state.zero_roll_deg
+
+    # 檢測障礙物：當距離突然變大超過閾值時（STM32 的 safety_margin_cm = 50cm）
+    # STM32 邏輯：distance_comp_rel > 50cm 且連續檢測到 2 次才觸發
+    if prev_dist is not None and state.dist_cm is not None:
+        # 計算距離變化（相對於平滑前的原始值，模擬 STM32 的 distance_comp_rel）
+        # 這裡簡化為直接比較距離變化
+        dist_change = state.dist_cm - prev_dist
+        safety_margin_cm = 50.0  # 與 STM32 一致（50cm）
+
+        # 如果距離突然變大超過閾值，可能是障礙物/坑洞
+        if dist_change > safety_margin_cm:
+            state.obstacle_hit_count += 1
+            # STM32 需要連續 2 次才觸發（hit_need = 2）
+            # 注意：蜂鳴器狀態已移除，這裡只保留障礙物檢測計數
+        else:
+            # 距離變化正常，重置計數
+            state.obstacle_hit_count = 0
+
+    print_status(state)
+
+
+def apply_mpu(state: SensorState, vals: Dict[str, float]) -> None:
+    """套用一筆 MPU 數據（互補濾波、角度補償值），呼叫前需持有 state.lock。"""
+    update_orientation(state, vals)
+    state.mpu_vals = vals
+
+    # 計算角度補償值（只與 Roll 角度有關，與距離無關）
+    # 補償值 = Roll角度 - 基準角度
+    # 當角度超過 80 度時，補償值顯示為無限大
+    roll_deg = math.degrees(state.roll)
+    if roll_deg > 80.0:
+        state.dist_comp_cm = None  # 無限大（由前端根據角度判斷顯示）
+    else:
+        state.dist_comp_cm = roll_deg - state.zero_roll_deg
+
+    print_status(state, vals)
+    state.t += DT
+
+
+def handle_line(line: str) -> None:
+    """處理一行文字訊息（按鈕事件、距離、MPU 文字輸出）。"""
+    with state.lock:
+        # PB12 按鈕檢測：檢測多種可能的按鈕消息
+        line_lower = line.lower()
+        button_detected = False
+
+        # 檢測各種按鈕相關消息
+        if "calibrated" in line_lower and "pb12" in line_lower:
+            button_detected = True
+            state.event_msg = "PB12 已校準零點"
+            state.button_pressed = True
+            state.button_press_count += 1
+            state.last_button_event = time.time()
+            state.event_until = time.time() + EVENT_SHOW_SEC
+            # 更新警報距離：50 + 當前距離
+            if state.dist_cm is not None:
+                state.alarm_distance_cm = 50.0 + state.dist_cm
+            # 設定當前 Roll 角度為基準角度，補償值歸零
+            state.zero_roll_deg = math.degrees(state.roll)
+            state.dist_comp_cm = 0.0  # 補償值歸零
+            print_status(state)
+            return
+        elif "button pb12 pressed" in line_lower or "pb12 pressed" in line_lower:
+            button_detected = True
+            state.event_msg = "PB12 按鈕被按下"
+            state.button_pressed = True
+            state.button_press_count += 1
+            state.last_button_event = time.time()
+            state.event_until = time.time() + EVENT_SHOW_SEC
+            # 更新警報距離：50 + 當前距離
+            if state.dist_cm is not None:
+                state.alarm_distance_cm = 50.0 + state.dist_cm
+            # 設定當前 Roll 角度為基準角度，補償值歸零
+            state.zero_roll_deg = math.degrees(state.roll)
+            state.dist_comp_cm = 0.0  # 補償值歸零
+            print_status(state)
+            return
+
+        elif "calibrated:" in line_lower:
+            # 通用校準消息（可能包含 PB12）
+            button_detected = True
+            state.event_msg = "校準事件觸發"
+            state.button_pressed = True
+            state.button_press_count += 1
+            state.last_button_event = time.time()
+            state.event_until = time.time() + EVENT_SHOW_SEC
+            # 更新警報距離：50 + 當前距離
+            if state.dist_cm is not None:
+                state.alarm_distance_cm = 50.0 + state.dist_cm
+            # 設定當前 Roll 角度為基準角度，補償值歸零
+            state.zero_roll_deg = math.degrees(state.roll)
+            state.dist_comp_cm = 0.0  # 補償值歸零
+            print_status(state)
+            return
+
+        # 如果沒有檢測到按鈕事件，檢查按鈕是否已釋放
+        if not button_detected and state.button_pressed:
+            # 如果距離上次按鈕事件超過一定時間，認為按鈕已釋放
+            if time.time() - state.last_button_event > 0.5:
+                state.button_pressed = False
+
+        # 解析距離
+        dist_val = parse_distance(line)
+        if dist_val is not None:
+            apply_distance(state, dist_val)
+            return
+
+        # 解析 MPU 數據
+        vals = parse_mpu(line)
+        if vals is None:
+            return
+        apply_mpu(state, vals)
+
+
+backlog_decoder = FrameDecoder()
+backlog_samples = SampleReconstructor()
+live_samples = SampleReconstructor()  # 關鍵訊框 + 差量訊框還原取樣
+tracer = LatencyTracer()
+feed = LiveFeed()
+
+
+def handle_backlog(payload: bytes) -> None:
+    """補送資料已是過去的數據：不更新即時狀態，只寫入 BACKLOG_LOG 供事後分析。"""
+    decoded = decode_backlog(payload)
+    if decoded is None:
+        return
+    esp_t_ms, chunk = decoded
+    records = []
+    for kind, item in backlog_decoder.feed(chunk):
+        if kind == "text":
+            records.append({"esp_t_ms": esp_t_ms, "text": item})
+            continue
+        ftype, body = item
+        if ftype in (FRAME_TYPE_SAMPLE, FRAME_TYPE_DELTA):
+            sample = backlog_samples.feed(ftype, body)
+            if sample is not None:
+                records.append({"esp_t_ms": esp_t_ms, "sample": sample})
+        elif ftype == FRAME_TYPE_EVENT:
+            records.append({"esp_t_ms": esp_t_ms, "event": decode_event(body)})
+        elif ftype == FRAME_TYPE_RANGES:
+            records.append({"esp_t_ms": esp_t_ms, "ranges_cm": decode_ranges(body)})
+    if not records:
+        return
+    with state.lock:
+        state.backlog_items += len(records)
+    if BACKLOG_LOG:
+        with open(BACKLOG_LOG, "a", encoding="utf-8") as f:
+            for r in records:
+                f.write(json.dumps(r) + "\n")
+
+
+def handle_frame(ftype: int, payload: bytes, rx_us: int) -> None:
+    """處理一個二進位訊框（取樣訊框同時帶有距離與 MPU 數據）；rx_us 為主機讀到該筆資料的時間。"""
+    if ftype == FRAME_TYPE_SYNC:
+        reply = decode_sync(payload)
+        if reply is not None:
+            tracer.on_sync(reply, rx_us)
+        return
+    if ftype == FRAME_TYPE_ESP_TRACE:
+        trace = decode_esp_trace(payload)
+        if trace is not None:
+            tracer.on_esp_trace(trace)
+        return
+    if ftype == FRAME_TYPE_TRACE:
+        trace = decode_trace(payload)
+        if trace is not None:
+            tracer.on_trace(trace, rx_us)
+        return
+    if ftype == FRAME_TYPE_BACKLOG:
+        handle_backlog(payload)
+        return
+    if ftype == FRAME_TYPE_PARAM:
+        reply = decode_param(payload)
+        if reply is None:
+            return
+        if reply["name"]:
+            with state.lock:
+                state.params[reply["name"]] = reply
+        if reply["status"] != "OK":
+            print(f"Param {reply['id']}: {reply['status']}")
+        return
+    if ftype == FRAME_TYPE_PROFILE:
+        prof = decode_profile(payload)
+        if prof is not None:
+            # CPU 週期（84 MHz：84 cycles = 1 us）
+            print("Profile " + " ".join(
+                f"{name}={p['min']}/{p['avg']}/{p['max']}(n={p['count']})" for name, p in prof.items()))
+        return
+    if ftype == FRAME_TYPE_RANGES:
+        ranges = decode_ranges(payload)
+        if ranges is not None:
+            with state.lock:
+                state.ranges_cm = ranges
+        return
+    if ftype == FRAME_TYPE_EVENT:
+        ev = decode_event(payload)
+        if ev is not None:
+            with state.lock:
+                state.alert_events[ev["event"]] = state.alert_events.get(ev["event"], 0) + 1
+            print(f"Event {ev['event']} at {ev['t_ms']} ms")
+        return
+    if ftype not in (FRAME_TYPE_SAMPLE, FRAME_TYPE_DELTA):
+        return
+    sample = live_samples.feed(ftype, payload)
+    if sample is None:
+        return
+    with state.lock:
+        if state.button_pressed and time.time() - state.last_button_event > 0.5:
+            state.button_pressed = False
+        state.sample_rx_us = rx_us
+        apply_distance(state, sample["distance_cm"])
+        if sample["flags"] & SAMPLE_FLAG_MPU_OK:
+            apply_mpu(state, {k: float(sample[k]) for k in ("ax", "ay", "az", "gx", "gy", "gz")})
+
+
+def new_decoder():
+    return BulkFrameDecoder() if BULK_DECODE and HAVE_NUMPY else FrameDecoder()
+
+
+def handle_chunk(decoder, data: bytes, rx_us: int) -> None:
+    """解碼一次讀到的資料並依序處理文字行與訊框。"""
+    if isinstance(decoder, FrameDecoder):
+        for kind, item in decoder.feed(data):
+            if kind == "text":
+                handle_line(item)
+            else:
+                handle_frame(*item, rx_us)
+        return
+    samples, items = decoder.feed(data)
+    fed = 0  # 已交給 live_samples 作為參考的完整取樣數
+    for kind, item, before in items:
+        if kind == "text":
+            handle_line(item)
+            continue
+        ftype, payload = item
+        if ftype == FRAME_TYPE_DELTA and before > fed:
+            # 差量訊框以它之前最近的完整取樣為參考（tobytes() 即原始 payload）
+            live_samples.feed(FRAME_TYPE_SAMPLE, samples[before - 1].tobytes())
+            fed = before
+        handle_frame(ftype, payload, rx_us)
+    if len(samples) > fed:
+        handle_frame(FRAME_TYPE_SAMPLE, samples[-1].tobytes(), rx_us)
+
+
+def send_commands(send) -> None:
+    """送出網頁排入的指令訊框與時鐘同步指令（由讀取執行緒呼叫，與接收共用同一條連線）。"""
+    with state.lock:
+        pending, state.commands = state.commands, []
+    for cmd in pending:
+        send(cmd)
+    tracer.poll_sync(send)
+
+
 def read_tcp_data():
     """在背景執行 TCP 數據讀取"""
     # --- 初始化 TCP Server ---
@@ -613,7 +1028,11 @@ def read_tcp_data():
                     try:
                         conn, addr = tcp_socket.accept()
                         conn.settimeout(0.5)  # 設置讀取超時
-                        conn_file = conn.makefile("r", encoding="utf-8", errors="ignore", newline=None)
+                        conn_file = conn.makefile("rb")
+                        decoder = new_decoder()
+                        tracer.reset_pending()
+                        with state.lock:
+                            state.commands.append(encode_param_get())  # 連線後讀取參數表
                         # print(f"ESP32 已連線：{addr}")  # 已禁用終端輸出
                     except socket.timeout:
                         # accept 超時，繼續等待
@@ -640,7 +1059,8 @@ def read_tcp_data():
                     # 使用 select 檢查是否有數據可讀
                     ready = select.select([conn], [], [], 0.1)
                     if not ready[0]:
-                        # 沒有數據，繼續循環
+                        # 沒有數據（遙測可能已關閉），仍送出排隊的指令
+                        send_commands(conn.sendall)
                         time.sleep(1.0 / LOOP_RATE)
                         continue
                 except:
@@ -661,9 +1081,10 @@ def read_tcp_data():
                     continue
                 
                 try:
-                    # 從 TCP 連接讀取一行數據
-                    line = conn_file.readline()
-                    if not line:
+                    # 從 TCP 連接讀取目前可用的位元組，交給解碼器切出文字行與二進位訊框
+                    data = conn_file.read1(4096)
+                    rx_us = host_us()
+                    if not data:
                         # 連接中斷，重置連接
                         # print("ESP32 連線中斷，等待重新連接...")  # 已禁用終端輸出
                         try:
@@ -676,128 +1097,13 @@ def read_tcp_data():
                             pass
                         conn = None
                         conn_file = None
+                        decoder = new_decoder()
                         time.sleep(0.5)
                         continue
-                    
-                    line = line.strip()
-                    if not line:
-                        time.sleep(1.0 / LOOP_RATE)
-                        continue
 
-                    with state.lock:
-                        # PB12 按鈕檢測：檢測多種可能的按鈕消息
-                        line_lower = line.lower()
-                        button_detected = False
-                        
-                        # 檢測各種按鈕相關消息
-                        if "calibrated" in line_lower and "pb12" in line_lower:
-                            button_detected = True
-                            state.event_msg = "PB12 已校準零點"
-                            state.button_pressed = True
-                            state.button_press_count += 1
-                            state.last_button_event = time.time()
-                            state.event_until = time.time() + EVENT_SHOW_SEC
-                            # 更新警報距離：50 + 當前距離
-                            if state.dist_cm is not None:
-                                state.alarm_distance_cm = 50.0 + state.dist_cm
-                            # 設定當前 Roll 角度為基準角度，補償值歸零
-                            state.zero_roll_deg = math.degrees(state.roll)
-                            state.dist_comp_cm = 0.0  # 補償值歸零
-                            print_status(state)
-                            continue
-                        elif "button pb12 pressed" in line_lower or "pb12 pressed" in line_lower:
-                            button_detected = True
-                            state.event_msg = "PB12 按鈕被按下"
-                            state.button_pressed = True
-                            state.button_press_count += 1
-                            state.last_button_event = time.time()
-                            state.event_until = time.time() + EVENT_SHOW_SEC
-                            # 更新警報距離：50 + 當前距離
-                            if state.dist_cm is not None:
-                                state.alarm_distance_cm = 50.0 + state.dist_cm
-                            # 設定當前 Roll 角度為基準角度，補償值歸零
-                            state.zero_roll_deg = math.degrees(state.roll)
-                            state.dist_comp_cm = 0.0  # 補償值歸零
-                            print_status(state)
-                            continue
-
-                        elif "calibrated:" in line_lower:
-                            # 通用校準消息（可能包含 PB12）
-                            button_detected = True
-                            state.event_msg = "校準事件觸發"
-                            state.button_pressed = True
-                            state.button_press_count += 1
-                            state.last_button_event = time.time()
-                            state.event_until = time.time() + EVENT_SHOW_SEC
-                            # 更新警報距離：50 + 當前距離
-                            if state.dist_cm is not None:
-                                state.alarm_distance_cm = 50.0 + state.dist_cm
-                            # 設定當前 Roll 角度為基準角度，補償值歸零
-                            state.zero_roll_deg = math.degrees(state.roll)
-                            state.dist_comp_cm = 0.0  # 補償值歸零
-                            print_status(state)
-                            continue
-
-                        # 如果沒有檢測到按鈕事件，檢查按鈕是否已釋放
-                        if not button_detected and state.button_pressed:
-                            # 如果距離上次按鈕事件超過一定時間，認為按鈕已釋放
-                            if time.time() - state.last_button_event > 0.5:
-                                state.button_pressed = False
-
-                        # 解析距離
-                        dist_val = parse_distance(line)
-                        if dist_val is not None:
-                            prev_dist = state.dist_cm
-                            state.dist_cm = smooth_distance(state, dist_val)
-                            
-                            # 計算角度補償值（只與 Roll 角度有關，與距離無關）
-                            # 補償值 = Roll角度 - 基準角度
-                            # 當角度超過 80 度時，補償值顯示為無限大
-                            roll_deg = math.degrees(state.roll)
-                            if roll_deg > 80.0:
-                                state.dist_comp_cm = None  # 無限大（由前端根據角度判斷顯示）
-                            else:
-                                state.dist_comp_cm = roll_deg - state.zero_roll_deg
-                            
-                            # 檢測障礙物：當距離突然變大超過閾值時（STM32 的 safety_margin_cm = 50cm）
-                            # STM32 邏輯：distance_comp_rel > 50cm 且連續檢測到 2 次才觸發
-                            if prev_dist is not None and state.dist_cm is not None:
-                                # 計算距離變化（相對於平滑前的原始值，模擬 STM32 的 distance_comp_rel）
-                                # 這裡簡化為直接比較距離變化
-                                dist_change = state.dist_cm - prev_dist
-                                safety_margin_cm = 50.0  # 與 STM32 一致（50cm）
-                                
-                                # 如果距離突然變大超過閾值，可能是障礙物/坑洞
-                                if dist_change > safety_margin_cm:
-                                    state.obstacle_hit_count += 1
-                                    # STM32 需要連續 2 次才觸發（hit_need = 2）
-                                    # 注意：蜂鳴器狀態已移除，這裡只保留障礙物檢測計數
-                                else:
-                                    # 距離變化正常，重置計數
-                                    state.obstacle_hit_count = 0
-                            
-                            print_status(state)
-                            continue
-
-                        # 解析 MPU 數據
-                        vals = parse_mpu(line)
-                        if vals is None:
-                            continue
-
-                        update_orientation(state, vals)
-                        state.mpu_vals = vals
-                        
-                        # 計算角度補償值（只與 Roll 角度有關，與距離無關）
-                        # 補償值 = Roll角度 - 基準角度
-                        # 當角度超過 80 度時，補償值顯示為無限大
-                        roll_deg = math.degrees(state.roll)
-                        if roll_deg > 80.0:
-                            state.dist_comp_cm = None  # 無限大（由前端根據角度判斷顯示）
-                        else:
-                            state.dist_comp_cm = roll_deg - state.zero_roll_deg
-                        
-                        print_status(state, vals)
-                        state.t += DT
+                    handle_chunk(decoder, data, rx_us)
+                    publish_state()
+                    send_commands(conn.sendall)
 
                 except socket.timeout:
                     # 讀取超時是正常的，繼續循環
@@ -891,6 +1197,56 @@ def read_tcp_data():
         # print("TCP 連線已關閉")  # 已禁用終端輸出
 
 
+def read_udp_data():
+    """UDP 模式：每個 datagram 都是完整的文字行 / 訊框，依序號統計遺失，晚到的直接丟棄"""
+    udp_socket = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+    udp_socket.setsockopt(socket.SOL_SOCKET, socket.SO_REUSEADDR, 1)
+    udp_socket.bind((TCP_HOST, TCP_PORT))
+    udp_socket.settimeout(1.0)
+    tracker = SeqGapTracker()
+    decoder = new_decoder()
+    last_stats = time.time()
+    esp_addr = None
+    try:
+        while True:
+            try:
+                data, addr = udp_socket.recvfrom(2048)
+                rx_us = host_us()
+            except socket.timeout:
+                data = None
+            if data and esp_addr is None:
+                with state.lock:
+                    state.commands.append(encode_param_get())
+            if data:
+                esp_addr = addr  # 指令送回 ESP32 的來源位址（與其送出的 port 相同）
+            if esp_addr is not None:
+                send_commands(lambda cmd: udp_socket.sendto(cmd, esp_addr))
+            if data:
+                dgram = decode_datagram(data)
+                if dgram is not None:
+                    seq, t_ms, body = dgram
+                    use, gap = tracker.accept(seq, t_ms)
+                    if use:
+                        if gap:
+                            # 中間有遺失：丟掉上一個 datagram 殘留的半行
+                            decoder = new_decoder()
+                            tracer.reset_pending()
+                        handle_chunk(decoder, body, rx_us)
+                        publish_state()
+                    with state.lock:
+                        state.link_lost = tracker.lost
+                        state.link_loss_ratio = tracker.loss_ratio()
+            now = time.time()
+            if now - last_stats >= UDP_STATS_SEC:
+                last_stats = now
+                print(f"UDP: received={tracker.received} lost={tracker.lost} "
+                      f"({tracker.loss_ratio() * 100:.2f}%) late={tracker.late} restarts={tracker.restarts}")
+    except KeyboardInterrupt:
+        pass
+    finally:
+        udp_socket.close()
+
+
 def main():
     """主函數：啟動 Web 伺服器和 TCP 數據讀取"""
     # 啟動 Web 伺服器（背景執行）
@@ -901,8 +1257,11 @@ def main():
     # print(f"等待 ESP32 連線到 TCP 端口 {TCP_PORT}...")  # 已禁用終端輸出
     # print("=" * 80)  # 已禁用終端輸出
     
-    # 在主線程執行 TCP 數據讀取
-    read_tcp_data()
+    # 在主線程執行數據讀取
+    if TRANSPORT == "udp":
+        read_udp_data()
+    else:
+        read_tcp_data()
 
 
 if __name__ == "__main__":
@@ -0,0 +1,379 @@
+"""STM32 二進位遙測訊框解碼（格式見 stm32/telemetry_frame.h）。
+
+訊框：0xA5 0x5A | type | len | payload[len] | crc16(LE)
+文字行（啟動訊息、校準事件、除錯模式輸出）可與訊框混在同一串流中。
+
+UDP 模式（esp32/esp32_wifi_tcp.cpp 的 LINK_TRANSPORT_UDP）每個 datagram 前面加上
+'S' 'C' | version | seq(u32) | t_ms(u32)，後面是完整的文字行 / 訊框。
+"""
+import binascii
+import struct
+from typing import Dict, List, Optional, Tuple, Union
+
+FRAME_SYNC = b"\xa5\x5a"
+FRAME_HEADER_LEN = 4
+FRAME_CRC_LEN = 2
+FRAME_MAX_PAYLOAD = 96
+MAX_TEXT_LINE = 256  # 文字行超過此長度視為雜訊丟棄
+
+FRAME_TYPE_SAMPLE = 0x01
+FRAME_TYPE_PROFILE = 0x02
+FRAME_TYPE_RANGES = 0x03
+FRAME_TYPE_BACKLOG = 0x04  # ESP32 斷線期間暫存、重新連線後補送：t_ms(u32) | 原始串流片段
+FRAME_TYPE_PARAM = 0x05    # 參數回覆：id | status | value(f32) | min(f32) | max(f32) | name
+FRAME_TYPE_DELTA = 0x06    # 差量取樣（見 stm32/telemetry_delta.h），由 SampleReconstructor 還原
+FRAME_TYPE_EVENT = 0x07    # 警示 / 校準事件：t_ms(u32) | event | flags
+FRAME_TYPE_SYNC = 0x08     # 時鐘同步回覆：token(u32) | source | rx_us(u32) | tx_us(u32)
+FRAME_TYPE_TRACE = 0x09    # STM32 延遲追蹤：seq(u16) | capture_us(u32) | tx_us(u32)
+FRAME_TYPE_ESP_TRACE = 0x0A  # ESP32 延遲追蹤（下一個 TRACE 訊框）：rx_us(u32) | tx_us(u32)
+FRAME_TYPE_HELLO = 0x0B    # ESP32 每次連上主機的識別：mac[6] | connects(u32)
+SYNC_SOURCES = ("stm32", "esp32")
+
+EVENT_NAMES = {1: "hit_start", 2: "hit_stop", 3: "calibrated", 4: "calib_rejected",
+               5: "cooldown_start", 6: "cooldown_end"}
+DELTA_FIELDS = ("ax", "ay", "az", "gx", "gy", "gz", "echo_us")
+
+# 指令（PC -> STM32，格式同訊框，見 stm32/param_table.h）
+FRAME_CMD_PARAM_GET = 0x81  # id；PARAM_ID_ALL = 整個參數表
+FRAME_CMD_PARAM_SET = 0x82  # id | value(f32)
+FRAME_CMD_TIME_SYNC = 0x83      # token(u32)，STM32 回覆 SYNC 訊框
+FRAME_CMD_TIME_SYNC_ESP = 0x84  # token(u32)，ESP32 攔截回覆
+PARAM_ID_ALL = 0xFF
+PARAM_STATUS_NAMES = ("OK", "unknown id", "out of range", "bad request")
+PARAM_REPLY_STRUCT = struct.Struct("<BBfff")
+SYNC_STRUCT = struct.Struct("<IBII")
+TRACE_STRUCT = struct.Struct("<HII")
+ESP_TRACE_STRUCT = struct.Struct("<II")
+HELLO_STRUCT = struct.Struct("<6sI")
+
+SAMPLE_FLAG_ECHO_VALID = 1 << 0
+SAMPLE_FLAG_MPU_OK = 1 << 1
+SAMPLE_FLAG_HIT = 1 << 2
+SAMPLE_FLAG_CALIBRATED = 1 << 3
+SAMPLE_FLAG_BUZZER = 1 << 4
+SAMPLE_FLAG_MOTOR = 1 << 5
+SAMPLE_FLAG_COOLDOWN = 1 << 6
+
+# seq, t_ms, ax, ay, az, gx, gy, gz, echo_us, flags
+SAMPLE_STRUCT = struct.Struct("<HI6hHB")
+
+# 剖析訊框：n | n × (count, min, avg, max)，區段順序同 stm32/cycle_profile.h
+PROFILE_ENTRY_STRUCT = struct.Struct("<HIII")
+PROFILE_SECTIONS = ("ranging", "imu_read", "fusion", "alert_fsm", "telemetry")
+
+UDP_HEADER = struct.Struct("<2sBII")  # magic, version, seq, ESP32 millis
+UDP_MAGIC = b"SC"
+UDP_VERSION = 1
+
+US_TO_CM = 0.017  # 與 STM32 相同：340 m/s 往返
+
+
+def crc16_ccitt(data: bytes, crc: int = 0xFFFF) -> int:
+    """CRC16-CCITT（多項式 0x1021，初值 0xFFFF）；binascii.crc_hqx 是同一個 CRC 的 C 實作。"""
+    return binascii.crc_hqx(data, crc)
+
+
+def decode_sample(payload: bytes) -> Optional[Dict[str, float]]:
+    """解析取樣訊框 payload，回傳與文字解析相同鍵名的字典。"""
+    if len(payload) != SAMPLE_STRUCT.size:
+        return None
+    seq, t_ms, ax, ay, az, gx, gy, gz, echo_us, flags = SAMPLE_STRUCT.unpack(payload)
+    return {
+        "seq": seq, "t_ms": t_ms,
+        "ax": ax, "ay": ay, "az": az, "gx": gx, "gy": gy, "gz": gz,
+        "echo_us": echo_us, "flags": flags,
+        "distance_cm": echo_us * US_TO_CM,
+    }
+
+
+def decode_profile(payload: bytes) -> Optional[Dict[str, Dict[str, int]]]:
+    """解析剖析訊框 payload，回傳 {區段名: {count, min, avg, max}}（單位：CPU 週期）。"""
+    if not payload:
+        return None
+    n = payload[0]
+    if len(payload) != 1 + n * PROFILE_ENTRY_STRUCT.size:
+        return None
+    out = {}
+    for i in range(n):
+        count, cmin, cavg, cmax = PROFILE_ENTRY_STRUCT.unpack_from(payload, 1 + i * PROFILE_ENTRY_STRUCT.size)
+        name = PROFILE_SECTIONS[i] if i < len(PROFILE_SECTIONS) else "section%d" % i
+        out[name] = {"count": count, "min": cmin, "avg": cavg, "max": cmax}
+    return out
+
+
+def decode_ranges(payload: bytes) -> Optional[List[Optional[float]]]:
+    """解析多感測器訊框 payload：n | n × echo_us(u16)，回傳各通道距離（cm，無回波為 None）。"""
+    if not payload or len(payload) != 1 + 2 * payload[0]:
+        return None
+    echoes = struct.unpack_from("<%dH" % payload[0], payload, 1)
+    return [us * US_TO_CM if us > 0 else None for us in echoes]
+
+
+def decode_datagram(data: bytes) -> Optional[Tuple[int, int, bytes]]:
+    """解析 UDP datagram，回傳 (seq, t_ms, 內容)；表頭不符回傳 None。"""
+    if len(data) < UDP_HEADER.size:
+        return None
+    magic, version, seq, t_ms = UDP_HEADER.unpack_from(data)
+    if magic != UDP_MAGIC or version != UDP_VERSION:
+        return None
+    return seq, t_ms, data[UDP_HEADER.size:]
+
+
+class SeqGapTracker:
+    """依 datagram 序號統計遺失與亂序；晚到（序號比已收到的舊）的資料已過時，直接丟棄。
+
+    accept() 回傳 (是否使用, 這次之前遺失的數量)。區網內亂序只差幾毫秒、幾個 datagram；
+    ESP32 時間明顯倒退或連續多個「晚到」視為 ESP32 重新開機，重新起算。
+    """
+
+    RESTART_BACKWARD_MS = 1000
+    RESTART_LATE_RUN = 8
+
+    def __init__(self) -> None:
+        self.expected: Optional[int] = None
+        self.last_t_ms = 0
+        self.received = 0
+        self.lost = 0
+        self.late = 0
+        self.restarts = 0
+        self.late_run = 0
+
+    def accept(self, seq: int, t_ms: int) -> Tuple[bool, int]:
+        gap = 0
+        if self.expected is not None:
+            diff = (seq - self.expected) & 0xFFFFFFFF
+            if diff >= 0x80000000:
+                back_ms = (self.last_t_ms - t_ms) & 0xFFFFFFFF
+                self.late_run += 1
+                if back_ms < self.RESTART_BACKWARD_MS and self.late_run < self.RESTART_LATE_RUN:
+                    # 晚到的 datagram：先前已算成遺失，這裡扣回
+                    self.late += 1
+                    self.lost = max(0, self.lost - 1)
+                    return False, 0
+                self.restarts += 1
+            else:
+                gap = diff
+                self.lost += gap
+        self.late_run = 0
+        self.expected = (seq + 1) & 0xFFFFFFFF
+        self.last_t_ms = t_ms
+        self.received += 1
+        return True, gap
+
+    def loss_ratio(self) -> float:
+        total = self.received + self.lost
+        return self.lost / total if total else 0.0
+
+
+def decode_event(payload: bytes) -> Optional[Dict[str, Union[int, str]]]:
+    """解析事件訊框 payload。"""
+    if len(payload) != 6:
+        return None
+    t_ms, event, flags = struct.unpack("<IBB", payload)
+    return {"t_ms": t_ms, "event": EVENT_NAMES.get(event, str(event)), "flags": flags}
+
+
+def _read_varint(data: bytes, i: int) -> Tuple[int, int]:
+    value = shift = 0
+    while True:
+        if i >= len(data):
+            raise ValueError("truncated varint")
+        b = data[i]
+        i += 1
+        value |= (b & 0x7F) << shift
+        if not b & 0x80:
+            return value, i
+        shift += 7
+
+
+class SampleReconstructor:
+    """由關鍵訊框（SAMPLE）與差量訊框（DELTA）還原每筆取樣。
+
+    feed() 回傳與 decode_sample 相同的字典，無法還原（尚未收到關鍵訊框、中間遺失）時回傳 None。
+    """
+
+    def __init__(self) -> None:
+        self.ref: Optional[Dict[str, float]] = None
+        self.keyframes = 0
+        self.deltas = 0
+        self.desync = 0  # 參考序號不符而丟棄的差量訊框
+
+    def feed(self, ftype: int, payload: bytes) -> Optional[Dict[str, float]]:
+        if ftype == FRAME_TYPE_SAMPLE:
+            sample = decode_sample(payload)
+            if sample is not None:
+                self.ref = dict(sample)
+                self.keyframes += 1
+            return sample
+        if ftype != FRAME_TYPE_DELTA or len(payload) < 5:
+            return None
+        seq, ref_seq = struct.unpack_from("<HB", payload)
+        if self.ref is None or ref_seq != (int(self.ref["seq"]) & 0xFF):
+            self.desync += 1
+            self.ref = None  # 等待下一個關鍵訊框
+            return None
+        try:
+            dt, i = _read_varint(payload, 3)
+            mask = payload[i]
+            i += 1
+            sample = dict(self.ref)
+            for bit, name in enumerate(DELTA_FIELDS):
+                if mask & (1 << bit):
+                    z, i = _read_varint(payload, i)
+                    sample[name] = int(sample[name]) + ((z >> 1) ^ -(z & 1))
+            if mask & 0x80:
+                sample["flags"] = payload[i]
+        except (ValueError, IndexError):
+            self.ref = None
+            return None
+        sample["seq"] = seq
+        sample["t_ms"] = (int(self.ref["t_ms"]) + dt) & 0xFFFFFFFF
+        sample["distance_cm"] = sample["echo_us"] * US_TO_CM
+        self.ref = sample
+        self.deltas += 1
+        return dict(sample)
+
+
+def encode_frame(ftype: int, payload: bytes) -> bytes:
+    """組成訊框（與 stm32/telemetry_frame.h 的 frame_encode 相同）。"""
+    body = bytes([ftype, len(payload)]) + payload
+    return FRAME_SYNC + body + struct.pack("<H", crc16_ccitt(body))
+
+
+def encode_param_get(param_id: int = PARAM_ID_ALL) -> bytes:
+    return encode_frame(FRAME_CMD_PARAM_GET, bytes([param_id]))
+
+
+def encode_param_set(param_id: int, value: float) -> bytes:
+    return encode_frame(FRAME_CMD_PARAM_SET, struct.pack("<Bf", param_id, value))
+
+
+def decode_param(payload: bytes) -> Optional[Dict[str, Union[int, float, str, None]]]:
+    """解析參數回覆；status 非 0 時沒有 value/min/max/name。"""
+    if len(payload) < 2:
+        return None
+    param_id, status = payload[0], payload[1]
+    out: Dict[str, Union[int, float, str, None]] = {
+        "id": param_id,
+        "status": PARAM_STATUS_NAMES[status] if status < len(PARAM_STATUS_NAMES) else str(status),
+        "value": None, "min": None, "max": None, "name": None,
+    }
+    if len(payload) >= PARAM_REPLY_STRUCT.size:
+        _, _, value, vmin, vmax = PARAM_REPLY_STRUCT.unpack_from(payload)
+        out.update(value=value, min=vmin, max=vmax,
+                   name=payload[PARAM_REPLY_STRUCT.size:].decode("ascii", errors="replace"))
+    return out
+
+
+def encode_time_sync(source: str, token: int) -> bytes:
+    cmd = FRAME_CMD_TIME_SYNC_ESP if source == "esp32" else FRAME_CMD_TIME_SYNC
+    return encode_frame(cmd, struct.pack("<I", token & 0xFFFFFFFF))
+
+
+def decode_sync(payload: bytes) -> Optional[Dict[str, Union[int, str]]]:
+    """時鐘同步回覆：rx_us / tx_us 為裝置收到指令與送出回覆的時間（u32 µs，會溢位）。"""
+    if len(payload) < SYNC_STRUCT.size:
+        return None
+    token, source, rx_us, tx_us = SYNC_STRUCT.unpack_from(payload)
+    name = SYNC_SOURCES[source] if source < len(SYNC_SOURCES) else str(source)
+    return {"token": token, "source": name, "rx_us": rx_us, "tx_us": tx_us}
+
+
+def decode_trace(payload: bytes) -> Optional[Dict[str, int]]:
+    if len(payload) < TRACE_STRUCT.size:
+        return None
+    seq, capture_us, tx_us = TRACE_STRUCT.unpack_from(payload)
+    return {"seq": seq, "capture_us": capture_us, "tx_us": tx_us}
+
+
+def decode_esp_trace(payload: bytes) -> Optional[Dict[str, int]]:
+    if len(payload) < ESP_TRACE_STRUCT.size:
+        return None
+    rx_us, tx_us = ESP_TRACE_STRUCT.unpack_from(payload)
+    return {"rx_us": rx_us, "tx_us": tx_us}
+
+
+def decode_hello(payload: bytes) -> Optional[Dict[str, Union[int, str]]]:
+    if len(payload) < HELLO_STRUCT.size:
+        return None
+    mac, connects = HELLO_STRUCT.unpack_from(payload)
+    return {"mac": mac.hex(":"), "connects": connects}
+
+
+def decode_backlog(payload: bytes) -> Optional[Tuple[int, bytes]]:
+    """解析補送訊框 payload，回傳 (ESP32 收到的時間 ms, 原始串流片段)；片段依序交給另一個 FrameDecoder。"""
+    if len(payload) < 4:
+        return None
+    return struct.unpack_from("<I", payload)[0], payload[4:]
+
+
+FrameItem = Tuple[str, Union[str, Tuple[int, bytes]]]
+
+
+class FrameDecoder:
+    """串流解碼器：餵入任意切割的位元組，取出文字行與通過 CRC 的訊框。
+
+    feed() 回傳 [("text", line)] 或 [("frame", (type, payload))]。
+    """
+
+    def __init__(self) -> None:
+        self.buf = bytearray()
+        self.crc_errors = 0
+        self.frames = 0
+
+    def feed(self, data: bytes) -> List[FrameItem]:
+        self.buf.extend(data)
+        out: List[FrameItem] = []
+        buf = self.buf
+        i = 0
+        n = len(buf)
+        while i < n:
+            if buf[i] == 0xA5:
+                if i + 1 >= n:
+                    break
+                if buf[i + 1] != 0x5A:
+                    i += 1
+                    continue
+                if i + FRAME_HEADER_LEN > n:
+                    break
+                ftype = buf[i + 2]
+                length = buf[i + 3]
+                if length > FRAME_MAX_PAYLOAD:
+                    i += 1
+                    continue
+                end = i + FRAME_HEADER_LEN + length + FRAME_CRC_LEN
+                if end > n:
+                    break
+                body = bytes(buf[i + 2:i + FRAME_HEADER_LEN + length])
+                crc = buf[end - 2] | (buf[end - 1] << 8)
+                if crc16_ccitt(body) == crc:
+                    out.append(("frame", (ftype, body[2:])))
+                    self.frames += 1
+                    i = end
+                else:
+                    # CRC 錯誤：跳過同步字元重新搜尋
+                    self.crc_errors += 1
+                    i += 1
+                continue
+            nl = buf.find(b"\n", i)
+            sync = buf.find(b"\xa5", i)
+            if nl < 0 or (0 <= sync < nl):
+                # 文字行尚未結束或中途遇到訊框：保留剩餘資料
+                stop = sync if sync >= 0 else n
+                if stop - i > MAX_TEXT_LINE:
+                    i = stop
+                    continue
+                if sync < 0:
+                    break
+                # 文字行被訊框打斷，輸出已收到的部分
+                line = bytes(buf[i:sync]).decode("utf-8", errors="ignore").strip()
+                if line:
+                    out.append(("text", line))
+                i = sync
+                continue
+            line = bytes(buf[i:nl]).decode("utf-8", errors="ignore").strip()
+            if line:
+                out.append(("text", line))
+            i = nl + 1
+        del buf[:i]
+        return out
@@ -1,26 +1,129 @@
 #include "mbed.h"
+#include "telemetry_frame.h"
+#include "uart_tx_queue.h"
+#include "scheduler.h"
+#include "echo_capture.h"
+#include "mpu6050.h"
+#include "orientation.h"
+#include "tilt_bench.h"
+#include "cycle_profile.h"
+#include "pattern_engine.h"
+#include "alert_output.h"
+#include "power_manager.h"
+#include "distance_filter.h"
+#include "spsc_ring.h"
+#include "calibration.h"
+#include "range_array.h"
+#include "alert_logic.h"
+#include "param_table.h"
+#include "telemetry_delta.h"
+
+// 遙測輸出模式：1 = 二進位訊框（預設，約 27 bytes/frame），0 = 文字 printf（除錯用）
+// 啟動訊息與校準事件等低頻文字行在兩種模式下都會輸出
+#ifndef TELEMETRY_BINARY
+#define TELEMETRY_BINARY 1
+#endif
+
+// 省電模式切換需要 MPU6050 INT 腳（FIFO 模式）作為動作喚醒來源
+#define POWER_ADAPTIVE (POWER_MANAGEMENT && IMU_FIFO_MODE)
+
+// 與 ESP32 之間的 UART 速率（兩端需相同，見 esp32/ 的 LINK_BAUD）；9600 為原本的相容速率
+#ifndef LINK_BAUD
+#define LINK_BAUD 460800
+#endif
+
+// UART 輸出佇列大小（bytes，需為 2 的次方；460800 baud 約 22ms、9600 baud 約 1 秒的資料量）與滿載時的處理方式
+#ifndef TX_QUEUE_SIZE
+#define TX_QUEUE_SIZE 1024
+#endif
+#ifndef TX_OVERFLOW_POLICY
+#define TX_OVERFLOW_POLICY TX_DROP_NEWEST
+#endif
 
 // 明確指定 UART 走 PA_2/PA_3，預設 9600
-static Serial pc(PA_2, PA_3);
+// 使用 RawSerial：可在 TX 中斷內呼叫 putc（Serial 內含 mutex，不可用於中斷）
+static RawSerial pc(PA_2, PA_3);
+TxQueue<TX_QUEUE_SIZE> tx_queue;  // 所有輸出都先進佇列，主迴圈不等待 UART
+volatile bool tx_active = false;  // TX 中斷是否已啟用
+SpscRing<uint8_t, 256> rx_ring;   // RX 中斷收到的位元組（PC 經 ESP32 送來的指令訊框）
+FrameParser cmd_parser;           // 指令訊框解析（主迴圈）
 
 // 超音波腳位（Echo 請分壓到 3.3V）
 DigitalOut led_hb(PC_13);        // 心跳燈（PC13 低電位亮）
-DigitalOut buzzer(PB_4);         // 蜂鳴器
-DigitalOut motor(PB_5);          // 馬達驅動（請經 MOSFET/三極體）
-DigitalIn btn(PB_12);            // 按鈕（按下校準零點，使用輪詢方式）
-DigitalOut trig(PB_8);
-InterruptIn echo(PA_0);          // Echo 請確保分壓到 3.3V`
+InterruptIn btn(PB_12);          // 按鈕（按下校準零點，EXTI 中斷 + 計時器去彈跳）
+Timeout btn_debounce;            // 最後一次邊緣後經過去彈跳時間才取樣
+static_assert(RANGE_CHANNELS >= 1 && RANGE_CHANNELS <= ECHO_CAPTURE_MAX_CHANNELS, "RANGE_CHANNELS out of range");
+DigitalOut trig0(PB_8);          // 地面感測器 Trig
+#if RANGE_CHANNELS > 1
+DigitalOut trig1(PB_9);          // 前方感測器 Trig
+DigitalOut *const trig_pins[RANGE_CHANNELS] = {&trig0, &trig1};
+#else
+DigitalOut *const trig_pins[RANGE_CHANNELS] = {&trig0};
+#endif
+#if !ECHO_CAPTURE_MODE
+InterruptIn echo0(PA_0);         // Echo 請確保分壓到 3.3V`
+#if RANGE_CHANNELS > 1
+InterruptIn echo1(PB_10);
+InterruptIn *const echo_pins[RANGE_CHANNELS] = {&echo0, &echo1};
+#else
+InterruptIn *const echo_pins[RANGE_CHANNELS] = {&echo0};
+#endif
 Timer t;
+#endif
+#if POWER_MANAGEMENT && DEVICE_LPTICKER
+LowPowerTimer uptime;            // 開機計時（遙測時間戳）；lp_ticker 不會鎖住 deep sleep
+#else
+Timer uptime;                    // 開機計時（遙測時間戳）
+#endif
 
-volatile uint32_t echo_us = 0;   // microseconds
-bool calibrate = false;          // 按鈕觸發校準（輪詢方式，不需要volatile）
+EventFlags loop_events;           // 中斷喚醒主迴圈用
+const uint32_t EVT_ECHO_DONE = 1 << 0;
+const uint32_t EVT_IMU_FIFO = 1 << 1;
+const uint32_t EVT_IMU_I2C = 1 << 2;
+const uint32_t EVT_IMU_MOTION = 1 << 3;  // 靜止模式下 MPU6050 偵測到動作
+const uint32_t EVT_BUTTON = 1 << 4;      // 按鈕狀態穩定改變
+const uint32_t EVT_COMMAND = 1 << 5;     // UART 收到指令位元組
+bool calibrate = false;          // 校準進行中（按鈕觸發，只在主迴圈讀寫，不需要volatile）
 float zero_pitch_deg = 0.0f;     // 手杖角度零點
 float zero_distance_cm = 0.0f;   // 距離零點
 
-// MPU6050 腳位與地址
-I2C i2c(PB_7, PB_6);             // SDA, SCL我的MPU6050 測是起來
-const int MPU_ADDR = 0x68 << 1;  // mbed 使用 8-bit 地址
+// 回波事件：中斷內放入樣本環，主迴圈依觸發序號認領，逾時後才到的回波不會被誤認為下一次量測
+struct EchoEvent {
+    uint8_t channel;     // 感測器通道
+    uint32_t ping;       // 中斷發生時的觸發序號
+    uint32_t width_us;   // 脈寬
+    uint32_t t_us;       // 下降沿時間（us_ticker）
+};
+SpscRing<EchoEvent, 8> echo_ring;
+volatile uint32_t ping_seq = 0;  // 每次觸發加 1（主迴圈寫、中斷讀）
+volatile int range_active = 0;   // 目前量測中的通道
+uint32_t echo_stale = 0;         // 不屬於目前量測的回波數
+
+// 按鈕邊緣事件
+struct ButtonEvent {
+    uint32_t t_ms;
+    bool pressed;
+};
+SpscRing<ButtonEvent, 8> button_ring;
 
+// 本次回波完成（中斷內呼叫）
+void echo_push(int channel, uint32_t width_us) {
+    EchoEvent ev = {(uint8_t)channel, ping_seq, width_us, us_ticker_read()};
+    echo_ring.push(ev);
+    loop_events.set(EVT_ECHO_DONE);  // 立即喚醒主迴圈處理結果並排下一次觸發
+}
+
+#if ECHO_CAPTURE_MODE
+// 脈寬由 TIM2 捕捉暫存器計算（32-bit 相減自動處理回繞）
+void echo_captured(const EchoCapture &c) {
+    echo_push(c.channel, c.fall_us - c.rise_us);
+}
+
+bool echo_pin_high(int channel) {
+    return echo_capture_pin_high(channel);
+}
+#else
+// 同一時間只有一個感測器被觸發，所有 Echo 腳共用同一組中斷與計時器
 void echo_rise() {
     t.reset();
     t.start();
@@ -28,364 +131,957 @@ void echo_rise() {
 
 void echo_fall() {
     t.stop();
-    echo_us = t.read_us();
+    echo_push(range_active, t.read_us());
 }
 
-// 按鈕已改為輪詢方式，不再使用中斷
+bool echo_pin_high(int channel) {
+    return echo_pins[channel]->read();
+}
+#endif
 
-void mpu_write(uint8_t reg, uint8_t val) {
-    char d[2] = {(char)reg, (char)val};
-    i2c.write(MPU_ADDR, d, 2);
+// TX 中斷：UART 可寫時從佇列補位元組，佇列空了就關閉 TX 中斷
+void uart_tx_isr() {
+    uint8_t c;
+    while (pc.writeable()) {
+        if (!tx_queue.pop(c)) {
+            pc.attach(NULL, SerialBase::TxIrq);
+            tx_active = false;
+            return;
+        }
+        pc.putc(c);
+    }
 }
 
-bool mpu_read(uint8_t reg, char *buf, int len) {
-    char r = reg;
-    if (i2c.write(MPU_ADDR, &r, 1, true) != 0) return false;
-    if (i2c.read(MPU_ADDR, buf, len) != 0) return false;
-    return true;
+// RX 中斷：收下所有可讀位元組放入環形緩衝區，由指令任務在主迴圈解析
+void uart_rx_isr() {
+    while (pc.readable()) rx_ring.push((uint8_t)pc.getc());
+    loop_events.set(EVT_COMMAND);
 }
 
-bool mpu_init() {
-    i2c.frequency(400000); // 400kHz
-    mpu_write(0x6B, 0x00); // PWR_MGMT_1: 退出睡眠
-    thread_sleep_for(100);
-    char whoami = 0;
-    if (!mpu_read(0x75, &whoami, 1)) return false;
-    return (whoami == 0x68);
+// 啟用 / 停用指令接收；RX 中斷啟用時 Mbed 會鎖住 deep sleep，靜止模式需停用才能進入 Stop
+void uart_rx_enable(bool on) {
+    if (on) {
+        pc.attach(&uart_rx_isr, SerialBase::RxIrq);
+    } else {
+        pc.attach(NULL, SerialBase::RxIrq);
+    }
 }
 
-int main() {
-    pc.baud(9600);
-    pc.format(8, SerialBase::None, 1);
-    pc.printf("HC-SR04 + MPU6050 demo\r\n");
+// 寫入輸出佇列（不會等待 UART），佇列滿時依 TX_OVERFLOW_POLICY 捨棄並計數
+void tx_write(const uint8_t *data, size_t len) {
+    core_util_critical_section_enter();
+    tx_queue.push(data, len, TX_OVERFLOW_POLICY);
+    if (!tx_active && !tx_queue.empty()) {
+        tx_active = true;
+        pc.attach(&uart_tx_isr, SerialBase::TxIrq);  // TXE 已為 1，退出臨界區後立即進入中斷
+    }
+    core_util_critical_section_exit();
+}
 
-    // 初始化蜂鳴器和馬達為低電平，確保不會有雜音
-    buzzer = 0;
-    motor = 0;
-    pc.printf("Buzzer and motor initialized to OFF\r\n");
+// 格式化後寫入輸出佇列（取代 pc.printf，單行上限 159 字元）
+void tx_printf(const char *fmt, ...) {
+    char line[160];
+    va_list args;
+    va_start(args, fmt);
+    int n = vsnprintf(line, sizeof(line), fmt, args);
+    va_end(args);
+    if (n <= 0) return;
+    if (n >= (int)sizeof(line)) n = sizeof(line) - 1;
+    tx_write((const uint8_t *)line, n);
+}
 
-    // 超音波設定
-    echo.mode(PullDown);    // 防止 Echo 浮空
-    echo.rise(&echo_rise);
-    echo.fall(&echo_fall);
-    btn.mode(PullUp);      // 上拉模式：PB12 > 按鈕 > GND（按下為0，未按下為1）
-    pc.printf("Button PB12 initialized (PullUp, polling mode)\r\n");
-    pc.printf("Button connection: PB12 > Button > GND\r\n");
-    pc.printf("Button logic: Pressed=0 (GND), Released=1 (PullUp)\r\n");
+// 送出一個完整的二進位訊框
+void send_frame(const uint8_t *buf, size_t len) {
+    tx_write(buf, len);
+}
 
-    // MPU6050 初始化
-    bool mpu_ok = mpu_init();
-    pc.printf("MPU6050 init: %s\r\n", mpu_ok ? "OK" : "FAIL");
+// ===== 排程任務 =====
+// 各任務週期可獨立調整；取樣率由 target_fps 決定，而不是阻塞延遲的總和
+// 非 const 的參數可由主機以指令訊框調整（見下方參數表與 param_table.h）
+int target_fps = 8;                             // 目標 IMU/遙測取樣率（FPS）
+int loop_delay_ms = 1000 / target_fps;          // 約 125ms
+const int range_min_interval_ms = 20;           // 兩次觸發的最小間隔（避免收到上一次的殘響）
+const int range_timeout_ms = 40;                // 等待回波逾時（HC-SR04 無回波時約 38ms）
+const uint32_t range_max_echo_us = 38000;       // 超過此值視為無回波
+const int range_stagger_ms = 10;                // 多感測器：上一個完成後間隔多久才觸發下一個（避免串音）
+const int param_dump_retry_ms = 5;              // 參數整表回覆等待輸出佇列空間的間隔（115200 baud 約送出 60 bytes）
+const int calib_save_retry_ms = 500;           // 警示或提示音進行中時，延後多久再嘗試寫入校準結果
+const int fast_period_ms = 10;                  // 按鈕 / 指令處理期限，也是警示評估（冷卻期檢查、事件）週期
+const int button_debounce_ms = 20;              // 按鈕去彈跳時間
+const uint16_t imu_rate_hz = 200;               // FIFO 模式 MPU6050 取樣率
+const int imu_watermark = 10;                   // FIFO 累積幾筆通知一次（200Hz 下每 50ms 讀一批）
+const int prof_report_period_ms = 5000;         // 週期統計回報間隔
 
-    // 按鈕狀態變數
-    static bool btn_was_pressed = false;  // 上次是否按下
-        
-    while (true) {
-        // 簡單檢測：PB12是否接到GND（按下為0，未按下為1）
-        bool btn_current = btn.read();
-        
-        // 檢測按下：PB12接地（讀數為0）
-        if (btn_current == 0 && !btn_was_pressed && !calibrate) {
-            // 按鈕剛按下，觸發校準
-            calibrate = true;
-            buzzer = 1;
-            thread_sleep_for(100);  // 響100ms確認
-            buzzer = 0;
-            pc.printf("[DEBUG] Button PB12 pressed, calibrate flag set\r\n");
+// 省電模式：靜止一段時間後降低取樣率，MPU6050 動作偵測中斷喚醒
+const int stationary_enter_ms = 15000;          // 連續靜止多久後進入省電模式
+const float still_gyro_dps = 3.0f;              // 各軸角速度低於此值視為靜止
+const float still_accel_g = 0.05f;              // 加速度大小與 1g 的差低於此值視為靜止
+const uint16_t stationary_imu_rate_hz = 20;     // 省電模式 MPU6050 取樣率
+const int stationary_imu_period_ms = 500;       // 省電模式 IMU 讀取週期
+const int stationary_range_interval_ms = 250;   // 省電模式測距間隔
+const int stationary_slow_period_ms = 50;       // 省電模式冷卻期檢查週期
+const uint8_t motion_threshold = 20;            // MOT_THR（2mg/LSB，40mg）
+const uint8_t motion_duration_ms = 5;           // MOT_DUR
+const int power_report_period_ms = 30000;       // 各模式耗電統計回報間隔
+
+// 校準：累積多筆樣本取平均，任一量標準差過大時不採用
+const CalibLimits calib_limits = {
+    IMU_FIFO_MODE ? 100u : 8u,               // IMU 樣本數（FIFO 200Hz 約 0.5 秒，單筆模式約 1 秒）
+    10,                                      // 距離樣本數
+    3000,                                    // 期限（ms）
+    0.5f,                                    // 俯仰角標準差上限（度）
+    3.0f,                                    // 距離標準差上限（cm）
+    still_gyro_dps * GYRO_LSB_PER_DPS,       // 陀螺儀標準差上限（LSB）
+};
+
+// 警示邏輯參數：偵測高低差（距離變大）
+float safety_margin_cm = 50.0f;    // 大於此差值視為下陷/坑洞，可調（50cm）
+int hit_need = 2;                  // 連續次數
+int hit_need_confident = 2;        // 距離濾波有把握時的連續次數（重播模擬未證實單筆可靠前維持 2）
+int motor_cooldown_ms = 5000;      // 馬達冷卻期（5秒），避免連續觸發
+float urgency_span_cm = 100.0f;    // 超過閾值多少 cm 時急迫度達到最大（最高音、馬達全速）
+float forward_obstacle_cm = 80.0f; // 前方感測器：距離小於此值視為障礙物
+
+// 遙測內容：0 = 關閉（只剩文字事件），1 = 取樣訊框，2 = 全部（另含多感測器與週期統計訊框）
+const int TELEMETRY_OFF = 0;
+const int TELEMETRY_SAMPLES = 1;
+const int TELEMETRY_FULL = 2;
+int telemetry_level = TELEMETRY_FULL;
+
+// 差量遙測（見 telemetry_delta.h）：關鍵訊框間隔與死區（IMU 8 LSB 約 0.5mg / 0.06dps，回波 58us 約 1cm）
+int telemetry_delta = TELEMETRY_DELTA;
+int keyframe_ms = 1000;
+int imu_deadband_lsb = 8;
+int echo_deadband_us = 58;
+DeltaEncoder delta_enc;
+
+// 延遲追蹤：每 trace_every 個取樣訊框附一個 TRACE 訊框（0 = 關閉），主機端以時鐘同步換算各段延遲
+int trace_every = 4;
+
+// 輸出節奏（level, ms），由 pattern_engine 以計時器中斷精確切換；警示節奏的時間可由參數表調整
+// 蜂鳴器：響0.1秒 → 停0.1秒 → 響0.1秒 → 停0.7秒，周期1秒循環
+int buzzer_on_ms = 100;
+int buzzer_gap_ms = 100;
+int buzzer_pause_ms = 700;
+PatternStep buzzer_alert_steps[] = {{1, 100}, {0, 100}, {1, 100}, {0, 700}};
+constexpr Pattern buzzer_alert = make_pattern(buzzer_alert_steps, true);
+// 馬達：響0.1秒 → 休息0.1秒 → 再響0.1秒（一次）
+int motor_on_ms = 100;
+int motor_gap_ms = 100;
+PatternStep motor_alert_steps[] = {{1, 100}, {0, 100}, {1, 100}};
+constexpr Pattern motor_alert = make_pattern(motor_alert_steps, false);
+// 心跳燈：閃0.1秒 暗0.1秒 閃0.1秒 暗0.1秒 閃0.3秒 暗0.3秒（循環）
+constexpr PatternStep heartbeat_steps[] = {{1, 100}, {0, 100}, {1, 100}, {0, 100}, {1, 300}, {0, 300}};
+constexpr Pattern heartbeat = make_pattern(heartbeat_steps, true);
+// 按鈕確認音：響0.1秒（一次）
+constexpr PatternStep button_beep_steps[] = {{1, 100}};
+constexpr Pattern button_beep = make_pattern(button_beep_steps, false);
+// 校準失敗：三短聲（一次）
+constexpr PatternStep calib_fail_steps[] = {{1, 60}, {0, 60}, {1, 60}, {0, 60}, {1, 60}};
+constexpr Pattern calib_fail_beep = make_pattern(calib_fail_steps, false);
+
+uint32_t now_ms() {
+    return (uint32_t)uptime.read_ms();
+}
+
+Scheduler<8> sched(now_ms);
+int range_task = -1;             // 測距為事件任務，由回波完成或逾時釋放
+int imu_task = -1;               // FIFO 水位中斷會提早釋放 IMU 任務
+int button_task = -1;            // 按鈕為事件任務，由去彈跳後的按鈕事件釋放
+int alert_task = -1;
+int telemetry_task = -1;
+int command_task = -1;           // 指令為事件任務，由 RX 中斷釋放
+int calib_save_task = -1;        // 校準寫入為事件任務，由校準成功釋放
+uint32_t range_interval_ms = range_min_interval_ms;  // 目前的測距間隔（省電模式放寬）
+uint32_t still_since_ms = 0;     // 最近一次「不靜止」樣本的時間
+volatile bool power_wake = false; // 要求離開省電模式（動作中斷、按鈕、警示）
+
+bool mpu_ok = false;
+
+// 最新的量測結果（由各任務更新，供警示與遙測使用）
+RangeChannel ranges[RANGE_CHANNELS]; // 各感測器的距離（通道 0 為地面感測器，遙測與校準使用）
+bool range_busy = false;         // 已觸發，等待回波或逾時
+uint32_t range_done_ms = 0;      // 上一次量測完成時間
+bool imu_valid = false;          // 最近一次 MPU 讀取是否成功
+uint32_t imu_samples = 0;        // 累計處理的 IMU 樣本數
+OrientationFilter ori;           // 陀螺儀 + 加速度計姿態融合，每筆 IMU 樣本更新一次
+int16_t ax, ay, az, gx, gy, gz;
+float roll = 0.0f, pitch = 0.0f, pitch_rel = 0.0f;
+float distance_comp = 0.0f, distance_rel = 0.0f, distance_comp_rel = 0.0f;
+bool calibrated_pending = false; // 校準已完成，等待遙測回報
+CalibAccum calib_acc;            // 校準期間的樣本統計
+CalibData calib_unsaved;         // 已套用、尚未寫入 Flash 的校準結果
+bool calib_save_pending = false;
+
+// 警示狀態（連續次數、馬達冷卻期，見 alert_logic.h）
+AlertState alert;
+int buzzer_ch = -1;                // 節奏引擎通道
+int motor_ch = -1;
+int led_ch = -1;
+
+// 節奏引擎的通道輸出（中斷內呼叫）；蜂鳴器/馬達見 alert_output.h
+void led_out(uint8_t level) { led_hb = level ? 0 : 1; }   // PC13 低電位亮
+
+// 要求回到活動模式：立即釋放 IMU 任務，由它在 I2C 閒置時切換
+void power_request_wake() {
+    if (power_mode() == POWER_ACTIVE) return;
+    power_wake = true;
+    sched.release_at(imu_task, now_ms());
+}
+
+// 去彈跳計時到（中斷內呼叫）：狀態與上次穩定狀態不同才放入按鈕事件
+void button_settled() {
+    static bool stable_pressed = false;
+    bool pressed = (btn.read() == 0);    // PB12接到GND為按下（讀數為0）
+    if (pressed == stable_pressed) return;
+    stable_pressed = pressed;
+    ButtonEvent ev = {now_ms(), pressed};
+    button_ring.push(ev);
+    loop_events.set(EVT_BUTTON);
+}
+
+// 按鈕邊緣（中斷內呼叫）：每次彈跳都重新計時，最後一次邊緣後 button_debounce_ms 才取樣
+void button_edge() {
+    btn_debounce.attach_us(&button_settled, button_debounce_ms * 1000);
+}
+
+// 按鈕：取出按鈕事件，按下觸發校準；確認音交給節奏引擎，不阻塞主迴圈
+void task_button() {
+    ButtonEvent ev;
+    while (button_ring.pop(ev)) {
+        if (!ev.pressed || calibrate) continue;
+        calibrate = true;
+        calib_begin(calib_acc, now_ms());
+        power_request_wake();
+        pattern_play(buzzer_ch, button_beep);  // 警示中會暫停一聲，下次評估時重新開始
+        tx_printf("[DEBUG] Button PB12 pressed, calibrate flag set\r\n");
+    }
+}
+
+// 目前的 SAMPLE_FLAG_*（遙測訊框與事件共用）
+uint8_t sample_flags() {
+    uint8_t f = 0;
+    if (ranges[0].echo_us > 0) f |= SAMPLE_FLAG_ECHO_VALID;
+    if (imu_valid) f |= SAMPLE_FLAG_MPU_OK;
+    if (alert.hit_count >= hit_need) f |= SAMPLE_FLAG_HIT;
+    if (calibrated_pending) f |= SAMPLE_FLAG_CALIBRATED;
+    if (buzzer_is_on()) f |= SAMPLE_FLAG_BUZZER;
+    if (motor_is_on()) f |= SAMPLE_FLAG_MOTOR;
+    if (alert.motor_in_cooldown) f |= SAMPLE_FLAG_COOLDOWN;
+    return f;
+}
+
+// 事件訊框立即送出，不等下一個遙測週期（文字模式另有對應的文字行）
+void send_event(TelemetryEvent ev) {
+#if TELEMETRY_BINARY
+    uint8_t buf[FRAME_MAX_LEN];
+    send_frame(buf, encode_event_frame(now_ms(), ev, sample_flags(), buf));
+#else
+    (void)ev;
+#endif
+}
+
+// 檢查警示狀態的邊緣（警示開始 / 結束、馬達冷卻期開始 / 結束）
+void telemetry_events_poll() {
+    static bool last_hit = false;
+    static bool last_cooldown = false;
+    bool hit_now = alert.hit_count >= hit_need;
+    bool cooldown = alert.motor_in_cooldown;
+    if (hit_now != last_hit) send_event(hit_now ? EVENT_HIT_START : EVENT_HIT_STOP);
+    if (cooldown != last_cooldown) send_event(cooldown ? EVENT_COOLDOWN_START : EVENT_COOLDOWN_END);
+    last_hit = hit_now;
+    last_cooldown = cooldown;
+}
+
+// 參數表寫入後同步節奏步驟表（中斷讀取 16-bit 欄位，單次寫入不會讀到一半）
+void alert_timing_apply() {
+    buzzer_alert_steps[0].duration_ms = buzzer_alert_steps[2].duration_ms = (uint16_t)buzzer_on_ms;
+    buzzer_alert_steps[1].duration_ms = (uint16_t)buzzer_gap_ms;
+    buzzer_alert_steps[3].duration_ms = (uint16_t)buzzer_pause_ms;
+    motor_alert_steps[0].duration_ms = motor_alert_steps[2].duration_ms = (uint16_t)motor_on_ms;
+    motor_alert_steps[1].duration_ms = (uint16_t)motor_gap_ms;
+}
+
+// 遙測速率改變：IMU / 遙測任務改用新週期（省電模式的 IMU 週期不變，回到活動模式時套用）
+void telemetry_rate_apply() {
+    loop_delay_ms = 1000 / target_fps;
+    sched.set_period(telemetry_task, loop_delay_ms, loop_delay_ms / 2);
+    if (power_mode() == POWER_ACTIVE) sched.set_period(imu_task, loop_delay_ms, loop_delay_ms / 2);
+}
+
+// 切換差量遙測或改變策略時，下一筆送關鍵訊框
+void telemetry_delta_apply() {
+    delta_encoder_init(delta_enc);
+}
+
+// 執行期參數表：id 為索引，新增參數請加在最後，主機端的 id 才不會錯位
+const ParamDef params[] = {
+    // 名稱                  型態         變數                  最小     最大      寫入後
+    {"safety_margin_cm",    PARAM_FLOAT, &safety_margin_cm,    5.0f,   300.0f,   NULL},
+    {"forward_obstacle_cm", PARAM_FLOAT, &forward_obstacle_cm, 10.0f,  400.0f,   NULL},
+    {"urgency_span_cm",     PARAM_FLOAT, &urgency_span_cm,     10.0f,  500.0f,   NULL},
+    {"hit_need",            PARAM_INT,   &hit_need,            1,      20,       NULL},
+    {"hit_need_confident",  PARAM_INT,   &hit_need_confident,  1,      20,       NULL},
+    {"motor_cooldown_ms",   PARAM_INT,   &motor_cooldown_ms,   0,      60000,    NULL},
+    {"buzzer_on_ms",        PARAM_INT,   &buzzer_on_ms,        10,     2000,     alert_timing_apply},
+    {"buzzer_gap_ms",       PARAM_INT,   &buzzer_gap_ms,       10,     2000,     alert_timing_apply},
+    {"buzzer_pause_ms",     PARAM_INT,   &buzzer_pause_ms,     10,     10000,    alert_timing_apply},
+    {"motor_on_ms",         PARAM_INT,   &motor_on_ms,         10,     2000,     alert_timing_apply},
+    {"motor_gap_ms",        PARAM_INT,   &motor_gap_ms,        10,     2000,     alert_timing_apply},
+    {"target_fps",          PARAM_INT,   &target_fps,          1,      50,       telemetry_rate_apply},
+    {"telemetry_level",     PARAM_INT,   &telemetry_level,     TELEMETRY_OFF, TELEMETRY_FULL, NULL},
+    {"telemetry_delta",     PARAM_INT,   &telemetry_delta,     0,      1,        telemetry_delta_apply},
+    {"keyframe_ms",         PARAM_INT,   &keyframe_ms,         100,    10000,    telemetry_delta_apply},
+    {"imu_deadband_lsb",    PARAM_INT,   &imu_deadband_lsb,    0,      1000,     telemetry_delta_apply},
+    {"echo_deadband_us",    PARAM_INT,   &echo_deadband_us,    0,      1000,     telemetry_delta_apply},
+    {"trace_every",         PARAM_INT,   &trace_every,         0,      100,      NULL},
+};
+const int PARAM_COUNT = sizeof(params) / sizeof(params[0]);
+
+// 指令：解析 RX 環內的位元組，完整的指令訊框交給參數表處理，回覆走一般輸出佇列
+// 整表回覆只送出輸出佇列放得下的部分（佇列滿時會捨棄新資料），其餘在下一次執行時繼續
+void task_command() {
+    static uint32_t unknown_commands = 0;
+    static ParamDump param_dump = {-1};
+    uint8_t c;
+    for (;;) {
+        // 先取出 CRC 錯誤後重新掃描找到的訊框，再讀 RX 環
+        if (!frame_parser_poll(cmd_parser)) {
+            if (!rx_ring.pop(c)) break;
+            if (!frame_parser_feed(cmd_parser, c)) continue;
         }
-        
-        btn_was_pressed = (btn_current == 0);  // 記錄當前狀態
-        
-        // --- 超音波測距 ---
-        echo_us = 0;
-        trig = 0;
-        thread_sleep_for(2);
-        trig = 1;
-        wait_us(10);
-        trig = 0;
-
-        thread_sleep_for(50);  // 等待回波
-
-        float distance_cm = echo_us * 0.017f;  // 340 m/s -> us to cm
-        pc.printf("distance: %.2f cm\r\n", distance_cm);
-
-        // --- 讀 MPU6050 ---
-        if (mpu_ok) {
-            char buf[14] = {0};
-            if (mpu_read(0x3B, buf, 14)) {
-                int16_t ax = (buf[0] << 8) | buf[1];
-                int16_t ay = (buf[2] << 8) | buf[3];
-                int16_t az = (buf[4] << 8) | buf[5];
-                int16_t gx = (buf[8] << 8) | buf[9];
-                int16_t gy = (buf[10] << 8) | buf[11];
-                int16_t gz = (buf[12] << 8) | buf[13];
-                // 以加速度估計手杖傾斜角（俯仰/翻滾），單位度數
-                float roll = atan2f((float)ay, (float)az) * 57.2958f;
-                float pitch = atanf(-(float)ax / sqrtf((float)ay * ay + (float)az * az)) * 57.2958f;
-                float pitch_rad = pitch * 0.0174533f;
-                float distance_comp = distance_cm * cosf(pitch_rad);  // 補償傾斜
-
-                // 按鈕校準：將當前角度與距離設定為零點
-                if (calibrate) {
-                    pc.printf("[DEBUG] Calibrate flag detected in main loop\r\n");
-                    pc.printf("Calibrated: PB12 pressed\r\n");
-                    zero_pitch_deg = pitch;
-                    zero_distance_cm = distance_cm;
-                    calibrate = false;
-                    pc.printf("Calibrated: zero_pitch=%.2f deg, zero_distance=%.2f cm\r\n",
-                              zero_pitch_deg, zero_distance_cm);
-                }
-
-                float pitch_rel = pitch - zero_pitch_deg;
-                float distance_rel = distance_cm - zero_distance_cm;
-                float distance_comp_rel = distance_comp - zero_distance_cm; // 以校準零點作為基準
-
-                // 警示邏輯：偵測高低差（距離變大）
-                const float safety_margin_cm = 50.0f; // 大於此差值視為下陷/坑洞，可調（50cm）
-                static int hit_count = 0;
-                const int hit_need = 2;            // 連續次數
-                const int buzzer_pulse_ms = 100;  // 蜂鳴器單次響的時間（0.1秒）
-                const int buzzer_short_rest_ms = 100;  // 蜂鳴器短休息時間（0.1秒，兩聲之間）
-                const int buzzer_long_rest_ms = 700;   // 蜂鳴器長休息時間（0.7秒，周期結束前）
-                static bool buzzer_state = false; // 當前蜂鳴器狀態（true=響，false=停）
-                static int buzzer_pulse_count = 0; // 蜂鳴器脈衝計數（0=第一聲，1=短休息，2=第二聲，3=長休息）
-                static Timer buzzer_timer;        // 蜂鳴器狀態切換計時器
-                static bool buzzer_timer_started = false; // 計時器是否已啟動
-                const int motor_pulse_ms = 100;   // 馬達單次脈衝時間（0.1秒）
-                const int motor_rest_ms = 100;     // 馬達休息時間（0.1秒）
-                static Timer motor_timer;          // 馬達計時器
-                static bool motor_triggered = false; // 馬達是否已觸發
-                static bool motor_timer_started = false; // 馬達計時器是否已啟動
-                static int motor_pulse_count = 0;  // 馬達脈衝計數（0=第一次響，1=休息，2=第二次響）
-                const int motor_cooldown_ms = 5000; // 馬達冷卻期（5秒），避免連續觸發
-                static Timer motor_cooldown_timer; // 馬達冷卻計時器
-                static bool motor_in_cooldown = false; // 馬達是否在冷卻期
-
-                // 偵測高低差：距離「變大」才觸發
-                bool hit = (echo_us > 0) && (distance_comp_rel > safety_margin_cm);
-                if (hit) {
-                    if (++hit_count >= hit_need) {
-                        // 首次觸發時啟動蜂鳴器計時器
-                        if (!buzzer_timer_started) {
-                            buzzer_timer.start();
-                            buzzer_timer.reset();
-                            buzzer_timer_started = true;
-                            buzzer_state = true;  // 開始時先響第一聲
-                            buzzer_pulse_count = 0;  // 從第一聲開始
-                            buzzer = 1;
-                            
-                            // 馬達獨立觸發：檢查是否在冷卻期
-                            if (!motor_in_cooldown) {
-                                // 不在冷卻期，可以觸發馬達
-                                if (!motor_triggered) {
-                                    motor = 1;  // 第一次響
-                                    motor_pulse_count = 0;  // 從第一次響開始
-                                    motor_timer.start();
-                                    motor_timer.reset();
-                                    motor_timer_started = true;
-                                    motor_triggered = true;
-                                    
-                                    // 啟動冷卻期計時器
-                                    motor_cooldown_timer.start();
-                                    motor_cooldown_timer.reset();
-                                    motor_in_cooldown = true;
-                                }
-                            }
-                        } else {
-                            // 檢查蜂鳴器是否需要切換狀態（響0.1秒 → 停0.1秒 → 響0.1秒 → 停0.7秒，周期1秒）
-                            int elapsed_ms = buzzer_timer.read_ms();
-                            
-                            if (buzzer_pulse_count == 0) {
-                                // 第一聲：響0.1秒
-                                buzzer = 1;
-                                if (elapsed_ms >= buzzer_pulse_ms) {
-                                    buzzer_pulse_count = 1;  // 切換到短休息
-                                    buzzer = 0;
-                                    buzzer_timer.reset();
-                                    buzzer_timer.start();
-                                }
-                            } else if (buzzer_pulse_count == 1) {
-                                // 短休息：停0.1秒（兩聲之間）
-                                buzzer = 0;
-                                if (elapsed_ms >= buzzer_short_rest_ms) {
-                                    buzzer_pulse_count = 2;  // 切換到第二聲
-                                    buzzer = 1;
-                                    buzzer_timer.reset();
-                                    buzzer_timer.start();
-                                }
-                            } else if (buzzer_pulse_count == 2) {
-                                // 第二聲：響0.1秒
-                                buzzer = 1;
-                                if (elapsed_ms >= buzzer_pulse_ms) {
-                                    buzzer_pulse_count = 3;  // 切換到長休息
-                                    buzzer = 0;
-                                    buzzer_timer.reset();
-                                    buzzer_timer.start();
-                                }
-                            } else if (buzzer_pulse_count == 3) {
-                                // 長休息：停0.7秒（完成一個周期，回到第一聲）
-                                buzzer = 0;
-                                if (elapsed_ms >= buzzer_long_rest_ms) {
-                                    buzzer_pulse_count = 0;  // 循環回到第一聲
-                                    buzzer = 1;
-                                    buzzer_timer.reset();
-                                    buzzer_timer.start();
-                                }
-                            }
-                        }
-                    }
-                } else {
-                    // 沒有檢測到障礙物，重置所有狀態
-                    hit_count = 0;
-                    buzzer = 0;
-                    motor = 0;
-                    buzzer_state = false;
-                    buzzer_pulse_count = 0;
-                    buzzer_timer.stop();
-                    buzzer_timer.reset();
-                    buzzer_timer_started = false;
-                    motor_timer.stop();
-                    motor_timer.reset();
-                    motor_timer_started = false;
-                    motor_triggered = false;
-                    motor_pulse_count = 0;
-                    // 注意：冷卻期計時器繼續運行，直到時間到
-                }
-                
-                // 檢查馬達脈衝序列：響0.1秒 → 休息0.1秒 → 再響0.1秒
-                if (motor_timer_started) {
-                    int elapsed_ms = motor_timer.read_ms();
-                    
-                    if (motor_pulse_count == 0) {
-                        // 第一次響：0.1秒
-                        motor = 1;
-                        if (elapsed_ms >= motor_pulse_ms) {
-                            motor_pulse_count = 1;  // 切換到休息
-                            motor = 0;
-                            motor_timer.reset();
-                            motor_timer.start();
-                        }
-                    } else if (motor_pulse_count == 1) {
-                        // 休息：0.1秒
-                        motor = 0;
-                        if (elapsed_ms >= motor_rest_ms) {
-                            motor_pulse_count = 2;  // 切換到第二次響
-                            motor = 1;
-                            motor_timer.reset();
-                            motor_timer.start();
-                        }
-                    } else if (motor_pulse_count == 2) {
-                        // 第二次響：0.1秒
-                        motor = 1;
-                        if (elapsed_ms >= motor_pulse_ms) {
-                            motor = 0;
-                            motor_timer.stop();
-                            motor_timer.reset();
-                            motor_timer_started = false;
-                            motor_pulse_count = 0;
-                            // 完成脈衝序列，在冷卻期內不再開啟
-                        }
-                    }
-                }
-                
-                // 檢查冷卻期是否結束
-                if (motor_in_cooldown) {
-                    if (motor_cooldown_timer.read_ms() >= motor_cooldown_ms) {
-                        motor_in_cooldown = false;
-                        motor_cooldown_timer.stop();
-                        motor_cooldown_timer.reset();
-                        // 冷卻期結束，如果障礙物消失，重置觸發標記
-                        if (!hit) {
-                            motor_triggered = false;
-                        }
-                    }
-                }
-
-                pc.printf("MPU ax:%d ay:%d az:%d gx:%d gy:%d gz:%d roll:%.2f pitch:%.2f pitch_rel:%.2f\r\n",
-                          ax, ay, az, gx, gy, gz, roll, pitch, pitch_rel);
-                pc.printf("distance_comp: %.2f cm distance_rel: %.2f cm distance_comp_rel: %.2f cm\r\n",
-                          distance_comp, distance_rel, distance_comp_rel);
-            } else {
-                pc.printf("MPU read fail\r\n");
-                if (calibrate) {
-                    calibrate = false;
-                    pc.printf("Calibrated: PB12 pressed but MPU read fail\r\n");
-                }
-            }
+        if (cmd_parser.type == FRAME_CMD_TIME_SYNC && cmd_parser.len == 4) {
+            // 時鐘同步：收到時間（解析完成）與回覆時間，主機端以來回時間估計時鐘偏移
+            uint32_t rx_us = us_ticker_read();
+            uint8_t buf[FRAME_MAX_LEN];
+            send_frame(buf, encode_sync_frame(get_u32(cmd_parser.payload), SYNC_SOURCE_STM32, rx_us,
+                                              us_ticker_read(), buf));
+            continue;
+        }
+        if (!param_handle_command(params, PARAM_COUNT, cmd_parser.type, cmd_parser.payload, cmd_parser.len,
+                                  &send_frame, param_dump)) {
+            unknown_commands++;
+            tx_printf("Command: unknown type 0x%02X (%lu)\r\n", cmd_parser.type, (unsigned long)unknown_commands);
         }
+    }
+    if (param_dump_step(param_dump, params, PARAM_COUNT, tx_queue.space(), &send_frame)) {
+        sched.release_at(command_task, now_ms() + param_dump_retry_ms);
+    }
+}
+
+// 目前的警示參數（參數表可隨時修改，每次評估時讀取）
+AlertConfig alert_config() {
+    AlertConfig c;
+    c.safety_margin_cm = safety_margin_cm;
+    c.forward_obstacle_cm = forward_obstacle_cm;
+    c.urgency_span_cm = urgency_span_cm;
+    c.hit_need = hit_need;
+    c.hit_need_confident = hit_need_confident;
+    c.motor_cooldown_ms = (uint32_t)motor_cooldown_ms;
+    return c;
+}
+
+// 目前角速度大小（dps，取各軸最大值），作為距離濾波的過程雜訊依據
+float motion_dps() {
+    if (!imu_valid) return 0.0f;
+    float m = fabsf(gx - ori.gyro_bias[0]);
+    if (fabsf(gy - ori.gyro_bias[1]) > m) m = fabsf(gy - ori.gyro_bias[1]);
+    if (fabsf(gz - ori.gyro_bias[2]) > m) m = fabsf(gz - ori.gyro_bias[2]);
+    return m / GYRO_LSB_PER_DPS;
+}
+
+// 通道 ch 的新距離量測：以最新的傾斜角補償地面距離，依距離向量評估是否觸發警示（MPU 無效時不評估）
+void alert_evaluate(int ch) {
+    if (!imu_valid) return;
+
+    float cos_pitch = tilt_cos(pitch * DEG_TO_RAD);
+    const RangeChannel &ground = ranges[0];
+    distance_comp = ground.filt_cm * cos_pitch;  // 補償傾斜
+    distance_rel = ground.filt_cm - zero_distance_cm;
+    distance_comp_rel = distance_comp - zero_distance_cm; // 以校準零點作為基準
+
+    uint8_t act = alert_step(alert, alert_config(), ranges, RANGE_CHANNELS, ch, cos_pitch, zero_distance_cm,
+                             DISTANCE_FILTER, pattern_active(buzzer_ch), now_ms());
+    if (act & ALERT_ACT_WAKE) {
+        power_request_wake();
+        alert_set_urgency(alert.urgency);
+    }
+    if (act & ALERT_ACT_BUZZER) pattern_play(buzzer_ch, buzzer_alert);
+    if (act & ALERT_ACT_MOTOR) pattern_play(motor_ch, motor_alert);
+    if (act & ALERT_ACT_STOP) {
+        pattern_stop(buzzer_ch);
+        pattern_stop(motor_ch);
+    }
+}
+
+// FIFO 水位（中斷內呼叫）：喚醒主迴圈讀取整批樣本
+void imu_watermark_isr() {
+    loop_events.set(EVT_IMU_FIFO);
+}
+
+#if POWER_ADAPTIVE
+// 靜止模式下 MPU6050 偵測到動作（中斷內呼叫）
+void imu_motion_isr() {
+    power_wake = true;
+    loop_events.set(EVT_IMU_MOTION);
+}
+
+// 樣本是否靜止：各軸角速度（扣除零偏）與加速度大小都接近靜止值
+bool sample_still(const ImuSample &s) {
+    const float g_lim = still_gyro_dps * GYRO_LSB_PER_DPS;
+    if (fabsf(s.gx - ori.gyro_bias[0]) > g_lim) return false;
+    if (fabsf(s.gy - ori.gyro_bias[1]) > g_lim) return false;
+    if (fabsf(s.gz - ori.gyro_bias[2]) > g_lim) return false;
+    float a2 = ((float)s.ax * s.ax + (float)s.ay * s.ay + (float)s.az * s.az) / (ACCEL_LSB_PER_G * ACCEL_LSB_PER_G);
+    return fabsf(a2 - 1.0f) < 2.0f * still_accel_g;   // |a|^2 - 1 約等於 2(|a| - 1)
+}
+
+void enter_stationary() {
+    bool ok = mpu_motion_wake_enable(motion_threshold, motion_duration_ms, stationary_imu_rate_hz,
+                                     &imu_motion_isr);
+    sched.set_period(imu_task, stationary_imu_period_ms, stationary_imu_period_ms / 2);
+    sched.set_period(alert_task, stationary_slow_period_ms, stationary_slow_period_ms);
+    range_interval_ms = stationary_range_interval_ms;
+    pattern_stop(led_ch);   // 心跳燈的 Timeout 會鎖住 deep sleep
+    alert_output_suspend(); // PwmOut 同樣鎖住 deep sleep（警示 / 提示音結束後才會進入靜止模式）
+    uart_rx_enable(false);  // RX 中斷同樣鎖住 deep sleep；靜止期間的指令不會收到，主機未收到回覆時需重送
+    power_wake = false;
+    power_set_mode(POWER_STATIONARY, now_ms());
+    tx_printf("Power: stationary (motion wake %s, deep sleep %s)\r\n", ok ? "OK" : "FAIL",
+              power_deep_sleep_allowed() ? "allowed" : "locked");
+}
+
+void enter_active() {
+    mpu_motion_wake_disable();
+    sched.set_period(imu_task, loop_delay_ms, loop_delay_ms / 2);
+    sched.set_period(alert_task, fast_period_ms, fast_period_ms);
+    range_interval_ms = range_min_interval_ms;
+    alert_output_resume();
+    pattern_play(led_ch, heartbeat);
+    uart_rx_enable(true);
+    power_wake = false;
+    still_since_ms = now_ms();
+    power_set_mode(POWER_ACTIVE, now_ms());
+    tx_printf("Power: active\r\n");
+}
+
+// 省電模式切換；切換會做阻塞 I2C 設定寫入，非阻塞讀取進行中時不切換，留到下一次 IMU 任務
+void power_update() {
+#if IMU_ASYNC_I2C
+    if (!mpu_async_idle()) return;
+#endif
+    uint32_t now = now_ms();
+    if (power_mode() == POWER_ACTIVE) {
+        bool alerting = alert.hit_count > 0 || pattern_active(buzzer_ch) || pattern_active(motor_ch);
+        if (alerting || calibrate) {
+            still_since_ms = now;
+            return;
+        }
+        if (now - still_since_ms >= (uint32_t)stationary_enter_ms) enter_stationary();
+    } else if (power_wake) {
+        enter_active();
+    }
+}
+#endif
+
+#if IMU_ASYNC_I2C
+// I2C 傳輸完成或錯誤（中斷內呼叫）
+void imu_i2c_isr() {
+    loop_events.set(EVT_IMU_I2C);
+}
+#endif
+
+// 套用校準結果（按鈕校準或開機載入）
+void calib_apply(const CalibData &cd) {
+    zero_pitch_deg = cd.zero_pitch_deg;
+    zero_distance_cm = cd.zero_distance_cm;
+    for (int i = 0; i < 3; i++) ori.gyro_bias[i] = cd.gyro_bias[i];
+}
+
+// 校準進行中：樣本足夠或逾時後判定結果，成功時套用，並交給 calib_save 任務寫入 Flash
+void calib_update() {
+    CalibData cd;
+    CalibStatus st = calib_check(calib_acc, calib_limits, now_ms(), cd);
+    if (st == CALIB_COLLECTING) return;
+    calibrate = false;
+    if (st != CALIB_OK) {
+        pattern_play(buzzer_ch, calib_fail_beep);
+        send_event(EVENT_CALIB_REJECTED);
+        tx_printf("Calibration rejected (%s): pitch sd %.2f deg n=%lu, distance sd %.2f cm n=%lu\r\n",
+                  CALIB_STATUS_NAMES[st], running_stat_sd(calib_acc.pitch), (unsigned long)calib_acc.pitch.n,
+                  running_stat_sd(calib_acc.distance), (unsigned long)calib_acc.distance.n);
+        return;
+    }
+    calib_apply(cd);
+    calibrated_pending = true;
+    send_event(EVENT_CALIBRATED);
+    calib_unsaved = cd;
+    calib_save_pending = true;
+    sched.release_at(calib_save_task, now_ms());
+    tx_printf("Calibrated: zero_pitch=%.2f deg, zero_distance=%.2f cm (%u samples)\r\n",
+              zero_pitch_deg, zero_distance_cm, cd.samples);
+    tx_printf("Calibration gyro bias: %.1f %.1f %.1f LSB\r\n",
+              cd.gyro_bias[0], cd.gyro_bias[1], cd.gyro_bias[2]);
+}
+
+// 校準結果寫入 Flash（最低優先）：寫入 / TDBStore 整理磁區時 CPU 與中斷都會停住，
+// 因此只在沒有警示與節奏播放時進行，否則稍後再試
+void task_calib_save() {
+    if (!calib_save_pending) return;
+    if (alert.hit_count > 0 || alert.active || pattern_active(buzzer_ch) || pattern_active(motor_ch)) {
+        sched.release_at(calib_save_task, now_ms() + calib_save_retry_ms);
+        return;
+    }
+    calib_save_pending = false;
+    bool saved = calib_save(calib_unsaved);
+    tx_printf("Calibration %s\r\n", saved ? "saved" : "not saved");
+}
+
+// IMU：讀 MPU6050、計算傾斜角並處理校準
+void task_imu() {
+    if (!mpu_ok) {
+        imu_valid = false;
         // 若 MPU 未就緒，但按鈕被按下，仍傳送事件
-        if (!mpu_ok && calibrate) {
-            pc.printf("[DEBUG] Calibrate flag detected but MPU not ready\r\n");
+        if (calibrate) {
+            tx_printf("[DEBUG] Calibrate flag detected but MPU not ready\r\n");
+            calibrate = false;
+            tx_printf("Calibrated: PB12 pressed (MPU not ready)\r\n");
+        }
+        return;
+    }
+
+    ImuSample s;
+    uint32_t prof_start = prof_begin();
+#if IMU_ASYNC_I2C
+    // 非阻塞讀取：傳輸進行中先返回，完成時 I2C 中斷喚醒主迴圈再次釋放本任務
+#if IMU_FIFO_MODE
+    int drained = 0;
+    MpuAsyncStatus st = mpu_fifo_drain_step(now_ms(), drained);
+#else
+    MpuAsyncStatus st = mpu_read_sample_step(s, now_ms());
+#endif
+    prof_end(PROF_IMU_READ, prof_start);
+    if (st == MPU_ASYNC_PENDING) return;
+    bool read_ok = (st == MPU_ASYNC_DONE);
+#elif IMU_FIFO_MODE
+    bool read_ok = mpu_fifo_drain(now_ms()) >= 0;
+    prof_end(PROF_IMU_READ, prof_start);
+#else
+    bool read_ok = mpu_read_sample(s, now_ms());
+    prof_end(PROF_IMU_READ, prof_start);
+#endif
+
+#if IMU_FIFO_MODE
+    // 一次讀出 FIFO 內整批樣本，每一筆都送進姿態濾波（以 IMU 取樣率融合）
+    bool got = false;
+    ImuSample next;
+    prof_start = prof_begin();
+    while (imu_ring_pop(next)) {
+        s = next;
+        got = true;
+        imu_samples++;
+        orientation_update(ori, s.ax, s.ay, s.az, s.gx, s.gy, s.gz, s.t_ms);
+        if (calibrate) calib_add_imu(calib_acc, ori.pitch_deg, s.gx, s.gy, s.gz);
+#if POWER_ADAPTIVE
+        if (!sample_still(s)) {
+            still_since_ms = s.t_ms;
+            if (power_mode() == POWER_STATIONARY) power_wake = true;   // 動作中斷的備援
+        }
+#endif
+    }
+    if (got) prof_end(PROF_FUSION, prof_start);
+#if POWER_ADAPTIVE
+    power_update();
+#endif
+#else
+    bool got = read_ok;
+    if (got) {
+        imu_samples++;
+        prof_start = prof_begin();
+        orientation_update(ori, s.ax, s.ay, s.az, s.gx, s.gy, s.gz, s.t_ms);
+        prof_end(PROF_FUSION, prof_start);
+        if (calibrate) calib_add_imu(calib_acc, ori.pitch_deg, s.gx, s.gy, s.gz);
+    }
+#endif
+    if (!read_ok) {
+        imu_valid = false;
+#if !TELEMETRY_BINARY && !IMU_ASYNC_I2C
+        tx_printf("MPU read fail\r\n");   // 非阻塞模式的匯流排錯誤只計數，由遙測回報
+#endif
+        if (calibrate) {
             calibrate = false;
-            pc.printf("Calibrated: PB12 pressed (MPU not ready)\r\n");
+            tx_printf("Calibrated: PB12 pressed but MPU read fail\r\n");
+        }
+        return;
+    }
+    if (!got) return;   // FIFO 尚無新樣本，沿用上一筆
+
+    imu_valid = true;
+    ax = s.ax; ay = s.ay; az = s.az;
+    gx = s.gx; gy = s.gy; gz = s.gz;
+    // 手杖傾斜角（俯仰/翻滾），單位度數；擺動時由陀螺儀維持，不受線性加速度干擾
+    roll = ori.roll_deg;
+    pitch = ori.pitch_deg;
+
+    // 按鈕校準：樣本足夠後以平均值作為零點
+    if (calibrate) calib_update();
+
+    pitch_rel = pitch - zero_pitch_deg;
+}
+
+// 超音波：事件驅動測距，多感測器時輪流觸發
+// 觸發後由回波完成中斷（或逾時）釋放本任務收下結果，並在間隔到達後立即觸發下一個感測器
+// 近距離障礙物回波很快，量測率因此不再受固定等待時間限制
+void task_range() {
+    ProfScope prof(PROF_RANGING);
+    uint32_t now = now_ms();
+
+    // 收下樣本環內的回波；通道或觸發序號不符的是上一次逾時後才到的回波
+    bool done = false;
+    uint32_t width_us = 0;
+    uint32_t fall_us = 0;
+    EchoEvent ev;
+    while (echo_ring.pop(ev)) {
+        if (range_busy && !done && ev.channel == range_active && ev.ping == ping_seq) {
+            done = true;
+            width_us = ev.width_us;
+            fall_us = ev.t_us;
+        } else {
+            echo_stale++;
+        }
+    }
+
+    if (range_busy) {
+        RangeChannel &ch = ranges[range_active];
+        if (!done && !time_reached(now, ch.trigger_ms + range_timeout_ms)) {
+            // 提早被喚醒（例如其他事件），繼續等待回波或逾時
+            sched.release_at(range_task, ch.trigger_ms + range_timeout_ms);
+            return;
+        }
+        range_busy = false;
+        range_done_ms = now;
+        sleep_manager_unlock_deep_sleep();
+        uint32_t us = done ? width_us : 0;
+        if (us > range_max_echo_us) us = 0;
+        if (!done) ch.timeouts++;
+        ch.capture_us = done ? fall_us : us_ticker_read();
+        range_channel_record(ch, us, motion_dps(), now);
+        if (calibrate && range_active == 0 && us > 0 && ch.filt_cm >= 0.0f) calib_add_distance(calib_acc, ch.filt_cm);
+        alert_evaluate(range_active);
+        telemetry_events_poll();
+    }
+
+    // 輪到下一個感測器（單一感測器時即為自己）
+    int next = (range_active + 1) % RANGE_CHANNELS;
+    uint32_t next_ms = range_next_due(ranges[next], range_interval_ms, range_done_ms,
+                                      RANGE_CHANNELS > 1 ? range_stagger_ms : 0);
+    if (!time_reached(now, next_ms)) {
+        sched.release_at(range_task, next_ms);
+        return;
+    }
+    if (echo_pin_high(next)) {
+        // Echo 仍為高電位（上一次的脈衝尚未結束），感測器不會接受新的觸發
+        sched.release_at(range_task, now + 2);
+        return;
+    }
+
+    range_active = next;
+    ping_seq = ping_seq + 1;
+    *trig_pins[next] = 1;
+    wait_us(10);
+    *trig_pins[next] = 0;
+    range_busy = true;
+    sleep_manager_lock_deep_sleep();   // Stop 模式下 TIM2 停止計數，量測期間只允許 Sleep
+    ranges[next].trigger_ms = now;
+    sched.release_at(range_task, now + range_timeout_ms);  // 逾時保護；回波完成時會提早釋放
+}
+
+// 警示狀態機：蜂鳴器/馬達節奏由 pattern_engine 推進，這裡只處理馬達冷卻期
+void task_alert() {
+    ProfScope prof(PROF_ALERT_FSM);
+
+    alert_cooldown_poll(alert, alert_config(), now_ms());
+    telemetry_events_poll();
+}
+
+// 遙測：以 target_fps 送出最新的取樣（內容依 telemetry_level），並回報輸出佇列溢位與排程 missed 次數
+void task_telemetry() {
+    static uint16_t frame_seq = 0;               // 遙測訊框序號
+    static uint32_t tx_overflow_reported = 0;    // 上次回報的輸出佇列溢位次數
+    static uint32_t tx_report_ms = 0;
+    static uint32_t missed_reported = 0;         // 上次回報的 missed 總數
+    static uint32_t sched_report_ms = 0;
+    static uint32_t prof_report_ms = 0;
+    static uint32_t power_report_ms = 0;
+
+    uint32_t prof_start = prof_begin();
+#if TELEMETRY_BINARY
+    if (telemetry_level >= TELEMETRY_SAMPLES) {
+        SampleFrame sample = {};
+        sample.seq = frame_seq++;
+        sample.t_ms = now_ms();
+        sample.echo_us = ranges[0].echo_us > 0xFFFF ? 0xFFFF : (uint16_t)ranges[0].echo_us;
+        if (imu_valid) {
+            sample.ax = ax; sample.ay = ay; sample.az = az;
+            sample.gx = gx; sample.gy = gy; sample.gz = gz;
+        }
+        sample.flags = sample_flags();
+        uint8_t frame_buf[FRAME_MAX_LEN];
+        size_t frame_len;
+        if (telemetry_delta) {
+            const DeltaPolicy pol = {(uint32_t)keyframe_ms, (uint16_t)imu_deadband_lsb, (uint16_t)echo_deadband_us};
+            frame_len = delta_encode(delta_enc, sample, pol, frame_buf);   // 0 = 沒有變化
+        } else {
+            frame_len = encode_sample_frame(sample, frame_buf);
         }
-        
-        // 檢查按鈕狀態（用於調試）
-        static int btn_check_counter = 0;
-        if (++btn_check_counter >= 20) {  // 每20次循環檢查一次（約1秒）
-            btn_check_counter = 0;
-            // 讀取按鈕狀態（PullUp模式下，按下為0，未按下為1）
-            // 注意：InterruptIn 不直接支持讀取，但可以通過其他方式檢查
+        if (frame_len > 0) send_frame(frame_buf, frame_len);
+        static int trace_count = 0;
+        if (frame_len > 0 && trace_every > 0 && ++trace_count >= trace_every) {
+            trace_count = 0;
+            send_frame(frame_buf, encode_trace_frame(sample.seq, ranges[0].capture_us, us_ticker_read(), frame_buf));
         }
+    }
+#if RANGE_CHANNELS > 1
+    if (telemetry_level >= TELEMETRY_FULL) {
+        uint8_t frame_buf[FRAME_MAX_LEN];
+        uint16_t echo_vec[RANGE_CHANNELS];
+        for (int i = 0; i < RANGE_CHANNELS; i++) {
+            echo_vec[i] = ranges[i].echo_us > 0xFFFF ? 0xFFFF : (uint16_t)ranges[i].echo_us;
+        }
+        send_frame(frame_buf, encode_ranges_frame(echo_vec, RANGE_CHANNELS, frame_buf));
+    }
+#endif
+#else
+    (void)frame_seq;
+    if (telemetry_level >= TELEMETRY_SAMPLES) {
+        tx_printf("distance: %.2f cm\r\n", ranges[0].distance_cm);
+    }
+    for (int i = 1; i < RANGE_CHANNELS && telemetry_level >= TELEMETRY_FULL; i++) {
+        tx_printf("range %s: %.2f cm filt: %.2f cm\r\n", ranges[i].name, ranges[i].distance_cm, ranges[i].filt_cm);
+    }
+    if (imu_valid && telemetry_level >= TELEMETRY_SAMPLES) {
+        tx_printf("MPU ax:%d ay:%d az:%d gx:%d gy:%d gz:%d roll:%.2f pitch:%.2f pitch_rel:%.2f\r\n",
+                  ax, ay, az, gx, gy, gz, roll, pitch, pitch_rel);
+        tx_printf("distance_comp: %.2f cm distance_rel: %.2f cm distance_comp_rel: %.2f cm distance_filt: %.2f cm\r\n",
+                  distance_comp, distance_rel, distance_comp_rel, ranges[0].filt_cm);
+    }
+#endif
+    calibrated_pending = false;
+    prof_end(PROF_TELEMETRY, prof_start);
 
-        // 控制數據採集速度：5-10 FPS（每秒5-10次）
-        // 計算延遲時間：10 FPS = 100ms, 5 FPS = 200ms
-        // 使用中間值約 7.5 FPS = 133ms
-        const int target_fps = 8;  // 目標 8 FPS
-        const int loop_delay_ms = 1000 / target_fps;  // 約 125ms
-        
-        // 心跳閃燈：閃0.1秒 暗0.1秒 閃0.1秒 暗0.1秒 閃0.3秒 暗0.3秒（循環）
-        static Timer led_timer;
-        static int led_state = 0;  // 0=閃0.1, 1=暗0.1, 2=閃0.1, 3=暗0.1, 4=閃0.3, 5=暗0.3
-        static bool led_timer_started = false;
-        
-        if (!led_timer_started) {
-            led_timer.start();
-            led_timer_started = true;
-            led_hb = 0;  // 開始時亮（PC13低電位亮）
+#if CYCLE_PROFILE
+    // 週期統計（每 prof_report_period_ms 一次），送出後重新開始統計視窗
+    if (now_ms() - prof_report_ms >= prof_report_period_ms && telemetry_level >= TELEMETRY_FULL) {
+        prof_report_ms = now_ms();
+#if TELEMETRY_BINARY
+        uint8_t prof_buf[FRAME_MAX_LEN];
+        send_frame(prof_buf, encode_profile_frame(prof_buf));
+#else
+        for (int i = 0; i < PROF_SECTION_COUNT; i++) {
+            uint32_t count, min_c, avg_c, max_c;
+            prof_summary(i, count, min_c, avg_c, max_c);
+            tx_printf("Prof %s: n=%lu min=%lu avg=%lu max=%lu cycles\r\n", PROF_SECTION_NAMES[i],
+                      (unsigned long)count, (unsigned long)min_c, (unsigned long)avg_c, (unsigned long)max_c);
         }
-        
-        int elapsed_ms = led_timer.read_ms();
-        int state_duration_ms = 0;
-        bool should_be_on = false;
-        
-        switch (led_state) {
-            case 0: // 閃0.1秒
-                state_duration_ms = 100;
-                should_be_on = true;
-                break;
-            case 1: // 暗0.1秒
-                state_duration_ms = 100;
-                should_be_on = false;
-                break;
-            case 2: // 閃0.1秒
-                state_duration_ms = 100;
-                should_be_on = true;
-                break;
-            case 3: // 暗0.1秒
-                state_duration_ms = 100;
-                should_be_on = false;
-                break;
-            case 4: // 閃0.3秒
-                state_duration_ms = 300;
-                should_be_on = true;
-                break;
-            case 5: // 暗0.3秒
-                state_duration_ms = 300;
-                should_be_on = false;
-                break;
+#endif
+        prof_reset();
+    }
+#else
+    (void)prof_report_ms;
+#endif
+
+    // 各模式停留時間、睡眠比例與估計電流（POWER_*_MA 常數 x 實測睡眠比例，並非量測值；見 power_manager.h）
+    if (now_ms() - power_report_ms >= (uint32_t)power_report_period_ms) {
+        power_report_ms = now_ms();
+        for (int m = 0; m < POWER_MODE_COUNT; m++) {
+            PowerModeStats ps;
+            power_stats((PowerMode)m, now_ms(), ps);
+            if (ps.time_ms == 0) continue;
+            tx_printf("Power %s: %lu s x%lu, sleep %lu%%, stop %lu%%, est %.1f mA (model)\r\n",
+                      POWER_MODE_NAMES[m], (unsigned long)(ps.time_ms / 1000), (unsigned long)ps.entries,
+                      (unsigned long)(ps.sleep_us / (ps.time_ms * 10)),
+                      (unsigned long)(ps.deep_sleep_us / (ps.time_ms * 10)),
+                      power_estimate_ma((PowerMode)m, now_ms()));
+        }
+        if (telemetry_delta) {
+            tx_printf("Telemetry delta: %lu key, %lu delta, %lu skipped frames\r\n", (unsigned long)delta_enc.keyframes,
+                      (unsigned long)delta_enc.deltas, (unsigned long)delta_enc.skipped);
         }
-        
-        // 設置LED狀態（PC13低電位亮，所以應該取反）
-        led_hb = should_be_on ? 0 : 1;
-        
-        // 檢查是否需要切換到下一個狀態
-        if (elapsed_ms >= state_duration_ms) {
-            led_state = (led_state + 1) % 6;  // 循環 0-5
-            led_timer.reset();
-            led_timer.start();
+    }
+
+    // 輸出佇列有溢位時回報（每秒最多一行，避免回報本身再造成溢位）
+    if (tx_queue.overflow_count() != tx_overflow_reported &&
+        now_ms() - tx_report_ms >= 1000) {
+        tx_report_ms = now_ms();
+        tx_overflow_reported = tx_queue.overflow_count();
+        tx_printf("TX overflow: %lu events, %lu bytes dropped\r\n",
+                  (unsigned long)tx_overflow_reported, (unsigned long)tx_queue.dropped_bytes());
+    }
+
+    // 樣本環捨棄或逾時回波有變化時回報（每 5 秒最多一行）
+    static uint32_t ring_drops_reported = 0;
+    static uint32_t ring_report_ms = 0;
+#if IMU_FIFO_MODE
+    uint32_t imu_dropped = imu_ring_dropped();
+#else
+    uint32_t imu_dropped = 0;
+#endif
+    uint32_t ring_drops = echo_ring.dropped() + imu_dropped + button_ring.dropped() + echo_stale;
+    if (ring_drops != ring_drops_reported && now_ms() - ring_report_ms >= 5000) {
+        ring_report_ms = now_ms();
+        ring_drops_reported = ring_drops;
+        tx_printf("Ring drops: echo=%lu imu=%lu button=%lu stale_echo=%lu\r\n",
+                  (unsigned long)echo_ring.dropped(), (unsigned long)imu_dropped,
+                  (unsigned long)button_ring.dropped(), (unsigned long)echo_stale);
+    }
+
+#if IMU_ASYNC_I2C
+    // I2C 匯流排錯誤只計數，有變化時回報（每 5 秒最多一行）
+    static uint32_t i2c_errors_reported = 0;
+    static uint32_t i2c_report_ms = 0;
+    if (mpu_bus_errors() != i2c_errors_reported && now_ms() - i2c_report_ms >= 5000) {
+        i2c_report_ms = now_ms();
+        i2c_errors_reported = mpu_bus_errors();
+        tx_printf("I2C errors: %lu\r\n", (unsigned long)i2c_errors_reported);
+    }
+#endif
+
+    // 有任務錯過截止時間時回報各任務 missed 次數（每 5 秒最多一行）
+    uint32_t missed_total = 0;
+    for (int i = 0; i < sched.count(); i++) missed_total += sched.task(i).missed;
+    if (missed_total != missed_reported && now_ms() - sched_report_ms >= 5000) {
+        sched_report_ms = now_ms();
+        missed_reported = missed_total;
+        char line[120];
+        int n = snprintf(line, sizeof(line), "Sched missed:");
+        for (int i = 0; i < sched.count() && n < (int)sizeof(line); i++) {
+            n += snprintf(line + n, sizeof(line) - n, " %s=%lu", sched.task(i).name,
+                          (unsigned long)sched.task(i).missed);
         }
+        tx_printf("%s\r\n", line);
     }
 }
 
+#if TILT_MATH_BENCH
+// 開機時跑一次傾斜計算微基準，輸出各實作每個 frame 的週期數與相對 libm 的誤差
+void run_tilt_bench() {
+    static TiltBenchInput in;
+    tilt_bench_input(in);
+    cyccnt_init();
+    TiltBenchResult r;
+    r = tilt_bench_run<tilt_libm::atan2, tilt_libm::sqrt, tilt_libm::cos>(in);
+    tx_printf("Bench tilt libm: %lu cycles/frame\r\n", (unsigned long)r.cycles_per_frame);
+    r = tilt_bench_run<tilt_fpu::atan2, tilt_fpu::sqrt, tilt_fpu::cos>(in);
+    tx_printf("Bench tilt fpu:  %lu cycles/frame, max err %.4f deg %.3f cm\r\n",
+              (unsigned long)r.cycles_per_frame, r.max_err_deg, r.max_err_cm);
+    r = tilt_bench_run<tilt_q15::atan2, tilt_q15::sqrt, tilt_q15::cos>(in);
+    tx_printf("Bench tilt q15:  %lu cycles/frame, max err %.4f deg %.3f cm\r\n",
+              (unsigned long)r.cycles_per_frame, r.max_err_deg, r.max_err_cm);
+}
+#endif
+
+int main() {
+    prof_init();
+    pc.baud(LINK_BAUD);
+    pc.format(8, SerialBase::None, 1);
+    frame_parser_init(cmd_parser);
+    delta_encoder_init(delta_enc);
+    uart_rx_enable(true);
+    tx_printf("HC-SR04 + MPU6050 demo\r\n");
+    tx_printf("Link: %d baud\r\n", LINK_BAUD);
+    tx_printf("Telemetry mode: %s%s\r\n", TELEMETRY_BINARY ? "binary" : "text",
+              TELEMETRY_BINARY && TELEMETRY_DELTA ? " (delta)" : "");
+    tx_printf("Tilt math backend: %d\r\n", TILT_MATH_BACKEND);
+    uptime.start();
+    power_init(now_ms());
+
+    // 初始化蜂鳴器和馬達為低電平，確保不會有雜音（註冊通道時輸出 0）
+    alert_output_init();
+    buzzer_ch = pattern_channel_add(&buzzer_out);
+    motor_ch = pattern_channel_add(&motor_out);
+    led_ch = pattern_channel_add(&led_out);
+    pattern_play(led_ch, heartbeat);
+    tx_printf("Buzzer and motor initialized to OFF (%s)\r\n", ALERT_PWM ? "PWM" : "on/off");
 
+    // 超音波設定
+    range_channel_init(ranges[0], "ground", RANGE_GROUND);
+#if RANGE_CHANNELS > 1
+    range_channel_init(ranges[1], "forward", RANGE_FORWARD);
+#endif
+    for (int i = 0; i < RANGE_CHANNELS; i++) *trig_pins[i] = 0;
+#if ECHO_CAPTURE_MODE
+    echo_capture_init(RANGE_CHANNELS, &echo_captured);   // PA0/PB10 = TIM2 硬體捕捉，內含下拉
+    tx_printf("Echo: TIM2 input capture, %d sensor(s)\r\n", RANGE_CHANNELS);
+#else
+    for (int i = 0; i < RANGE_CHANNELS; i++) {
+        echo_pins[i]->mode(PullDown);    // 防止 Echo 浮空
+        echo_pins[i]->rise(&echo_rise);
+        echo_pins[i]->fall(&echo_fall);
+    }
+    tx_printf("Echo: InterruptIn + Timer, %d sensor(s)\r\n", RANGE_CHANNELS);
+#endif
+    btn.mode(PullUp);      // 上拉模式：PB12 > 按鈕 > GND（按下為0，未按下為1）
+    btn.fall(&button_edge);
+    btn.rise(&button_edge);
+    tx_printf("Button PB12 initialized (PullUp, EXTI + %d ms debounce)\r\n", button_debounce_ms);
+    tx_printf("Button connection: PB12 > Button > GND\r\n");
+    tx_printf("Button logic: Pressed=0 (GND), Released=1 (PullUp)\r\n");
+
+    // MPU6050 初始化
+    orientation_init(ori);
+    alert_state_init(alert);
+    CalibData stored;
+    if (calib_load(stored)) {
+        calib_apply(stored);
+        tx_printf("Calibration loaded: zero_pitch=%.2f deg, zero_distance=%.2f cm, gyro bias %.1f %.1f %.1f\r\n",
+                  zero_pitch_deg, zero_distance_cm, stored.gyro_bias[0], stored.gyro_bias[1], stored.gyro_bias[2]);
+    } else {
+        tx_printf("Calibration: none stored, press PB12 to calibrate\r\n");
+    }
+    mpu_ok = mpu_init();
+    tx_printf("MPU6050 init: %s\r\n", mpu_ok ? "OK" : "FAIL");
+#if IMU_ASYNC_I2C
+    mpu_async_init(&imu_i2c_isr);
+#endif
+#if IMU_FIFO_MODE
+    if (mpu_ok) {
+        mpu_ok = mpu_fifo_init(imu_rate_hz, imu_watermark, &imu_watermark_isr);
+        tx_printf("MPU6050 FIFO: %s, %u Hz, watermark %d\r\n", mpu_ok ? "OK" : "FAIL",
+                  mpu_fifo_rate_hz(), imu_watermark);
+    }
+#endif
+
+#if TILT_MATH_BENCH
+    run_tilt_bench();
+#endif
+
+    // 任務表（加入順序 = 優先順序）；按鈕、測距、指令、校準寫入為事件任務（週期 0），由中斷、逾時或校準釋放
+    //                         名稱         函式             週期              截止時間
+    button_task = sched.add(   "button",    task_button,     0,                fast_period_ms);
+    range_task = sched.add(    "range",     task_range,      0,                5);
+    imu_task = sched.add(      "imu",       task_imu,        loop_delay_ms,    loop_delay_ms / 2);
+    alert_task = sched.add(    "alert",     task_alert,      fast_period_ms,   fast_period_ms);
+    telemetry_task = sched.add("telemetry", task_telemetry,  loop_delay_ms,    loop_delay_ms / 2, loop_delay_ms / 2);
+    command_task = sched.add(  "command",   task_command,    0,                fast_period_ms);
+    calib_save_task = sched.add("calib_save", task_calib_save, 0,                1000);
+    tx_printf("Scheduler: imu/telemetry %d ms, range min interval %d ms\r\n",
+              loop_delay_ms, range_min_interval_ms);
+    tx_printf("Params: %d tunable (PARAM_GET 0x%02X / PARAM_SET 0x%02X)\r\n", PARAM_COUNT,
+              FRAME_CMD_PARAM_GET, FRAME_CMD_PARAM_SET);
+
+    while (true) {
+        sched.run_due();
+        // 沒有任務到期時交給 RTOS idle（進入 sleep），直到下一個任務釋放或回波中斷喚醒
+        uint32_t idle_ms = sched.ms_until_next();
+        if (idle_ms > 0) {
+            uint32_t flags = loop_events.wait_any(EVT_ECHO_DONE | EVT_IMU_FIFO | EVT_IMU_I2C |
+                                                  EVT_IMU_MOTION | EVT_BUTTON | EVT_COMMAND, idle_ms);
+            if (!(flags & osFlagsError)) {
+                if (flags & EVT_ECHO_DONE) sched.release_at(range_task, now_ms());
+                if (flags & EVT_BUTTON) sched.release_at(button_task, now_ms());
+                if (flags & EVT_COMMAND) sched.release_at(command_task, now_ms());
+                if (flags & (EVT_IMU_FIFO | EVT_IMU_I2C | EVT_IMU_MOTION)) sched.release_at(imu_task, now_ms());
+            }
+        }
+    }
+}
@@ -0,0 +1,111 @@
+// 警示判斷：由距離向量與傾斜角決定何時啟動蜂鳴器 / 馬達，以及馬達冷卻期
+//
+// 不存取硬體：alert_step 回傳要執行的動作（ALERT_ACT_*），由呼叫端交給節奏引擎；
+// 韌體（alert_evaluate / task_alert）與主機端重播模擬（host/replay_sim.cpp）共用同一份邏輯。
+#ifndef ALERT_LOGIC_H
+#define ALERT_LOGIC_H
+
+#include <stdint.h>
+#include "range_array.h"
+
+struct AlertConfig {
+    float safety_margin_cm;     // 地面距離超過零點多少 cm 視為下陷/坑洞
+    float forward_obstacle_cm;  // 前方距離小於此值視為障礙物
+    float urgency_span_cm;      // 超過門檻多少 cm 時急迫度達到最大
+    int hit_need;               // 連續次數
+    int hit_need_confident;     // 距離濾波有把握時的連續次數
+    uint32_t motor_cooldown_ms; // 馬達冷卻期
+};
+
+struct AlertState {
+    int channel_hits[RANGE_CHANNELS];     // 各通道「自己的」新量測連續超過門檻的次數
+    float channel_excess[RANGE_CHANNELS]; // 各通道最近一次量測超過門檻的量（cm）
+    int hit_count;              // 各通道連續次數的最大值（旗標 / 事件 / 省電判斷使用）
+    bool hit;                   // 最近一次評估是否超過門檻
+    bool active;                // 這次警示已啟動蜂鳴器 / 馬達（回到安全時才需要停止）
+    bool motor_triggered;       // 這次警示是否已觸發過馬達
+    bool motor_in_cooldown;
+    uint32_t cooldown_start_ms;
+    float urgency;              // 最近一次超過門檻時的急迫度（0..1）
+};
+
+enum AlertAction {
+    ALERT_ACT_WAKE = 1 << 0,    // 超過門檻：要求離開省電模式，並更新急迫度
+    ALERT_ACT_BUZZER = 1 << 1,  // 蜂鳴器從第一聲開始
+    ALERT_ACT_MOTOR = 1 << 2,   // 觸發馬達一次（同時進入冷卻期）
+    ALERT_ACT_STOP = 1 << 3,    // 警示中回到安全：停止蜂鳴器與馬達（不影響按鈕 / 校準提示音）
+};
+
+inline void alert_state_init(AlertState &s) {
+    for (int i = 0; i < RANGE_CHANNELS; i++) {
+        s.channel_hits[i] = 0;
+        s.channel_excess[i] = -1.0f;
+    }
+    s.hit_count = 0;
+    s.hit = false;
+    s.active = false;
+    s.motor_triggered = false;
+    s.motor_in_cooldown = false;
+    s.cooldown_start_ms = 0;
+    s.urgency = 0.0f;
+}
+
+// 通道 ch 完成一次量測時評估一次：只有這個通道的連續次數前進（其他通道的距離是舊量測，不重複計數），
+// 再合併所有通道；buzzer_active 為蜂鳴器節奏是否仍在播放（播放中不重新開始）
+inline uint8_t alert_step(AlertState &s, const AlertConfig &cfg, const RangeChannel *ranges, int n, int ch,
+                          float cos_pitch, float ground_zero_cm, bool use_confidence,
+                          bool buzzer_active, uint32_t now_ms) {
+    // 地面距離「變大」（高低差）或前方距離過近（障礙物）
+    float e = range_excess_cm(ranges[ch], cos_pitch, ground_zero_cm, cfg.safety_margin_cm, cfg.forward_obstacle_cm);
+    s.channel_excess[ch] = e;
+    if (e > 0.0f) {
+        s.channel_hits[ch]++;
+    } else {
+        s.channel_hits[ch] = 0;
+    }
+
+    // 合併：任一通道超過門檻即為 hit，急迫度取超過門檻最多的通道
+    float excess = -1.0f;
+    s.hit_count = 0;
+    for (int i = 0; i < n; i++) {
+        if (s.channel_hits[i] == 0) continue;
+        if (s.channel_hits[i] > s.hit_count) s.hit_count = s.channel_hits[i];
+        if (s.channel_excess[i] > excess) excess = s.channel_excess[i];
+    }
+    s.hit = s.hit_count > 0;
+    if (!s.hit) {
+        // 沒有檢測到障礙物，重置狀態；冷卻期繼續計時，直到時間到
+        s.motor_triggered = false;
+        if (!s.active) return 0;
+        s.active = false;
+        return ALERT_ACT_STOP;
+    }
+
+    // 超過門檻越多越急迫：音高越高、馬達越強（PWM 模式）
+    s.urgency = excess / cfg.urgency_span_cm;
+    if (s.urgency > 1.0f) s.urgency = 1.0f;
+    uint8_t act = ALERT_ACT_WAKE;
+    // 本次量測的通道首次達到連續次數時啟動警示，之後由節奏引擎推進
+    int need = (use_confidence && distance_filter_confident(ranges[ch].filter)) ? cfg.hit_need_confident : cfg.hit_need;
+    if (s.channel_hits[ch] >= need && !buzzer_active) {
+        act |= ALERT_ACT_BUZZER;
+        s.active = true;
+        // 馬達獨立觸發：不在冷卻期且這次警示尚未觸發過
+        if (!s.motor_in_cooldown && !s.motor_triggered) {
+            act |= ALERT_ACT_MOTOR;
+            s.motor_triggered = true;
+            s.motor_in_cooldown = true;
+            s.cooldown_start_ms = now_ms;
+        }
+    }
+    return act;
+}
+
+// 檢查冷卻期是否結束；結束時若障礙物已消失，重置觸發標記
+inline void alert_cooldown_poll(AlertState &s, const AlertConfig &cfg, uint32_t now_ms) {
+    if (!s.motor_in_cooldown || now_ms - s.cooldown_start_ms < cfg.motor_cooldown_ms) return;
+    s.motor_in_cooldown = false;
+    if (!s.hit) s.motor_triggered = false;
+}
+
+#endif // ALERT_LOGIC_H
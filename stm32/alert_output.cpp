@@ -0,0 +1,140 @@
+#include "mbed.h"
+#include "alert_output.h"
+
+static volatile bool buzzer_on = false;
+static volatile bool motor_on = false;
+
+#if ALERT_PWM
+// PB4 = TIM3_CH1、PB5 = TIM3_CH2：同一個計時器共用週期，
+// 因此馬達 PWM 頻率跟著音高改變（1.5~3.5kHz 對馬達都可用），改週期後需重設馬達工作週期
+static PwmOut buzzer_pwm(PB_4);
+static PwmOut motor_pwm(PB_5);       // 馬達驅動（請經 MOSFET/三極體）
+static uint16_t tone_hz = ALERT_TONE_MIN_HZ;
+static float motor_duty = ALERT_MOTOR_MIN_DUTY;
+static bool pwm_suspended = false;
+
+// 呼叫端需在中斷內或臨界區
+static void apply_outputs() {
+    buzzer_pwm.write(buzzer_on ? 0.5f : 0.0f);
+    motor_pwm.write(motor_on ? motor_duty : 0.0f);
+}
+
+// 呼叫端需在中斷內或臨界區；resume 後重設週期（同一計時器，兩個通道共用）
+static void pwm_resume() {
+    if (!pwm_suspended) return;
+    buzzer_pwm.resume();
+    motor_pwm.resume();
+    buzzer_pwm.period_us(1000000 / tone_hz);
+    pwm_suspended = false;
+}
+
+void alert_output_init() {
+    buzzer_pwm.period_us(1000000 / tone_hz);
+    apply_outputs();
+}
+
+void alert_output_suspend() {
+    core_util_critical_section_enter();
+    if (!pwm_suspended) {
+        buzzer_on = false;
+        motor_on = false;
+        apply_outputs();
+        buzzer_pwm.suspend();
+        motor_pwm.suspend();
+        pwm_suspended = true;
+    }
+    core_util_critical_section_exit();
+}
+
+void alert_output_resume() {
+    core_util_critical_section_enter();
+    if (pwm_suspended) {
+        pwm_resume();
+        apply_outputs();
+    }
+    core_util_critical_section_exit();
+}
+
+void buzzer_out(uint8_t level) {
+    buzzer_on = level != 0;
+    if (pwm_suspended) {
+        if (!buzzer_on) return;
+        pwm_resume();
+        apply_outputs();
+        return;
+    }
+    buzzer_pwm.write(buzzer_on ? 0.5f : 0.0f);
+}
+
+void motor_out(uint8_t level) {
+    motor_on = level != 0;
+    if (pwm_suspended) {
+        if (!motor_on) return;
+        pwm_resume();
+        apply_outputs();
+        return;
+    }
+    motor_pwm.write(motor_on ? motor_duty : 0.0f);
+}
+
+void alert_set_urgency(float urgency) {
+    if (urgency < 0.0f) urgency = 0.0f;
+    if (urgency > 1.0f) urgency = 1.0f;
+    // 音高以 100Hz 為一階，急迫度小幅變動時不重設計時器
+    uint16_t hz = (uint16_t)(ALERT_TONE_MIN_HZ + (ALERT_TONE_MAX_HZ - ALERT_TONE_MIN_HZ) * urgency);
+    hz = (uint16_t)((hz + 50) / 100 * 100);
+    float duty = ALERT_MOTOR_MIN_DUTY + (ALERT_MOTOR_MAX_DUTY - ALERT_MOTOR_MIN_DUTY) * urgency;
+
+    core_util_critical_section_enter();
+    if (pwm_suspended) {
+        // 暫停中只記下設定，resume 時套用
+        tone_hz = hz;
+        motor_duty = duty;
+        core_util_critical_section_exit();
+        return;
+    }
+    if (hz != tone_hz) {
+        tone_hz = hz;
+        buzzer_pwm.period_us(1000000 / tone_hz);
+    }
+    motor_duty = duty;
+    apply_outputs();
+    core_util_critical_section_exit();
+}
+#else
+static DigitalOut buzzer(PB_4);         // 蜂鳴器
+static DigitalOut motor(PB_5);          // 馬達驅動（請經 MOSFET/三極體）
+
+void alert_output_init() {
+    buzzer = 0;
+    motor = 0;
+}
+
+void buzzer_out(uint8_t level) {
+    buzzer_on = level != 0;
+    buzzer = buzzer_on ? 1 : 0;
+}
+
+void motor_out(uint8_t level) {
+    motor_on = level != 0;
+    motor = motor_on ? 1 : 0;
+}
+
+void alert_set_urgency(float urgency) {
+    (void)urgency;
+}
+
+void alert_output_suspend() {
+}
+
+void alert_output_resume() {
+}
+#endif
+
+bool buzzer_is_on() {
+    return buzzer_on;
+}
+
+bool motor_is_on() {
+    return motor_on;
+}
@@ -0,0 +1,38 @@
+// 蜂鳴器（PB4）與馬達（PB5）輸出
+// PWM 模式：兩腳皆為 TIM3 通道（CH1 / CH2），由硬體產生音調與馬達工作週期，
+// 警示急迫度（0..1）對應蜂鳴器音高與馬達強度；設定後不需要 CPU 介入
+// 音調需使用無源蜂鳴器；有源蜂鳴器請以 ALERT_PWM=0 建置（只做開/關）
+#ifndef ALERT_OUTPUT_H
+#define ALERT_OUTPUT_H
+
+#include <stdint.h>
+
+// 1 = PWM 輸出（預設），0 = DigitalOut 開/關
+#ifndef ALERT_PWM
+#define ALERT_PWM 1
+#endif
+
+const uint16_t ALERT_TONE_MIN_HZ = 1500;   // 急迫度 0 的音高
+const uint16_t ALERT_TONE_MAX_HZ = 3500;   // 急迫度 1 的音高
+const float ALERT_MOTOR_MIN_DUTY = 0.4f;   // 急迫度 0 的馬達工作週期（低於此值馬達可能轉不動）
+const float ALERT_MOTOR_MAX_DUTY = 1.0f;
+
+// 初始化輸出並設為關閉
+void alert_output_init();
+
+// 節奏引擎通道輸出（中斷內呼叫）：level 0 = 關，其他 = 以目前急迫度輸出
+void buzzer_out(uint8_t level);
+void motor_out(uint8_t level);
+
+// 設定急迫度（主迴圈呼叫），正在輸出時立即套用新的音高與強度
+void alert_set_urgency(float urgency);
+
+// 省電模式：關閉輸出並釋放 PwmOut 的 deep sleep 鎖（PwmOut::suspend），回到活動模式時 resume；
+// 暫停期間若有通道要求輸出（靜止時出現警示），會先自動 resume。DigitalOut 模式不鎖 deep sleep，兩者皆無動作
+void alert_output_suspend();
+void alert_output_resume();
+
+bool buzzer_is_on();
+bool motor_is_on();
+
+#endif // ALERT_OUTPUT_H
@@ -0,0 +1,124 @@
+#include "mbed.h"
+#include "calibration.h"
+
+#if CALIB_PERSIST == 1
+#include "kvstore_global_api.h"
+
+static const char *const CALIB_KEY = "/kv/cane_calib";
+
+bool calib_load(CalibData &out) {
+    CalibData d;
+    size_t actual = 0;
+    if (kv_get(CALIB_KEY, &d, sizeof(d), &actual) != MBED_SUCCESS) return false;
+    if (actual != sizeof(d) || d.version != CALIB_VERSION) return false;
+    out = d;
+    return true;
+}
+
+bool calib_save(const CalibData &data) {
+    return kv_set(CALIB_KEY, &data, sizeof(data), 0) == MBED_SUCCESS;
+}
+
+#elif CALIB_PERSIST == 2
+#include "telemetry_frame.h"
+
+// Flash 最後一個磁區作為附加寫入的紀錄區：每次校準寫在下一個空槽，載入時取最後一筆有效紀錄。
+// 抹除只在開機載入時進行（F4 抹除 128KB 約 1~2 秒，期間 CPU 與中斷都停住）：紀錄區已滿時抹除並寫回
+// 最後一筆；執行中 calib_save 只寫入數十 bytes，不抹除（128KB 可存約 4000 筆，同一次開機內不會寫滿）
+const uint32_t CALIB_MAGIC = 0x43414C31;   // "CAL1"
+
+struct CalibRecord {
+    uint32_t magic;
+    CalibData data;
+    uint16_t crc;           // CRC16-CCITT（magic + data）
+    uint16_t reserved;
+};
+
+static FlashIAP flash;
+
+static uint16_t record_crc(const CalibRecord &r) {
+    return crc16_ccitt((const uint8_t *)&r, offsetof(CalibRecord, crc));
+}
+
+// 紀錄區位置；紀錄大小需為寫入單位的整數倍，且磁區不可與程式（含 .data 初始值）重疊：
+// 程式結尾進位到所在磁區的結尾，最後一個磁區需在其後（F4 磁區起點對齊各自的大小）
+static bool calib_area(uint32_t &addr, uint32_t &size) {
+    if (flash.init() != 0) return false;
+    uint32_t end = flash.get_flash_start() + flash.get_flash_size();
+    size = flash.get_sector_size(end - 1);
+    addr = end - size;
+    uint32_t app_end = FLASHIAP_APP_ROM_END_ADDR;
+    uint32_t app_sector = flash.get_sector_size(app_end);
+    uint32_t app_end_sector = (app_end + app_sector - 1) / app_sector * app_sector;
+    if (addr < app_end_sector) return false;
+    return sizeof(CalibRecord) % flash.get_page_size() == 0;
+}
+
+// 從頭掃描：回傳最後一筆有效紀錄的索引（-1 表示沒有）與第一個空槽索引
+static void calib_scan(uint32_t addr, uint32_t size, int &last_valid, int &first_free) {
+    int slots = size / sizeof(CalibRecord);
+    last_valid = -1;
+    first_free = slots;
+    for (int i = 0; i < slots; i++) {
+        CalibRecord r;
+        flash.read(&r, addr + i * sizeof(CalibRecord), sizeof(r));
+        if (r.magic == 0xFFFFFFFF) {
+            first_free = i;
+            return;
+        }
+        if (r.magic == CALIB_MAGIC && r.crc == record_crc(r)) last_valid = i;
+    }
+}
+
+static bool calib_program(uint32_t addr, int slot, const CalibData &data) {
+    CalibRecord r;
+    memset(&r, 0xFF, sizeof(r));
+    r.magic = CALIB_MAGIC;
+    r.data = data;
+    r.crc = record_crc(r);
+    return flash.program(&r, addr + slot * sizeof(CalibRecord), sizeof(r)) == 0;
+}
+
+bool calib_load(CalibData &out) {
+    uint32_t addr, size;
+    bool ok = calib_area(addr, size);
+    if (ok) {
+        int last_valid, first_free;
+        calib_scan(addr, size, last_valid, first_free);
+        CalibRecord r;
+        ok = last_valid >= 0 && flash.read(&r, addr + last_valid * sizeof(CalibRecord), sizeof(r)) == 0 &&
+             r.data.version == CALIB_VERSION;
+        if (ok) out = r.data;
+        // 紀錄區已滿：趁開機（尚未開始測距與警示）抹除，並寫回最後一筆
+        if (first_free >= (int)(size / sizeof(CalibRecord)) && flash.erase(addr, size) == 0 && ok) {
+            calib_program(addr, 0, r.data);
+        }
+    }
+    flash.deinit();
+    return ok;
+}
+
+bool calib_save(const CalibData &data) {
+    uint32_t addr, size;
+    bool ok = calib_area(addr, size);
+    if (ok) {
+        int last_valid, first_free;
+        calib_scan(addr, size, last_valid, first_free);
+        // 執行中不抹除：沒有空槽時回報未儲存，下次開機 calib_load 會整理紀錄區
+        ok = first_free < (int)(size / sizeof(CalibRecord)) && calib_program(addr, first_free, data);
+    }
+    flash.deinit();
+    return ok;
+}
+
+#else
+
+bool calib_load(CalibData &) {
+    return false;
+}
+
+bool calib_save(const CalibData &) {
+    return false;
+}
+
+#endif // CALIB_PERSIST
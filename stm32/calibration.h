@@ -0,0 +1,130 @@
+// 零點校準：累積多筆濾波後的俯仰角 / 距離與原始陀螺儀讀數，以平均值作為零點與陀螺儀零偏
+//
+// 以 Welford 法同時計算平均與變異數；任一量的標準差過大（校準時手杖在動、回波不穩）視為無效，
+// 保留原本的零點。成功的結果寫入 Flash，開機時載入，不必每次開機重新校準。
+//
+// 持久化方式（CALIB_PERSIST）：
+//   1 = KVStore（kv_set/kv_get），需在 mbed_app.json 設定儲存區，例如內部 Flash 的 TDBStore：
+//       "target_overrides": { "*": { "storage.storage_type": "TDB_INTERNAL" } }
+//       並依晶片 Flash 大小設定 storage_tdb_internal.internal_base_address / internal_size
+//       （TDBStore 需要兩個磁區輪替，且不可與程式重疊）
+//   2 = FlashIAP 直接寫入 Flash 最後一個磁區（附加寫入紀錄，寫滿時於開機載入時抹除），
+//       適用於 STM32F401CC（256KB）這類只剩一個大磁區、放不下 TDBStore 的晶片；
+//       程式結尾（FLASHIAP_APP_ROM_END_ADDR）延伸到最後一個磁區時不使用，避免抹除到程式
+#ifndef CALIBRATION_H
+#define CALIBRATION_H
+
+#include <math.h>
+#include <stdint.h>
+
+// 1 = KVStore（預設），2 = FlashIAP 最後一個磁區，0 = 只保存在 RAM
+#ifndef CALIB_PERSIST
+#define CALIB_PERSIST 1
+#endif
+
+// 線上平均 / 變異數
+struct RunningStat {
+    uint32_t n;
+    float mean;
+    float m2;       // 與平均差的平方和
+};
+
+inline void running_stat_reset(RunningStat &s) {
+    s.n = 0;
+    s.mean = 0.0f;
+    s.m2 = 0.0f;
+}
+
+inline void running_stat_add(RunningStat &s, float x) {
+    s.n++;
+    float d = x - s.mean;
+    s.mean += d / s.n;
+    s.m2 += d * (x - s.mean);
+}
+
+inline float running_stat_sd(const RunningStat &s) {
+    return s.n > 1 ? sqrtf(s.m2 / (s.n - 1)) : 0.0f;
+}
+
+struct CalibAccum {
+    RunningStat pitch;       // 濾波後俯仰角（度），每筆 IMU 樣本一次
+    RunningStat gyro[3];     // 原始陀螺儀（LSB）
+    RunningStat distance;    // 濾波後距離（cm），每筆有效回波一次
+    uint32_t start_ms;
+};
+
+// 校準結果（亦為持久化格式；欄位變更時請增加 CALIB_VERSION）
+const uint16_t CALIB_VERSION = 1;
+
+struct CalibData {
+    uint16_t version;
+    uint16_t samples;        // 平均用的 IMU 樣本數（僅供回報）
+    float zero_pitch_deg;
+    float zero_distance_cm;
+    float gyro_bias[3];      // LSB
+};
+
+enum CalibStatus {
+    CALIB_COLLECTING = 0,
+    CALIB_OK,
+    CALIB_TOO_NOISY,         // 標準差超過門檻
+    CALIB_TIMEOUT,           // 期限內樣本不足（例如沒有回波）
+};
+
+const char *const CALIB_STATUS_NAMES[] = {"collecting", "OK", "too noisy", "timeout"};
+
+// 接受門檻
+struct CalibLimits {
+    uint32_t imu_samples;        // 需要的 IMU 樣本數
+    uint32_t distance_samples;   // 需要的距離樣本數
+    uint32_t timeout_ms;
+    float max_pitch_sd_deg;
+    float max_distance_sd_cm;
+    float max_gyro_sd_lsb;
+};
+
+inline void calib_begin(CalibAccum &a, uint32_t now_ms) {
+    running_stat_reset(a.pitch);
+    for (int i = 0; i < 3; i++) running_stat_reset(a.gyro[i]);
+    running_stat_reset(a.distance);
+    a.start_ms = now_ms;
+}
+
+inline void calib_add_imu(CalibAccum &a, float pitch_deg, int16_t gx, int16_t gy, int16_t gz) {
+    running_stat_add(a.pitch, pitch_deg);
+    running_stat_add(a.gyro[0], gx);
+    running_stat_add(a.gyro[1], gy);
+    running_stat_add(a.gyro[2], gz);
+}
+
+inline void calib_add_distance(CalibAccum &a, float distance_cm) {
+    running_stat_add(a.distance, distance_cm);
+}
+
+// 樣本足夠時判定結果並填入 out；仍在收集時回傳 CALIB_COLLECTING
+inline CalibStatus calib_check(const CalibAccum &a, const CalibLimits &lim, uint32_t now_ms,
+                               CalibData &out) {
+    bool enough = a.pitch.n >= lim.imu_samples && a.distance.n >= lim.distance_samples;
+    if (!enough) return (now_ms - a.start_ms >= lim.timeout_ms) ? CALIB_TIMEOUT : CALIB_COLLECTING;
+
+    if (running_stat_sd(a.pitch) > lim.max_pitch_sd_deg) return CALIB_TOO_NOISY;
+    if (running_stat_sd(a.distance) > lim.max_distance_sd_cm) return CALIB_TOO_NOISY;
+    for (int i = 0; i < 3; i++) {
+        if (running_stat_sd(a.gyro[i]) > lim.max_gyro_sd_lsb) return CALIB_TOO_NOISY;
+    }
+
+    out.version = CALIB_VERSION;
+    out.samples = (uint16_t)(a.pitch.n > 0xFFFF ? 0xFFFF : a.pitch.n);
+    out.zero_pitch_deg = a.pitch.mean;
+    out.zero_distance_cm = a.distance.mean;
+    for (int i = 0; i < 3; i++) out.gyro_bias[i] = a.gyro[i].mean;
+    return CALIB_OK;
+}
+
+// 讀出 / 寫入持久化的校準結果；CALIB_PERSIST=0 或讀取失敗、版本不符時 calib_load 回傳 false
+// calib_save 會寫入 Flash（CPU 與中斷停住數十毫秒，遇到 TDBStore 整理磁區時約 1~2 秒），
+// 由最低優先的任務在沒有警示時呼叫；CALIB_PERSIST=2 的抹除只在 calib_load（開機）進行
+bool calib_load(CalibData &out);
+bool calib_save(const CalibData &data);
+
+#endif // CALIBRATION_H
@@ -0,0 +1,119 @@
+// 熱路徑週期剖析：以 DWT CYCCNT 記錄各區段每次執行的 min/avg/max 週期數
+// 統計表為靜態陣列，只在主迴圈內使用（不可在中斷內呼叫）；
+// 遙測任務定期以 FRAME_TYPE_PROFILE 訊框送出並重新開始統計視窗
+#ifndef CYCLE_PROFILE_H
+#define CYCLE_PROFILE_H
+
+#include <stdint.h>
+
+#include "cycle_counter.h"
+#include "telemetry_frame.h"
+
+// 1 = 啟用剖析（預設），0 = 區段標記全部編譯為空
+#ifndef CYCLE_PROFILE
+#define CYCLE_PROFILE 1
+#endif
+
+enum ProfSection {
+    PROF_RANGING = 0,    // task_range（含回波結果處理與警示評估）
+    PROF_IMU_READ,       // MPU6050 I2C 讀取（非阻塞模式為每一步的啟動/收尾）
+    PROF_FUSION,         // 姿態濾波（整批樣本）
+    PROF_ALERT_FSM,      // 蜂鳴器/馬達/冷卻期狀態機
+    PROF_TELEMETRY,      // 遙測編碼與排入輸出佇列
+    PROF_SECTION_COUNT,
+};
+
+const char *const PROF_SECTION_NAMES[PROF_SECTION_COUNT] = {
+    "ranging", "imu_read", "fusion", "alert_fsm", "telemetry",
+};
+
+struct ProfStat {
+    uint32_t count;
+    uint32_t min_cycles;
+    uint32_t max_cycles;
+    uint64_t sum_cycles;
+};
+
+// 剖析訊框 payload：n(1) | n × [count(2) min(4) avg(4) max(4)]，區段順序同 ProfSection
+const int PROF_ENTRY_LEN = 2 + 4 + 4 + 4;
+const int PROFILE_PAYLOAD_LEN = 1 + PROF_SECTION_COUNT * PROF_ENTRY_LEN;  // 71 bytes
+
+inline ProfStat *prof_table() {
+    static ProfStat table[PROF_SECTION_COUNT];
+    return table;
+}
+
+inline void prof_reset() {
+    ProfStat *t = prof_table();
+    for (int i = 0; i < PROF_SECTION_COUNT; i++) {
+        t[i].count = 0;
+        t[i].min_cycles = 0xFFFFFFFF;
+        t[i].max_cycles = 0;
+        t[i].sum_cycles = 0;
+    }
+}
+
+inline void prof_init() {
+#if CYCLE_PROFILE
+    cyccnt_init();
+#endif
+    prof_reset();
+}
+
+inline uint32_t prof_begin() {
+#if CYCLE_PROFILE
+    return cyccnt_read();
+#else
+    return 0;
+#endif
+}
+
+inline void prof_end(ProfSection sec, uint32_t start) {
+#if CYCLE_PROFILE
+    uint32_t cycles = cyccnt_read() - start;
+    ProfStat &s = prof_table()[sec];
+    s.count++;
+    s.sum_cycles += cycles;
+    if (cycles < s.min_cycles) s.min_cycles = cycles;
+    if (cycles > s.max_cycles) s.max_cycles = cycles;
+#else
+    (void)sec; (void)start;
+#endif
+}
+
+// 區段標記：建構時開始計時，離開作用域（含提早 return）時記錄
+class ProfScope {
+public:
+    explicit ProfScope(ProfSection sec) : sec_(sec), start_(prof_begin()) {}
+    ~ProfScope() { prof_end(sec_, start_); }
+
+private:
+    ProfSection sec_;
+    uint32_t start_;
+};
+
+inline void prof_summary(int i, uint32_t &count, uint32_t &min_c, uint32_t &avg_c, uint32_t &max_c) {
+    const ProfStat &s = prof_table()[i];
+    count = s.count;
+    min_c = s.count ? s.min_cycles : 0;
+    avg_c = s.count ? (uint32_t)(s.sum_cycles / s.count) : 0;
+    max_c = s.max_cycles;
+}
+
+// 把目前統計編成剖析訊框，回傳訊框總長度
+inline size_t encode_profile_frame(uint8_t *out) {
+    uint8_t payload[PROFILE_PAYLOAD_LEN];
+    uint8_t *p = payload;
+    *p++ = (uint8_t)PROF_SECTION_COUNT;
+    for (int i = 0; i < PROF_SECTION_COUNT; i++) {
+        uint32_t count, min_c, avg_c, max_c;
+        prof_summary(i, count, min_c, avg_c, max_c);
+        p = put_u16(p, count > 0xFFFF ? 0xFFFF : (uint16_t)count);
+        p = put_u32(p, min_c);
+        p = put_u32(p, avg_c);
+        p = put_u32(p, max_c);
+    }
+    return frame_encode(FRAME_TYPE_PROFILE, payload, PROFILE_PAYLOAD_LEN, out);
+}
+
+#endif // CYCLE_PROFILE_H
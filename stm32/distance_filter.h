@@ -0,0 +1,120 @@
+// 距離濾波：滑動中值（去除單筆突波）+ 一維 Kalman（平滑並估計不確定度）
+//
+// Kalman 狀態為距離（cm），預測步的過程雜訊隨手杖角速度增加：
+// 靜止時強平滑，擺動時信任新量測，不會因平滑而延遲跟上真實變化。
+// 中值視窗內的量測彼此一致、且新量測落在預測範圍內時視為「有把握」，可用較少的連續次數觸發警示。
+#ifndef DISTANCE_FILTER_H
+#define DISTANCE_FILTER_H
+
+#include <math.h>
+#include <stdint.h>
+
+// 1 = 中值 + Kalman（預設），0 = 原始距離，連續 hit_need 次才觸發
+#ifndef DISTANCE_FILTER
+#define DISTANCE_FILTER 1
+#endif
+
+const int DIST_MEDIAN_MAX = 7;
+
+struct DistanceFilter {
+    float ring[DIST_MEDIAN_MAX];   // 最近的原始距離
+    int window;                    // 中值視窗（奇數，<= DIST_MEDIAN_MAX）
+    int head;
+    int count;
+    float x;                       // 距離估計（cm）
+    float p;                       // 估計變異數（cm^2）
+    float r;                       // 量測雜訊變異數（cm^2）
+    float q_still;                 // 靜止時過程雜訊（cm^2/s）
+    float q_per_dps;               // 每 1 dps 角速度增加的過程雜訊（cm^2/s）
+    float p_max;                   // 變異數上限（長時間無回波時不再增加）
+    float confident_spread_cm;     // 視窗內最大與最小量測相差不超過此值
+    float confident_gate;          // 新量測與預測相差不超過 gate 倍標準差
+    float spread;                  // 最近一次視窗的最大 - 最小（cm）
+    float innovation;              // 最近一次中值與預測的差（cm）
+    float innovation_var;          // 最近一次預測 + 量測變異數（cm^2）
+    uint32_t last_t_ms;
+    bool initialized;
+};
+
+inline void distance_filter_init(DistanceFilter &f) {
+    f.window = 3;
+    f.head = 0;
+    f.count = 0;
+    f.x = 0.0f;
+    f.p = 0.0f;
+    f.r = 4.0f;                  // HC-SR04 約 ±2cm
+    f.q_still = 25.0f;
+    f.q_per_dps = 40.0f;
+    f.p_max = 10000.0f;
+    f.confident_spread_cm = 6.0f; // 約 3 倍量測標準差（三點視窗）
+    f.confident_gate = 2.0f;
+    f.spread = 0.0f;
+    f.innovation = 0.0f;
+    f.innovation_var = 0.0f;
+    f.last_t_ms = 0;
+    f.initialized = false;
+}
+
+// 視窗內的中值（插入排序，視窗很小）；同時記錄視窗內的最大 - 最小
+inline float distance_median(DistanceFilter &f) {
+    float v[DIST_MEDIAN_MAX];
+    int n = f.count;
+    for (int i = 0; i < n; i++) {
+        float a = f.ring[(f.head + DIST_MEDIAN_MAX - n + i) % DIST_MEDIAN_MAX];
+        int j = i;
+        while (j > 0 && v[j - 1] > a) {
+            v[j] = v[j - 1];
+            j--;
+        }
+        v[j] = a;
+    }
+    f.spread = v[n - 1] - v[0];
+    return v[n / 2];
+}
+
+// 預測步：依經過時間與角速度放大不確定度
+inline void distance_filter_predict(DistanceFilter &f, float motion_dps, uint32_t t_ms) {
+    float dt = (t_ms - f.last_t_ms) * 0.001f;
+    f.last_t_ms = t_ms;
+    if (dt < 0.0f || dt > 1.0f) dt = 1.0f;
+    f.p += (f.q_still + f.q_per_dps * motion_dps) * dt;
+    if (f.p > f.p_max) f.p = f.p_max;
+}
+
+// 一筆有效距離；motion_dps 為目前角速度大小；回傳濾波後距離
+// 開機後中值視窗尚未填滿時回傳 -1（不足 window 筆的中值擋不住突波，不交給 Kalman）
+inline float distance_filter_update(DistanceFilter &f, float z_cm, float motion_dps, uint32_t t_ms) {
+    f.ring[f.head] = z_cm;
+    f.head = (f.head + 1) % DIST_MEDIAN_MAX;
+    if (f.count < f.window) f.count++;
+    if (f.count < f.window) return -1.0f;
+    float z = distance_median(f);
+
+    if (!f.initialized) {
+        f.x = z;
+        f.p = f.r;
+        f.last_t_ms = t_ms;
+        f.initialized = true;
+        return f.x;
+    }
+    distance_filter_predict(f, motion_dps, t_ms);
+    f.innovation = z - f.x;
+    f.innovation_var = f.p + f.r;
+    float k = f.p / (f.p + f.r);
+    f.x += k * (z - f.x);
+    f.p *= (1.0f - k);
+    return f.x;
+}
+
+// 無回波：只做預測步；中值視窗保留（清空後前幾筆的中值等於最大值，突波會直接進入 Kalman）
+inline void distance_filter_miss(DistanceFilter &f, float motion_dps, uint32_t t_ms) {
+    if (f.initialized) distance_filter_predict(f, motion_dps, t_ms);
+}
+
+// 有把握：視窗內量測一致（沒有突波混在其中），且中值與預測相符（不是剛跳變的地面）
+inline bool distance_filter_confident(const DistanceFilter &f) {
+    return f.initialized && f.spread <= f.confident_spread_cm &&
+           f.innovation * f.innovation <= f.confident_gate * f.confident_gate * f.innovation_var;
+}
+
+#endif // DISTANCE_FILTER_H
@@ -0,0 +1,85 @@
+#include "mbed.h"
+#include "echo_capture.h"
+
+#if ECHO_CAPTURE_MODE
+
+static uint32_t capture_seq[ECHO_CAPTURE_MAX_CHANNELS] = {0};
+static EchoCaptureFn capture_cb = NULL;
+
+static void tim2_isr() {
+    uint32_t sr = TIM2->SR;
+    // 讀 CCRx 會同時清除對應的 CCxIF
+    if (sr & TIM_SR_CC2IF) {
+        EchoCapture c;
+        c.channel = 0;
+        c.rise_us = TIM2->CCR1;
+        c.fall_us = TIM2->CCR2;
+        c.seq = ++capture_seq[0];
+        TIM2->SR = ~(TIM_SR_CC1OF | TIM_SR_CC2OF);
+        if (capture_cb) capture_cb(c);
+    }
+    if (sr & TIM_SR_CC4IF) {
+        EchoCapture c;
+        c.channel = 1;
+        c.rise_us = TIM2->CCR3;
+        c.fall_us = TIM2->CCR4;
+        c.seq = ++capture_seq[1];
+        TIM2->SR = ~(TIM_SR_CC3OF | TIM_SR_CC4OF);
+        if (capture_cb) capture_cb(c);
+    }
+}
+
+// TIM2 掛在 APB1；APB1 有分頻時計時器時脈為 PCLK1 的 2 倍
+static uint32_t tim2_clock_hz() {
+    uint32_t pclk1 = HAL_RCC_GetPCLK1Freq();
+    if ((RCC->CFGR & RCC_CFGR_PPRE1) != RCC_CFGR_PPRE1_DIV1) return pclk1 * 2;
+    return pclk1;
+}
+
+void echo_capture_init(int channels, EchoCaptureFn on_capture) {
+    capture_cb = on_capture;
+
+    RCC->AHB1ENR |= RCC_AHB1ENR_GPIOAEN;
+    RCC->APB1ENR |= RCC_APB1ENR_TIM2EN;
+    (void)RCC->APB1ENR;
+
+    // PA0：複用功能 AF1（TIM2_CH1），下拉防止 Echo 浮空
+    GPIOA->MODER = (GPIOA->MODER & ~GPIO_MODER_MODER0) | GPIO_MODER_MODER0_1;
+    GPIOA->PUPDR = (GPIOA->PUPDR & ~GPIO_PUPDR_PUPDR0) | GPIO_PUPDR_PUPDR0_1;
+    GPIOA->AFR[0] = (GPIOA->AFR[0] & ~GPIO_AFRL_AFSEL0) | (1U << GPIO_AFRL_AFSEL0_Pos);
+
+    TIM2->CR1 = 0;
+    TIM2->PSC = tim2_clock_hz() / 1000000 - 1;   // 1 計數 = 1us
+    TIM2->ARR = 0xFFFFFFFF;                       // 32-bit 自由計數，相減自動處理回繞
+    // IC1 <- TI1（上升沿），IC2 <- TI1（下降沿）；輸入濾波 N=4 濾掉短突波
+    TIM2->CCMR1 = TIM_CCMR1_CC1S_0 | (2U << TIM_CCMR1_IC1F_Pos) |
+                  TIM_CCMR1_CC2S_1 | (2U << TIM_CCMR1_IC2F_Pos);
+    TIM2->CCER = TIM_CCER_CC1E | TIM_CCER_CC2E | TIM_CCER_CC2P;
+    TIM2->DIER = TIM_DIER_CC2IE;                  // 只在下降沿（脈衝完成）中斷
+
+    if (channels > 1) {
+        // PB10：AF1（TIM2_CH3），IC3 <- TI3（上升沿），IC4 <- TI3（下降沿）
+        RCC->AHB1ENR |= RCC_AHB1ENR_GPIOBEN;
+        (void)RCC->AHB1ENR;
+        GPIOB->MODER = (GPIOB->MODER & ~GPIO_MODER_MODER10) | GPIO_MODER_MODER10_1;
+        GPIOB->PUPDR = (GPIOB->PUPDR & ~GPIO_PUPDR_PUPDR10) | GPIO_PUPDR_PUPDR10_1;
+        GPIOB->AFR[1] = (GPIOB->AFR[1] & ~GPIO_AFRH_AFSEL10) | (1U << GPIO_AFRH_AFSEL10_Pos);
+        TIM2->CCMR2 = TIM_CCMR2_CC3S_0 | (2U << TIM_CCMR2_IC3F_Pos) |
+                      TIM_CCMR2_CC4S_1 | (2U << TIM_CCMR2_IC4F_Pos);
+        TIM2->CCER |= TIM_CCER_CC3E | TIM_CCER_CC4E | TIM_CCER_CC4P;
+        TIM2->DIER |= TIM_DIER_CC4IE;
+    }
+    TIM2->EGR = TIM_EGR_UG;
+    TIM2->SR = 0;
+
+    NVIC_SetVector(TIM2_IRQn, (uint32_t)&tim2_isr);
+    NVIC_EnableIRQ(TIM2_IRQn);
+    TIM2->CR1 = TIM_CR1_CEN;
+}
+
+bool echo_capture_pin_high(int channel) {
+    if (channel == 1) return (GPIOB->IDR & GPIO_IDR_ID10) != 0;
+    return (GPIOA->IDR & GPIO_IDR_ID0) != 0;
+}
+
+#endif // ECHO_CAPTURE_MODE
@@ -0,0 +1,34 @@
+// HC-SR04 Echo 脈寬硬體輸入捕捉（TIM2，AF1）
+//   通道 0：PA0  = TIM2_CH1，IC1 於上升沿、IC2（間接映射到 TI1）於下降沿鎖存
+//   通道 1：PB10 = TIM2_CH3，IC3 於上升沿、IC4（間接映射到 TI3）於下降沿鎖存
+// TIM2 以 1MHz 計數；下降沿中斷只讀出兩個捕捉暫存器交給回呼（由呼叫端放入樣本環），沒有軟體計時抖動
+#ifndef ECHO_CAPTURE_H
+#define ECHO_CAPTURE_H
+
+#include <stdint.h>
+
+// Echo 量測方式：1 = TIM2 硬體輸入捕捉（預設），0 = InterruptIn + mbed Timer
+// 注意：mbed 在 STM32F4 上以 TIM5 作為 us_ticker，TIM2 可自由使用
+#ifndef ECHO_CAPTURE_MODE
+#define ECHO_CAPTURE_MODE 1
+#endif
+
+const int ECHO_CAPTURE_MAX_CHANNELS = 2;
+
+// 一次完整脈衝的上升/下降沿計數值（us）
+struct EchoCapture {
+    uint8_t channel;
+    uint32_t rise_us;
+    uint32_t fall_us;
+    uint32_t seq;      // 該通道每捕捉一次加 1
+};
+
+typedef void (*EchoCaptureFn)(const EchoCapture &c);
+
+// 設定前 channels 個通道的腳位並啟動捕捉；每次脈衝完成於中斷內呼叫 on_capture
+void echo_capture_init(int channels, EchoCaptureFn on_capture);
+
+// Echo 腳目前電位（AF 模式下仍可由 IDR 讀取）
+bool echo_capture_pin_high(int channel);
+
+#endif // ECHO_CAPTURE_H
@@ -0,0 +1,185 @@
+// 傾斜計算用數學函式（atan2 / sqrt / cos），編譯期選擇實作：
+//   TILT_MATH_BACKEND 0 = libm（atan2f/sqrtf/cosf，預設）
+//   TILT_MATH_BACKEND 1 = FPU：VSQRT 指令 + 多項式近似 atan2/cos（角度誤差約 0.001 度）
+//   TILT_MATH_BACKEND 2 = Q15 查表：constexpr 產生的 257 點 atan/cos 表 + 線性內插，整數運算為主（角度誤差約 0.004 度）
+// 三種實作都會編譯，tilt_bench 可在同一份韌體比較；tilt_* 為目前選用的實作
+#ifndef FAST_MATH_H
+#define FAST_MATH_H
+
+#include <math.h>
+#include <stdint.h>
+
+#ifndef TILT_MATH_BACKEND
+#define TILT_MATH_BACKEND 0
+#endif
+
+const float FM_PI = 3.14159265f;
+const float FM_HALF_PI = 1.57079633f;
+const float FM_QUARTER_PI = 0.78539816f;
+
+namespace tilt_libm {
+
+inline float atan2(float y, float x) { return atan2f(y, x); }
+inline float sqrt(float x) { return sqrtf(x); }
+inline float cos(float x) { return cosf(x); }
+
+} // namespace tilt_libm
+
+namespace tilt_fpu {
+
+// VSQRT.F32：單指令 14 週期，不經過 libm 的 errno 處理
+inline float sqrt(float x) {
+#if defined(__GNUC__) && defined(__ARM_FP)
+    float r;
+    __asm__("vsqrt.f32 %0, %1" : "=t"(r) : "t"(x));
+    return r;
+#else
+    return sqrtf(x);
+#endif
+}
+
+// atan(a), 0 <= a <= 1：9 次 minimax 多項式（Abramowitz & Stegun 4.4.49），最大誤差約 1e-5 rad
+inline float atan_unit(float a) {
+    float s = a * a;
+    return a * (0.9998660f + s * (-0.3302995f + s * (0.1801410f + s * (-0.0851330f + s * 0.0208351f))));
+}
+
+inline float atan2(float y, float x) {
+    float ax = fabsf(x), ay = fabsf(y);
+    if (ax == 0.0f && ay == 0.0f) return 0.0f;
+    float r = (ay > ax) ? FM_HALF_PI - atan_unit(ax / ay) : atan_unit(ay / ax);
+    if (x < 0.0f) r = FM_PI - r;
+    return (y < 0.0f) ? -r : r;
+}
+
+// cos(x)：折回 [0, pi/2] 後以偶次多項式近似，最大誤差約 3e-7
+inline float cos(float x) {
+    x = fabsf(x);
+    if (x > FM_PI) x = fmodf(x, 2.0f * FM_PI);
+    if (x > FM_PI) x = 2.0f * FM_PI - x;
+    float sign = 1.0f;
+    if (x > FM_HALF_PI) {
+        x = FM_PI - x;
+        sign = -1.0f;
+    }
+    float s = x * x;
+    float c = 1.0f + s * (-0.4999999963f + s * (0.0416666418f + s * (-0.0013888397f + s * (0.0000247609f - s * 0.0000002605f))));
+    return sign * c;
+}
+
+} // namespace tilt_fpu
+
+namespace tilt_q15 {
+
+const int LUT_BITS = 8;
+const int LUT_N = 1 << LUT_BITS;     // 256 段，257 個點
+
+// constexpr 產表用的雙精度級數（只在編譯期執行）
+constexpr double cx_sqrt(double x) {
+    double r = x > 1.0 ? x : 1.0;
+    for (int i = 0; i < 40; i++) r = 0.5 * (r + x / r);
+    return r;
+}
+
+constexpr double cx_atan(double x) {
+    // 兩次半角縮減：atan(x) = 2 atan(x / (1 + sqrt(1 + x^2)))，之後 |x| < 0.2 級數收斂很快
+    double y = x / (1.0 + cx_sqrt(1.0 + x * x));
+    y = y / (1.0 + cx_sqrt(1.0 + y * y));
+    double sum = 0.0, term = y, y2 = y * y;
+    for (int k = 0; k < 20; k++) {
+        sum += term / (2 * k + 1) * (k % 2 ? -1.0 : 1.0);
+        term *= y2;
+    }
+    return 4.0 * sum;
+}
+
+constexpr double cx_cos(double x) {
+    double sum = 0.0, term = 1.0;
+    for (int k = 0; k < 16; k++) {
+        sum += term;
+        term *= -x * x / ((2 * k + 1) * (2 * k + 2));
+    }
+    return sum;
+}
+
+struct Q15Table {
+    int16_t v[LUT_N + 1];
+};
+
+// atan(i / N) / (pi/4)，Q15
+constexpr Q15Table make_atan_table() {
+    Q15Table t{};
+    for (int i = 0; i <= LUT_N; i++) {
+        double a = cx_atan((double)i / LUT_N) / 0.78539816339744831;
+        t.v[i] = (int16_t)(a * 32767.0 + 0.5);
+    }
+    return t;
+}
+
+// cos(i / N * pi/2)，Q15
+constexpr Q15Table make_cos_table() {
+    Q15Table t{};
+    for (int i = 0; i <= LUT_N; i++) {
+        t.v[i] = (int16_t)(cx_cos((double)i / LUT_N * 1.57079632679489662) * 32767.0 + 0.5);
+    }
+    return t;
+}
+
+constexpr Q15Table ATAN_LUT = make_atan_table();
+constexpr Q15Table COS_LUT = make_cos_table();
+
+// 以 Q15 位置（0..32767 對應 0..1）查表並線性內插
+inline int32_t lut_lookup(const Q15Table &t, int32_t q15) {
+    int32_t idx = q15 >> (15 - LUT_BITS);
+    int32_t frac = q15 & ((1 << (15 - LUT_BITS)) - 1);
+    if (idx >= LUT_N) return t.v[LUT_N];
+    int32_t a = t.v[idx], b = t.v[idx + 1];
+    return a + (((b - a) * frac) >> (15 - LUT_BITS));
+}
+
+// 任意量級的輸入（加速度 LSB 或 Madgwick 的 [-1, 1] 四元數項）皆可，回傳弧度；
+// 只用比值決定角度，先以浮點算出 0..1 的比值再轉成 Q15，不會因截斷成整數而失去精度
+inline float atan2(float yf, float xf) {
+    float ax = fabsf(xf), ay = fabsf(yf);
+    if (ax == 0.0f && ay == 0.0f) return 0.0f;
+    bool swap = ay > ax;
+    float num = swap ? ax : ay, den = swap ? ay : ax;
+    int32_t ratio_q15 = (int32_t)(num / den * 32768.0f);           // 0..32768
+    if (ratio_q15 > 32767) ratio_q15 = 32767;
+    int32_t a_q15 = lut_lookup(ATAN_LUT, ratio_q15);               // 單位 pi/4
+    if (swap) a_q15 = 65534 - a_q15;                               // pi/2 - a
+    if (xf < 0.0f) a_q15 = 131068 - a_q15;                         // pi - a
+    if (yf < 0.0f) a_q15 = -a_q15;
+    return a_q15 * (FM_QUARTER_PI / 32767.0f);
+}
+
+inline float sqrt(float x) { return tilt_fpu::sqrt(x); }
+
+inline float cos(float x) {
+    x = fabsf(x);
+    if (x > FM_PI) x = fmodf(x, 2.0f * FM_PI);
+    if (x > FM_PI) x = 2.0f * FM_PI - x;
+    int32_t sign = 1;
+    if (x > FM_HALF_PI) {
+        x = FM_PI - x;
+        sign = -1;
+    }
+    int32_t pos = (int32_t)(x * (32767.0f / FM_HALF_PI));
+    return sign * lut_lookup(COS_LUT, pos) * (1.0f / 32767.0f);
+}
+
+} // namespace tilt_q15
+
+#if TILT_MATH_BACKEND == 1
+namespace tilt_math = tilt_fpu;
+#elif TILT_MATH_BACKEND == 2
+namespace tilt_math = tilt_q15;
+#else
+namespace tilt_math = tilt_libm;
+#endif
+
+inline float tilt_atan2(float y, float x) { return tilt_math::atan2(y, x); }
+inline float tilt_sqrt(float x) { return tilt_math::sqrt(x); }
+inline float tilt_cos(float x) { return tilt_math::cos(x); }
+
+#endif // FAST_MATH_H
@@ -0,0 +1,399 @@
+// 主機端重播模擬：不需要硬體，以比即時快很多的速度跑完整條感測 → 警示管線
+//
+// 使用與韌體相同的標頭（orientation.h、range_array.h / distance_filter.h、calibration.h、alert_logic.h），
+// 這些檔案不依賴 mbed，因此不需要 DigitalOut / I2C / Timer 的替身：硬體相關的部分（中斷、節奏引擎、
+// UART）在這裡以時間戳記模擬。每一步的順序與 STM32F_hcsr04_mpu6050.cpp 相同：
+//   IMU 樣本 → orientation_update；測距完成 → range_channel_record → alert_step；task_alert → alert_cooldown_poll
+//
+// 輸入：
+//   合成步行軌跡（預設）：手杖左右掃動與步伐衝擊、回波雜訊 / 突波 / 遺失、小台階，以及已知位置的下陷（真值）
+//   或錄製的 CSV（--trace）：每列一個 5ms 取樣 t_ms,ax,ay,az,gx,gy,gz,echo_us[,truth]
+//     echo_us 空白表示這一列沒有完成測距，0 表示無回波；truth = 1 表示此時確實有危險（可省略）
+//     開頭需先靜止持杖（同按鈕校準），模擬以前幾秒校準零點與陀螺儀零偏
+//
+// 輸出：每個階段的 ns/次、警示延遲（危險出現到蜂鳴器啟動）p50/p99/max、漏報、每分鐘誤報與加速倍數。
+// 指定 --max-latency-ms / --max-false-per-min / --max-missed 時超過即回傳 1，可當作回歸檢查。
+//
+//   g++ -std=c++14 -O2 -Wall -Wextra -I stm32 stm32/host/replay_sim.cpp -o replay_sim
+//   ./replay_sim [--minutes 10] [--seed 1] [--dump synth.csv] [--trace rec.csv]
+//                [--max-latency-ms 150] [--max-false-per-min 0.5] [--max-missed 0]
+// 可加上與韌體相同的編譯旗標比較設定，例如 -DDISTANCE_FILTER=0、-DORIENTATION_FILTER=2。
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "alert_logic.h"
+#include "calibration.h"
+#include "orientation.h"
+#include "range_array.h"
+
+// 與韌體相同的參數（見 STM32F_hcsr04_mpu6050.cpp）
+const uint32_t IMU_PERIOD_MS = 5;          // FIFO 200Hz
+const uint32_t RANGE_EVERY = 4;            // range_min_interval_ms = 20
+const uint32_t ALERT_TASK_MS = 10;         // fast_period_ms
+const uint32_t RANGE_MAX_ECHO_US = 38000;
+const float STILL_GYRO_DPS = 3.0f;
+const CalibLimits SIM_CALIB_LIMITS = {100u, 10, 3000, 0.5f, 3.0f, STILL_GYRO_DPS * GYRO_LSB_PER_DPS};
+const AlertConfig SIM_ALERT_DEFAULT = {50.0f, 80.0f, 100.0f, 2, 2, 5000};
+
+const uint32_t FALSE_ALARM_GRACE_MS = 200; // 危險結束後這段時間內的啟動不算誤報（濾波尾端）
+
+struct TraceRow {
+    uint32_t t_ms;
+    int16_t ax, ay, az, gx, gy, gz;
+    bool has_echo;
+    uint32_t echo_us;
+    int truth;                             // -1 = 未知
+};
+
+static int16_t clamp16(float v) {
+    if (v > 32767.0f) return 32767;
+    if (v < -32768.0f) return -32768;
+    return (int16_t)lrintf(v);
+}
+
+// 合成步行：前 2 秒靜止持杖（校準），之後走路掃動，途中有小台階（不應警示）與下陷（應警示）
+static std::vector<TraceRow> synth_trace(double minutes, uint32_t seed) {
+    std::mt19937 rng(seed);
+    std::normal_distribution<float> gauss(0.0f, 1.0f);
+    std::uniform_real_distribution<float> uni(0.0f, 1.0f);
+
+    const float h_cm = 75.0f;               // 感測器到地面的垂直高度
+    const float pitch0 = 8.0f;              // 持杖俯仰角（度）
+    const float bias[3] = {180.0f, -95.0f, 40.0f};
+    const uint32_t still_ms = 2000;
+    const uint32_t total_ms = still_ms + (uint32_t)(minutes * 60000.0);
+
+    std::vector<TraceRow> rows;
+    rows.reserve(total_ms / IMU_PERIOD_MS + 1);
+    uint32_t next_event = still_ms + 3000;
+    uint32_t event_end = 0;
+    float event_depth = 0.0f;
+    bool event_hazard = false;
+    float prev_roll = 0.0f, prev_pitch = pitch0;
+    for (uint32_t t = 0, i = 0; t < total_ms; t += IMU_PERIOD_MS, i++) {
+        TraceRow r = {};
+        r.t_ms = t;
+        float ts = t * 0.001f;
+        bool walking = t >= still_ms;
+
+        // 姿態：左右掃動（roll，約 0.9Hz）與隨步伐的俯仰擺動（約 1.8Hz）
+        float roll = walking ? 20.0f * sinf(2.0f * 3.14159265f * 0.9f * ts) : 0.0f;
+        float pitch = pitch0 + (walking ? 6.0f * sinf(2.0f * 3.14159265f * 1.8f * ts) : 0.0f);
+        float dt = IMU_PERIOD_MS * 0.001f;
+        float droll = (roll - prev_roll) / dt, dpitch = (pitch - prev_pitch) / dt;
+        prev_roll = roll;
+        prev_pitch = pitch;
+
+        float p = pitch * DEG_TO_RAD, rr = roll * DEG_TO_RAD;
+        float lin_g = 0.0f;
+        if (walking && fmodf(ts, 1.0f / 1.8f) < 0.03f) lin_g = 0.4f;  // 著地衝擊
+        r.ax = clamp16((-sinf(p) + 0.01f * gauss(rng)) * ACCEL_LSB_PER_G);
+        r.ay = clamp16((cosf(p) * sinf(rr) + 0.01f * gauss(rng)) * ACCEL_LSB_PER_G);
+        r.az = clamp16((cosf(p) * cosf(rr) + lin_g + 0.01f * gauss(rng)) * ACCEL_LSB_PER_G);
+        r.gx = clamp16(bias[0] + (droll + 0.05f * gauss(rng)) * GYRO_LSB_PER_DPS);
+        r.gy = clamp16(bias[1] + (dpitch + 0.05f * gauss(rng)) * GYRO_LSB_PER_DPS);
+        r.gz = clamp16(bias[2] + 0.05f * gauss(rng) * GYRO_LSB_PER_DPS);
+
+        // 地面事件：約每 8~20 秒一次，下陷（60~120cm，0.8~2 秒）或小台階（±15cm）
+        if (walking && t >= next_event && t >= event_end) {
+            event_hazard = uni(rng) < 0.6f;
+            event_depth = event_hazard ? 60.0f + 60.0f * uni(rng) : (uni(rng) < 0.5f ? 15.0f : -15.0f);
+            uint32_t dur = (uint32_t)(event_hazard ? 800 + 1200 * uni(rng) : 1000 + 2000 * uni(rng));
+            event_end = t + dur;
+            next_event = event_end + 8000 + (uint32_t)(12000 * uni(rng));
+        }
+        bool in_event = t < event_end && walking && event_end != 0;
+        r.truth = (in_event && event_hazard) ? 1 : 0;
+
+        if (i % RANGE_EVERY == 0) {
+            r.has_echo = true;
+            float h = h_cm + (in_event ? event_depth : 0.0f);
+            float d = h / (cosf(p) * cosf(rr)) + 1.5f * gauss(rng);
+            float u = uni(rng);
+            if (u < 0.03f) {
+                r.echo_us = 0;                            // 遺失（斜射、吸音表面）
+            } else {
+                if (u < 0.05f) d = 30.0f + 370.0f * uni(rng);  // 突波（多重反射、殘響）
+                r.echo_us = d > 0.0f ? (uint32_t)(d / 0.017f) : 0;
+            }
+        }
+        rows.push_back(r);
+    }
+    return rows;
+}
+
+static bool load_trace(const char *path, std::vector<TraceRow> &rows) {
+    FILE *f = fopen(path, "r");
+    if (!f) return false;
+    char line[256];
+    while (fgets(line, sizeof(line), f)) {
+        if (line[0] < '0' || line[0] > '9') continue;   // 標題列或註解
+        char *fields[9] = {};
+        int n = 0;
+        for (char *p = line; n < 9;) {
+            fields[n++] = p;
+            char *c = strchr(p, ',');
+            if (!c) break;
+            *c = '\0';
+            p = c + 1;
+        }
+        if (n < 8) continue;
+        TraceRow r = {};
+        r.t_ms = (uint32_t)strtoul(fields[0], NULL, 10);
+        r.ax = (int16_t)atoi(fields[1]); r.ay = (int16_t)atoi(fields[2]); r.az = (int16_t)atoi(fields[3]);
+        r.gx = (int16_t)atoi(fields[4]); r.gy = (int16_t)atoi(fields[5]); r.gz = (int16_t)atoi(fields[6]);
+        char *e = fields[7];
+        while (*e == ' ') e++;
+        r.has_echo = *e >= '0' && *e <= '9';
+        r.echo_us = r.has_echo ? (uint32_t)strtoul(e, NULL, 10) : 0;
+        r.truth = n >= 9 && fields[8][0] >= '0' && fields[8][0] <= '9' ? atoi(fields[8]) : -1;
+        rows.push_back(r);
+    }
+    fclose(f);
+    return true;
+}
+
+static void dump_trace(const char *path, const std::vector<TraceRow> &rows) {
+    FILE *f = fopen(path, "w");
+    if (!f) return;
+    fprintf(f, "t_ms,ax,ay,az,gx,gy,gz,echo_us,truth\n");
+    for (const TraceRow &r : rows) {
+        fprintf(f, "%u,%d,%d,%d,%d,%d,%d,", (unsigned)r.t_ms, r.ax, r.ay, r.az, r.gx, r.gy, r.gz);
+        if (r.has_echo) fprintf(f, "%u", (unsigned)r.echo_us);
+        fprintf(f, ",%d\n", r.truth);
+    }
+    fclose(f);
+}
+
+// 每個階段的耗時（ns），扣除計時本身的開銷
+struct StageStat {
+    const char *name;
+    double total_ns;
+    double max_ns;
+    uint64_t calls;
+};
+
+typedef std::chrono::steady_clock Clock;
+
+static double overhead_ns = 0.0;
+
+static void stage_add(StageStat &s, Clock::time_point t0, Clock::time_point t1) {
+    double ns = std::chrono::duration<double, std::nano>(t1 - t0).count() - overhead_ns;
+    if (ns < 0.0) ns = 0.0;
+    s.total_ns += ns;
+    if (ns > s.max_ns) s.max_ns = ns;
+    s.calls++;
+}
+
+static double measure_overhead() {
+    const int n = 100000;
+    double sum = 0.0;
+    for (int i = 0; i < n; i++) {
+        Clock::time_point t0 = Clock::now();
+        Clock::time_point t1 = Clock::now();
+        sum += std::chrono::duration<double, std::nano>(t1 - t0).count();
+    }
+    return sum / n;
+}
+
+static float motion_dps(const OrientationFilter &ori, const TraceRow &s) {
+    float m = fabsf(s.gx - ori.gyro_bias[0]);
+    if (fabsf(s.gy - ori.gyro_bias[1]) > m) m = fabsf(s.gy - ori.gyro_bias[1]);
+    if (fabsf(s.gz - ori.gyro_bias[2]) > m) m = fabsf(s.gz - ori.gyro_bias[2]);
+    return m / GYRO_LSB_PER_DPS;
+}
+
+static double percentile(std::vector<double> v, double q) {
+    if (v.empty()) return 0.0;
+    std::sort(v.begin(), v.end());
+    return v[std::min(v.size() - 1, (size_t)lround(q * (v.size() - 1)))];
+}
+
+int main(int argc, char **argv) {
+    double minutes = 10.0;
+    uint32_t seed = 1;
+    const char *trace_path = NULL;
+    const char *dump_path = NULL;
+    double max_latency_ms = -1.0, max_false_per_min = -1.0;
+    int max_missed = -1;
+    for (int i = 1; i < argc; i++) {
+        const char *a = argv[i];
+        const char *v = i + 1 < argc ? argv[i + 1] : NULL;
+        if (!v) {
+            fprintf(stderr, "missing value for %s\n", a);
+            return 2;
+        }
+        if (!strcmp(a, "--minutes")) minutes = atof(v);
+        else if (!strcmp(a, "--seed")) seed = (uint32_t)strtoul(v, NULL, 10);
+        else if (!strcmp(a, "--trace")) trace_path = v;
+        else if (!strcmp(a, "--dump")) dump_path = v;
+        else if (!strcmp(a, "--max-latency-ms")) max_latency_ms = atof(v);
+        else if (!strcmp(a, "--max-false-per-min")) max_false_per_min = atof(v);
+        else if (!strcmp(a, "--max-missed")) max_missed = atoi(v);
+        else {
+            fprintf(stderr, "unknown option %s\n", a);
+            return 2;
+        }
+        i++;
+    }
+
+    std::vector<TraceRow> rows;
+    if (trace_path) {
+        if (!load_trace(trace_path, rows) || rows.empty()) {
+            fprintf(stderr, "cannot read trace %s\n", trace_path);
+            return 2;
+        }
+    } else {
+        rows = synth_trace(minutes, seed);
+        if (dump_path) dump_trace(dump_path, rows);
+    }
+
+    OrientationFilter ori;
+    orientation_init(ori);
+    RangeChannel ranges[1];
+    range_channel_init(ranges[0], "ground", RANGE_GROUND);
+    AlertState alert;
+    alert_state_init(alert);
+    const AlertConfig cfg = SIM_ALERT_DEFAULT;
+    CalibAccum calib;
+    calib_begin(calib, rows[0].t_ms);
+    bool calibrating = true;
+    float zero_distance_cm = 0.0f;
+
+    StageStat stages[] = {{"fusion", 0, 0, 0}, {"range", 0, 0, 0}, {"alert", 0, 0, 0}, {"cooldown", 0, 0, 0}};
+    StageStat &st_fusion = stages[0], &st_range = stages[1], &st_alert = stages[2], &st_cooldown = stages[3];
+    overhead_ns = measure_overhead();
+
+    // 警示事件對照真值
+    bool buzzer_active = false;
+    bool have_truth = false;
+    bool in_hazard = false, hazard_alerted = false;
+    uint32_t hazard_start = 0, hazard_end = 0;
+    int hazards = 0, missed = 0, false_alarms = 0, buzzer_starts = 0, motor_starts = 0;
+    std::vector<double> latencies;
+    uint32_t next_alert_task = rows[0].t_ms;
+    uint32_t eval_start_ms = 0;
+
+    Clock::time_point wall0 = Clock::now();
+    for (const TraceRow &s : rows) {
+        Clock::time_point t0 = Clock::now();
+        orientation_update(ori, s.ax, s.ay, s.az, s.gx, s.gy, s.gz, s.t_ms);
+        stage_add(st_fusion, t0, Clock::now());
+        if (calibrating) calib_add_imu(calib, ori.pitch_deg, s.gx, s.gy, s.gz);
+
+        if (s.truth >= 0) {
+            have_truth = true;
+            if (s.truth && !in_hazard) {
+                in_hazard = true;
+                hazard_alerted = false;
+                hazard_start = s.t_ms;
+                hazards++;
+            } else if (!s.truth && in_hazard) {
+                in_hazard = false;
+                hazard_end = s.t_ms;
+                if (!hazard_alerted) missed++;
+            }
+        }
+
+        if (s.has_echo) {
+            uint32_t us = s.echo_us > RANGE_MAX_ECHO_US ? 0 : s.echo_us;
+            RangeChannel &ch = ranges[0];
+            if (us == 0) ch.timeouts++;
+            t0 = Clock::now();
+            range_channel_record(ch, us, motion_dps(ori, s), s.t_ms);
+            stage_add(st_range, t0, Clock::now());
+
+            if (calibrating) {
+                if (us > 0 && ch.filt_cm >= 0.0f) calib_add_distance(calib, ch.filt_cm);
+                CalibData cd;
+                CalibStatus cs = calib_check(calib, SIM_CALIB_LIMITS, s.t_ms, cd);
+                if (cs != CALIB_COLLECTING) {
+                    if (cs != CALIB_OK) {
+                        fprintf(stderr, "calibration rejected (%s): pitch sd %.2f deg, distance sd %.2f cm\n",
+                                CALIB_STATUS_NAMES[cs], running_stat_sd(calib.pitch), running_stat_sd(calib.distance));
+                        return 2;
+                    }
+                    zero_distance_cm = cd.zero_distance_cm;
+                    for (int i = 0; i < 3; i++) ori.gyro_bias[i] = cd.gyro_bias[i];
+                    calibrating = false;
+                    eval_start_ms = s.t_ms;
+                    printf("calibrated at %.2f s: zero_pitch %.2f deg, zero_distance %.2f cm\n",
+                           s.t_ms * 0.001, cd.zero_pitch_deg, zero_distance_cm);
+                }
+            } else {
+                t0 = Clock::now();
+                float cos_pitch = tilt_cos(ori.pitch_deg * DEG_TO_RAD);
+                uint8_t act = alert_step(alert, cfg, ranges, 1, 0, cos_pitch, zero_distance_cm,
+                                         DISTANCE_FILTER, buzzer_active, s.t_ms);
+                stage_add(st_alert, t0, Clock::now());
+                if (act & ALERT_ACT_STOP) buzzer_active = false;
+                if (act & ALERT_ACT_MOTOR) motor_starts++;
+                if (act & ALERT_ACT_BUZZER) {
+                    buzzer_active = true;   // 警示節奏循環播放，直到 STOP
+                    buzzer_starts++;
+                    if (in_hazard) {
+                        if (!hazard_alerted) latencies.push_back(s.t_ms - hazard_start);
+                        hazard_alerted = true;
+                    } else if (have_truth && !(hazards > 0 && s.t_ms - hazard_end < FALSE_ALARM_GRACE_MS)) {
+                        false_alarms++;
+                    }
+                }
+            }
+        }
+
+        if (!time_reached(s.t_ms, next_alert_task)) continue;
+        next_alert_task = s.t_ms + ALERT_TASK_MS;
+        t0 = Clock::now();
+        alert_cooldown_poll(alert, cfg, s.t_ms);
+        stage_add(st_cooldown, t0, Clock::now());
+    }
+    double wall_s = std::chrono::duration<double>(Clock::now() - wall0).count();
+    if (in_hazard && !hazard_alerted) missed++;
+
+    double sim_s = (rows.back().t_ms - rows.front().t_ms) * 0.001;
+    double eval_min = (rows.back().t_ms - eval_start_ms) / 60000.0;
+    printf("replayed %.1f s (%zu IMU samples, %u ranges, %u timeouts) in %.3f s: %.0fx real time\n",
+           sim_s, rows.size(), (unsigned)ranges[0].count, (unsigned)ranges[0].timeouts, wall_s,
+           wall_s > 0.0 ? sim_s / wall_s : 0.0);
+    printf("stage cost (timer overhead %.1f ns subtracted):\n", overhead_ns);
+    for (const StageStat &st : stages) {
+        printf("  %-9s %10llu calls  avg %8.1f ns  max %10.1f ns\n", st.name, (unsigned long long)st.calls,
+               st.calls ? st.total_ns / st.calls : 0.0, st.max_ns);
+    }
+    printf("alerts: %d buzzer starts, %d motor starts\n", buzzer_starts, motor_starts);
+
+    int rc = 0;
+    if (!have_truth) {
+        printf("no truth column: latency / false alarms not evaluated\n");
+        return rc;
+    }
+    double false_per_min = eval_min > 0.0 ? false_alarms / eval_min : 0.0;
+    printf("hazards %d, missed %d\n", hazards, missed);
+    printf("alert latency ms: p50 %.0f  p99 %.0f  max %.0f (n=%zu)\n", percentile(latencies, 0.50),
+           percentile(latencies, 0.99), latencies.empty() ? 0.0 : *std::max_element(latencies.begin(), latencies.end()),
+           latencies.size());
+    printf("false alarms %d (%.2f / min)\n", false_alarms, false_per_min);
+
+    if (max_latency_ms >= 0.0 && percentile(latencies, 0.99) > max_latency_ms) {
+        printf("FAIL: p99 latency above %.0f ms\n", max_latency_ms);
+        rc = 1;
+    }
+    if (max_false_per_min >= 0.0 && false_per_min > max_false_per_min) {
+        printf("FAIL: false alarms above %.2f / min\n", max_false_per_min);
+        rc = 1;
+    }
+    if (max_missed >= 0 && missed > max_missed) {
+        printf("FAIL: missed hazards above %d\n", max_missed);
+        rc = 1;
+    }
+    return rc;
+}
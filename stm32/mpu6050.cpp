@@ -0,0 +1,358 @@
+#include "mbed.h"
+#include "mpu6050.h"
+#include "spsc_ring.h"
+
+// MPU6050 腳位與地址
+I2C i2c(PB_7, PB_6);             // SDA, SCL我的MPU6050 測是起來
+const int MPU_ADDR = 0x68 << 1;  // mbed 使用 8-bit 地址
+const int FIFO_BURST_SAMPLES = 10;       // 單次 I2C burst 讀取的樣本數（120 bytes）
+
+// 以 uint8_t 組合，避免 char 為負值時符號延伸蓋掉高位元組
+static inline int16_t be16(const char *p) {
+    return (int16_t)(((uint8_t)p[0] << 8) | (uint8_t)p[1]);
+}
+
+void mpu_write(uint8_t reg, uint8_t val) {
+    char d[2] = {(char)reg, (char)val};
+    i2c.write(MPU_ADDR, d, 2);
+}
+
+bool mpu_read(uint8_t reg, char *buf, int len) {
+    char r = reg;
+    if (i2c.write(MPU_ADDR, &r, 1, true) != 0) return false;
+    if (i2c.read(MPU_ADDR, buf, len) != 0) return false;
+    return true;
+}
+
+bool mpu_init() {
+    i2c.frequency(400000); // 400kHz
+    mpu_write(MPU_REG_PWR_MGMT_1, 0x00); // PWR_MGMT_1: 退出睡眠
+    thread_sleep_for(100);
+    char whoami = 0;
+    if (!mpu_read(MPU_REG_WHO_AM_I, &whoami, 1)) return false;
+    return (whoami == 0x68);
+}
+
+bool mpu_read_sample(ImuSample &out, uint32_t now_ms) {
+    char buf[14] = {0};
+    if (!mpu_read(MPU_REG_ACCEL_XOUT_H, buf, 14)) return false;
+    out.ax = be16(buf + 0);
+    out.ay = be16(buf + 2);
+    out.az = be16(buf + 4);
+    out.gx = be16(buf + 8);       // buf[6..7] 為溫度
+    out.gy = be16(buf + 10);
+    out.gz = be16(buf + 12);
+    out.t_ms = now_ms;
+    return true;
+}
+
+#if IMU_FIFO_MODE
+
+// INT 腳：MPU6050 資料就緒脈衝（約 50us，高電位有效）
+InterruptIn mpu_int(PB_1);
+
+// 樣本環容量（200Hz 下約 320ms）；滿了捨棄新樣本並計數
+static SpscRing<ImuSample, 64> imu_ring;
+static uint32_t overflows = 0;           // MPU6050 FIFO 溢位（重置）次數
+static uint16_t fifo_rate_hz = 0;
+
+static volatile int ready_count = 0;     // 自上次通知後的資料就緒次數
+static int ready_watermark = 1;
+static ImuWatermarkFn watermark_cb = NULL;
+static uint16_t normal_rate_hz = 0;      // mpu_fifo_init 設定的取樣率
+static volatile bool motion_mode = false; // INT 腳目前為動作偵測（省電模式）
+static ImuMotionFn motion_cb = NULL;
+
+static void mpu_int_rise() {
+    if (motion_mode) {
+        if (motion_cb) motion_cb();
+        return;
+    }
+    if (++ready_count >= ready_watermark) {
+        ready_count = 0;
+        if (watermark_cb) watermark_cb();
+    }
+}
+
+// 解析一批 FIFO 資料放入樣本環；first/total 用來回推每筆的取樣時間
+static void fifo_push_burst(const char *buf, int n, int first, int total, uint32_t now_ms) {
+    uint32_t period_ms = 1000 / fifo_rate_hz;
+    for (int i = 0; i < n; i++) {
+        const char *p = buf + i * MPU_FIFO_SAMPLE_BYTES;
+        ImuSample s;
+        s.ax = be16(p + 0);
+        s.ay = be16(p + 2);
+        s.az = be16(p + 4);
+        s.gx = be16(p + 6);
+        s.gy = be16(p + 8);
+        s.gz = be16(p + 10);
+        // FIFO 沒有時間戳：最後一筆視為現在，往前依取樣週期回推
+        s.t_ms = now_ms - (uint32_t)(total - 1 - (first + i)) * period_ms;
+        imu_ring.push(s);
+    }
+}
+
+static void fifo_reset() {
+    mpu_write(MPU_REG_USER_CTRL, 0x04);  // FIFO_RESET
+    mpu_write(MPU_REG_USER_CTRL, 0x40);  // FIFO_EN
+}
+
+// 設定 SMPLRT_DIV（DLPF 開啟時內部 1kHz），呼叫端接著清空 FIFO，避免新舊取樣週期的樣本混在一批
+static void set_sample_rate(uint16_t rate_hz) {
+    if (rate_hz < 4) rate_hz = 4;
+    if (rate_hz > 1000) rate_hz = 1000;
+    fifo_rate_hz = 1000 / (1000 / rate_hz);
+    mpu_write(MPU_REG_SMPLRT_DIV, (uint8_t)(1000 / rate_hz - 1));
+}
+
+bool mpu_fifo_init(uint16_t rate_hz, int watermark, ImuWatermarkFn on_watermark) {
+    normal_rate_hz = rate_hz;
+    ready_watermark = watermark < 1 ? 1 : watermark;
+    watermark_cb = on_watermark;
+
+    mpu_write(MPU_REG_PWR_MGMT_1, 0x01);               // 時脈改用 X 軸陀螺儀 PLL（較穩定）
+    mpu_write(MPU_REG_CONFIG, 0x03);                   // DLPF_CFG=3：加速度 44Hz / 陀螺儀 42Hz 頻寬
+    set_sample_rate(rate_hz);
+    mpu_write(MPU_REG_GYRO_CONFIG, 0x00);              // ±250 dps（131 LSB/dps）
+    mpu_write(MPU_REG_ACCEL_CONFIG, 0x00);             // ±2 g（16384 LSB/g）
+    mpu_write(MPU_REG_FIFO_EN, 0x78);                  // XG YG ZG ACCEL 寫入 FIFO
+    mpu_write(MPU_REG_INT_PIN_CFG, 0x10);              // 高電位脈衝，任何讀取清除中斷狀態
+    mpu_write(MPU_REG_INT_ENABLE, 0x01);               // DATA_RDY_EN
+    fifo_reset();
+
+    mpu_int.mode(PullDown);
+    mpu_int.rise(&mpu_int_rise);
+
+    char v = 0;
+    if (!mpu_read(MPU_REG_FIFO_EN, &v, 1)) return false;
+    return (uint8_t)v == 0x78;
+}
+
+int mpu_fifo_drain(uint32_t now_ms) {
+    char cnt[2];
+    if (!mpu_read(MPU_REG_FIFO_COUNTH, cnt, 2)) return -1;
+    int bytes = ((uint8_t)cnt[0] << 8) | (uint8_t)cnt[1];
+
+    // 溢位或未對齊（FIFO 滿時最舊資料被覆蓋，樣本邊界會錯位）：重置 FIFO
+    if (bytes >= MPU_FIFO_SIZE - MPU_FIFO_SAMPLE_BYTES || bytes % MPU_FIFO_SAMPLE_BYTES != 0) {
+        fifo_reset();
+        overflows++;
+        return 0;
+    }
+
+    int total = bytes / MPU_FIFO_SAMPLE_BYTES;
+    int done = 0;
+    char buf[FIFO_BURST_SAMPLES * MPU_FIFO_SAMPLE_BYTES];
+    while (done < total) {
+        int n = total - done;
+        if (n > FIFO_BURST_SAMPLES) n = FIFO_BURST_SAMPLES;
+        if (!mpu_read(MPU_REG_FIFO_R_W, buf, n * MPU_FIFO_SAMPLE_BYTES)) return done > 0 ? done : -1;
+        fifo_push_burst(buf, n, done, total, now_ms);
+        done += n;
+    }
+    return done;
+}
+
+bool imu_ring_pop(ImuSample &out) {
+    return imu_ring.pop(out);
+}
+
+uint32_t imu_ring_dropped() {
+    return imu_ring.dropped();
+}
+
+bool mpu_motion_wake_enable(uint8_t threshold, uint8_t duration_ms, uint16_t low_rate_hz,
+                            ImuMotionFn on_motion) {
+    motion_cb = on_motion;
+    mpu_write(MPU_REG_INT_ENABLE, 0x00);
+    motion_mode = true;
+    mpu_write(MPU_REG_ACCEL_CONFIG, 0x01);             // ±2 g，ACCEL_HPF=5Hz（只影響動作偵測）
+    mpu_write(MPU_REG_MOT_THR, threshold);
+    mpu_write(MPU_REG_MOT_DUR, duration_ms);
+    set_sample_rate(low_rate_hz);
+    fifo_reset();
+    mpu_write(MPU_REG_INT_ENABLE, 0x40);               // MOT_EN
+    char v = 0;
+    if (!mpu_read(MPU_REG_INT_ENABLE, &v, 1)) return false;
+    return (uint8_t)v == 0x40;
+}
+
+void mpu_motion_wake_disable() {
+    mpu_write(MPU_REG_INT_ENABLE, 0x00);
+    set_sample_rate(normal_rate_hz);
+    fifo_reset();
+    ready_count = 0;
+    motion_mode = false;
+    mpu_write(MPU_REG_INT_ENABLE, 0x01);               // DATA_RDY_EN
+}
+
+uint16_t mpu_fifo_rate_hz() {
+    return fifo_rate_hz;
+}
+
+uint32_t mpu_fifo_overflows() {
+    return overflows + imu_ring.dropped();
+}
+
+#endif // IMU_FIFO_MODE
+
+#if IMU_ASYNC_I2C
+
+const uint32_t ASYNC_TIMEOUT_MS = 10;    // 400kHz 下 120 bytes 約 3ms，逾時視為匯流排卡住
+
+static char async_tx[1];
+static char async_rx[FIFO_BURST_SAMPLES * MPU_FIFO_SAMPLE_BYTES];
+static volatile bool async_busy = false;
+static volatile int async_event = 0;
+static uint32_t async_start_ms = 0;
+static ImuAsyncFn async_cb = NULL;
+static uint32_t bus_errors = 0;
+
+static void i2c_transfer_done(int event) {
+    async_event = event;
+    async_busy = false;
+    if (async_cb) async_cb();
+}
+
+void mpu_async_init(ImuAsyncFn on_complete) {
+    async_cb = on_complete;
+}
+
+// 開始非阻塞讀取：寫暫存器位址後以 repeated start 讀 len bytes 到 async_rx
+static bool async_read(uint8_t reg, int len, uint32_t now_ms) {
+    async_tx[0] = (char)reg;
+    async_event = 0;
+    async_busy = true;
+    async_start_ms = now_ms;
+    if (i2c.transfer(MPU_ADDR, async_tx, 1, async_rx, len,
+                     callback(&i2c_transfer_done), I2C_EVENT_ALL, false) != 0) {
+        async_busy = false;
+        bus_errors++;
+        return false;
+    }
+    return true;
+}
+
+// 檢查傳輸結果：MPU_ASYNC_PENDING / DONE / ERROR（錯誤只計數）
+static MpuAsyncStatus async_poll(uint32_t now_ms) {
+    if (async_busy) {
+        if (now_ms - async_start_ms <= ASYNC_TIMEOUT_MS) return MPU_ASYNC_PENDING;
+        i2c.abort_transfer();
+        async_busy = false;
+        bus_errors++;
+        return MPU_ASYNC_ERROR;
+    }
+    int ev = async_event;
+    if ((ev & I2C_EVENT_TRANSFER_COMPLETE) &&
+        !(ev & (I2C_EVENT_ERROR | I2C_EVENT_ERROR_NO_SLAVE | I2C_EVENT_TRANSFER_EARLY_NACK))) {
+        return MPU_ASYNC_DONE;
+    }
+    bus_errors++;
+    return MPU_ASYNC_ERROR;
+}
+
+static bool sample_pending = false;
+
+MpuAsyncStatus mpu_read_sample_step(ImuSample &out, uint32_t now_ms) {
+    if (!sample_pending) {
+        if (!async_read(MPU_REG_ACCEL_XOUT_H, 14, now_ms)) return MPU_ASYNC_ERROR;
+        sample_pending = true;
+        return MPU_ASYNC_PENDING;
+    }
+    MpuAsyncStatus st = async_poll(now_ms);
+    if (st == MPU_ASYNC_PENDING) return st;
+    sample_pending = false;
+    if (st == MPU_ASYNC_DONE) {
+        out.ax = be16(async_rx + 0);
+        out.ay = be16(async_rx + 2);
+        out.az = be16(async_rx + 4);
+        out.gx = be16(async_rx + 8);
+        out.gy = be16(async_rx + 10);
+        out.gz = be16(async_rx + 12);
+        out.t_ms = now_ms;
+    }
+    return st;
+}
+
+#if IMU_FIFO_MODE
+enum FifoAsyncState { FIFO_IDLE, FIFO_READ_COUNT, FIFO_READ_DATA };
+static FifoAsyncState fifo_state = FIFO_IDLE;
+static int fifo_total = 0;     // 本批樣本數
+static int fifo_done = 0;      // 已讀出樣本數
+static int fifo_chunk = 0;     // 傳輸中的樣本數
+static uint32_t fifo_read_ms = 0;
+
+// 讀下一段 burst（最多 FIFO_BURST_SAMPLES 筆）
+static bool fifo_read_chunk(uint32_t now_ms) {
+    fifo_chunk = fifo_total - fifo_done;
+    if (fifo_chunk > FIFO_BURST_SAMPLES) fifo_chunk = FIFO_BURST_SAMPLES;
+    return async_read(MPU_REG_FIFO_R_W, fifo_chunk * MPU_FIFO_SAMPLE_BYTES, now_ms);
+}
+
+MpuAsyncStatus mpu_fifo_drain_step(uint32_t now_ms, int &samples) {
+    samples = 0;
+    MpuAsyncStatus st;
+    switch (fifo_state) {
+    case FIFO_IDLE:
+        if (!async_read(MPU_REG_FIFO_COUNTH, 2, now_ms)) return MPU_ASYNC_ERROR;
+        fifo_state = FIFO_READ_COUNT;
+        return MPU_ASYNC_PENDING;
+
+    case FIFO_READ_COUNT: {
+        st = async_poll(now_ms);
+        if (st == MPU_ASYNC_PENDING) return st;
+        fifo_state = FIFO_IDLE;
+        if (st == MPU_ASYNC_ERROR) return st;
+        int bytes = ((uint8_t)async_rx[0] << 8) | (uint8_t)async_rx[1];
+        if (bytes >= MPU_FIFO_SIZE - MPU_FIFO_SAMPLE_BYTES || bytes % MPU_FIFO_SAMPLE_BYTES != 0) {
+            fifo_reset();   // 少見情況，沿用阻塞寫入
+            overflows++;
+            return MPU_ASYNC_DONE;
+        }
+        fifo_total = bytes / MPU_FIFO_SAMPLE_BYTES;
+        if (fifo_total == 0) return MPU_ASYNC_DONE;
+        fifo_done = 0;
+        fifo_read_ms = now_ms;
+        if (!fifo_read_chunk(now_ms)) return MPU_ASYNC_ERROR;
+        fifo_state = FIFO_READ_DATA;
+        return MPU_ASYNC_PENDING;
+    }
+
+    case FIFO_READ_DATA:
+        st = async_poll(now_ms);
+        if (st == MPU_ASYNC_PENDING) return st;
+        if (st == MPU_ASYNC_ERROR) {
+            fifo_state = FIFO_IDLE;
+            samples = fifo_done;
+            return st;
+        }
+        fifo_push_burst(async_rx, fifo_chunk, fifo_done, fifo_total, fifo_read_ms);
+        fifo_done += fifo_chunk;
+        if (fifo_done < fifo_total) {
+            if (!fifo_read_chunk(now_ms)) {
+                fifo_state = FIFO_IDLE;
+                samples = fifo_done;
+                return MPU_ASYNC_ERROR;
+            }
+            return MPU_ASYNC_PENDING;
+        }
+        fifo_state = FIFO_IDLE;
+        samples = fifo_done;
+        return MPU_ASYNC_DONE;
+    }
+    return MPU_ASYNC_ERROR;
+}
+#endif // IMU_FIFO_MODE
+
+uint32_t mpu_bus_errors() {
+    return bus_errors;
+}
+
+bool mpu_async_idle() {
+#if IMU_FIFO_MODE
+    if (fifo_state != FIFO_IDLE) return false;
+#endif
+    return !async_busy && !sample_pending;
+}
+
+#endif // IMU_ASYNC_I2C
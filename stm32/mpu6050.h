@@ -0,0 +1,117 @@
+// MPU6050 驅動：暫存器快照讀取，以及 FIFO + INT 腳資料就緒中斷的批次讀取模式
+//
+// FIFO 模式：取樣率由 SMPLRT_DIV 決定（DLPF 開啟時 1kHz / (1 + div)），
+// 每筆 12 bytes（加速度 + 陀螺儀）寫入 MPU6050 內部 1024 bytes FIFO；
+// INT 腳每筆資料產生一個脈衝，累積到水位時通知主迴圈，一次以 burst I2C 讀出整批。
+// MPU6050 沒有 FIFO 水位中斷，因此由 MCU 端計數資料就緒脈衝實作水位。
+#ifndef MPU6050_H
+#define MPU6050_H
+
+#include <stdint.h>
+
+// IMU 讀取方式：1 = FIFO 批次讀取（預設），0 = 每次讀暫存器快照
+#ifndef IMU_FIFO_MODE
+#define IMU_FIFO_MODE 1
+#endif
+
+// I2C 傳輸方式：1 = 非阻塞（I2C::transfer + 完成中斷，需 DEVICE_I2C_ASYNCH），0 = 阻塞
+#ifndef IMU_ASYNC_I2C
+#if DEVICE_I2C_ASYNCH
+#define IMU_ASYNC_I2C 1
+#else
+#define IMU_ASYNC_I2C 0
+#endif
+#endif
+
+// MPU6050 暫存器
+const uint8_t MPU_REG_SMPLRT_DIV   = 0x19;
+const uint8_t MPU_REG_CONFIG       = 0x1A;
+const uint8_t MPU_REG_GYRO_CONFIG  = 0x1B;
+const uint8_t MPU_REG_ACCEL_CONFIG = 0x1C;
+const uint8_t MPU_REG_MOT_THR      = 0x1F;
+const uint8_t MPU_REG_MOT_DUR      = 0x20;
+const uint8_t MPU_REG_FIFO_EN      = 0x23;
+const uint8_t MPU_REG_INT_PIN_CFG  = 0x37;
+const uint8_t MPU_REG_INT_ENABLE   = 0x38;
+const uint8_t MPU_REG_INT_STATUS   = 0x3A;
+const uint8_t MPU_REG_ACCEL_XOUT_H = 0x3B;
+const uint8_t MPU_REG_USER_CTRL    = 0x6A;
+const uint8_t MPU_REG_PWR_MGMT_1   = 0x6B;
+const uint8_t MPU_REG_FIFO_COUNTH  = 0x72;
+const uint8_t MPU_REG_FIFO_R_W     = 0x74;
+const uint8_t MPU_REG_WHO_AM_I     = 0x75;
+
+const int MPU_FIFO_SIZE = 1024;
+const int MPU_FIFO_SAMPLE_BYTES = 12;   // ax ay az gx gy gz，各 2 bytes big-endian
+
+struct ImuSample {
+    int16_t ax, ay, az;
+    int16_t gx, gy, gz;
+    uint32_t t_ms;       // 取樣時間（FIFO 模式由讀出時間與取樣週期回推）
+};
+
+void mpu_write(uint8_t reg, uint8_t val);
+bool mpu_read(uint8_t reg, char *buf, int len);
+
+// 喚醒並確認 WHO_AM_I
+bool mpu_init();
+
+// 讀一筆暫存器快照（0x3B 起 14 bytes）
+bool mpu_read_sample(ImuSample &out, uint32_t now_ms);
+
+#if IMU_FIFO_MODE
+typedef void (*ImuWatermarkFn)();
+
+// 設定取樣率、DLPF、FIFO 與 INT 腳；每累積 watermark 筆資料於中斷內呼叫 on_watermark
+bool mpu_fifo_init(uint16_t rate_hz, int watermark, ImuWatermarkFn on_watermark);
+
+// 讀出 FIFO 內所有完整樣本放入樣本環，回傳讀到的筆數（失敗回傳 -1）
+int mpu_fifo_drain(uint32_t now_ms);
+
+// 從樣本環依序取出樣本（主迴圈使用）
+bool imu_ring_pop(ImuSample &out);
+uint32_t imu_ring_dropped();     // 主迴圈來不及處理而捨棄的樣本數
+
+uint16_t mpu_fifo_rate_hz();
+uint32_t mpu_fifo_overflows();   // MPU6050 FIFO 或樣本環溢位次數
+
+typedef void (*ImuMotionFn)();
+
+// 省電模式：取樣率降為 low_rate_hz 並關閉資料就緒中斷，INT 腳只在動作偵測
+// （高通後加速度超過 threshold × 2mg 持續 duration_ms）時觸發，於中斷內呼叫 on_motion
+// enable / disable 皆會做阻塞 I2C 寫入，非阻塞模式下需在 mpu_async_idle() 時呼叫（見 power_update）
+bool mpu_motion_wake_enable(uint8_t threshold, uint8_t duration_ms, uint16_t low_rate_hz,
+                            ImuMotionFn on_motion);
+
+// 回到 mpu_fifo_init 設定的取樣率與資料就緒中斷
+void mpu_motion_wake_disable();
+#endif
+
+#if IMU_ASYNC_I2C
+// 非阻塞讀取：每次呼叫推進一步，傳輸進行中回傳 PENDING，
+// 完成（或錯誤）時於 I2C 中斷內呼叫 on_complete，主迴圈再呼叫一次取得結果
+enum MpuAsyncStatus {
+    MPU_ASYNC_PENDING,
+    MPU_ASYNC_DONE,
+    MPU_ASYNC_ERROR,
+};
+
+typedef void (*ImuAsyncFn)();
+
+void mpu_async_init(ImuAsyncFn on_complete);
+
+// 讀一筆暫存器快照
+MpuAsyncStatus mpu_read_sample_step(ImuSample &out, uint32_t now_ms);
+
+#if IMU_FIFO_MODE
+// 讀出 FIFO：先讀 FIFO_COUNT，再分批 burst 讀取；DONE 時 samples 為放入樣本環的筆數
+MpuAsyncStatus mpu_fifo_drain_step(uint32_t now_ms, int &samples);
+#endif
+
+uint32_t mpu_bus_errors();       // I2C 錯誤（NACK、匯流排錯誤、逾時）次數
+
+// 沒有進行中的非阻塞讀取（可安全做阻塞設定寫入）
+bool mpu_async_idle();
+#endif
+
+#endif // MPU6050_H
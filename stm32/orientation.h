@@ -0,0 +1,159 @@
+// 姿態估計：融合陀螺儀與加速度計，以 IMU 取樣率更新 roll/pitch（單位度數）
+//
+// ORIENTATION_FILTER：
+//   0 = 只用加速度計（原本的算法，擺動時受線性加速度影響）
+//   1 = 互補濾波（預設）：陀螺儀積分 + 加速度計緩慢修正；
+//       加速度大小偏離 1g 過多時（手杖擺動、敲擊）暫停加速度修正，只積分陀螺儀
+//   2 = Madgwick（IMU 版，6 軸）：四元數梯度下降，beta 控制加速度修正強度
+//
+// 角度定義與原本相同：roll = atan2(ay, az)，pitch = atan(-ax / sqrt(ay^2 + az^2))
+#ifndef ORIENTATION_H
+#define ORIENTATION_H
+
+#include <math.h>
+#include <stdint.h>
+
+#include "fast_math.h"
+
+#ifndef ORIENTATION_FILTER
+#define ORIENTATION_FILTER 1
+#endif
+
+const float GYRO_LSB_PER_DPS = 131.0f;     // ±250 dps
+const float ACCEL_LSB_PER_G = 16384.0f;    // ±2 g
+const float RAD_TO_DEG = 57.2958f;
+const float DEG_TO_RAD = 0.0174533f;
+
+struct OrientationFilter {
+    float roll_deg;
+    float pitch_deg;
+    float q0, q1, q2, q3;        // Madgwick 四元數
+    float tau_s;                 // 互補濾波時間常數（秒），陀螺儀權重 = tau / (tau + dt)
+    float beta;                  // Madgwick 增益
+    float accel_reject_g;        // 加速度大小偏離 1g 超過此值時不信任加速度計
+    float gyro_bias[3];          // 陀螺儀零偏（LSB），由校準填入
+    uint32_t last_t_ms;
+    bool initialized;
+};
+
+inline void orientation_init(OrientationFilter &f) {
+    f.roll_deg = 0.0f;
+    f.pitch_deg = 0.0f;
+    f.q0 = 1.0f; f.q1 = 0.0f; f.q2 = 0.0f; f.q3 = 0.0f;
+    f.tau_s = 0.25f;
+    f.beta = 0.1f;
+    f.accel_reject_g = 0.25f;
+    f.gyro_bias[0] = f.gyro_bias[1] = f.gyro_bias[2] = 0.0f;
+    f.last_t_ms = 0;
+    f.initialized = false;
+}
+
+// 只由加速度計求 roll/pitch（度）；分母 >= 0，atan(-ax / d) 與 atan2(-ax, d) 相同
+inline void accel_tilt(float ax, float ay, float az, float &roll_deg, float &pitch_deg) {
+    roll_deg = tilt_atan2(ay, az) * RAD_TO_DEG;
+    pitch_deg = tilt_atan2(-ax, tilt_sqrt(ay * ay + az * az)) * RAD_TO_DEG;
+}
+
+// 由加速度計角度設定四元數初值（yaw = 0）
+inline void orientation_seed(OrientationFilter &f, float roll_deg, float pitch_deg) {
+    float cr = cosf(roll_deg * DEG_TO_RAD * 0.5f), sr = sinf(roll_deg * DEG_TO_RAD * 0.5f);
+    float cp = cosf(pitch_deg * DEG_TO_RAD * 0.5f), sp = sinf(pitch_deg * DEG_TO_RAD * 0.5f);
+    f.q0 = cr * cp;
+    f.q1 = sr * cp;
+    f.q2 = cr * sp;
+    f.q3 = -sr * sp;
+}
+
+// Madgwick IMU 更新；g* 為 rad/s，a* 任意單位（內部正規化）
+inline void madgwick_update(OrientationFilter &f, float gx, float gy, float gz,
+                            float ax, float ay, float az, float dt) {
+    float q0 = f.q0, q1 = f.q1, q2 = f.q2, q3 = f.q3;
+    float qd0 = 0.5f * (-q1 * gx - q2 * gy - q3 * gz);
+    float qd1 = 0.5f * (q0 * gx + q2 * gz - q3 * gy);
+    float qd2 = 0.5f * (q0 * gy - q1 * gz + q3 * gx);
+    float qd3 = 0.5f * (q0 * gz + q1 * gy - q2 * gx);
+
+    float an = tilt_sqrt(ax * ax + ay * ay + az * az);
+    if (an > 0.0f) {
+        ax /= an; ay /= an; az /= an;
+        // 梯度下降修正步
+        float _2q0 = 2.0f * q0, _2q1 = 2.0f * q1, _2q2 = 2.0f * q2, _2q3 = 2.0f * q3;
+        float _4q0 = 4.0f * q0, _4q1 = 4.0f * q1, _4q2 = 4.0f * q2;
+        float _8q1 = 8.0f * q1, _8q2 = 8.0f * q2;
+        float q0q0 = q0 * q0, q1q1 = q1 * q1, q2q2 = q2 * q2, q3q3 = q3 * q3;
+        float s0 = _4q0 * q2q2 + _2q2 * ax + _4q0 * q1q1 - _2q1 * ay;
+        float s1 = _4q1 * q3q3 - _2q3 * ax + 4.0f * q0q0 * q1 - _2q0 * ay - _4q1 + _8q1 * q1q1 + _8q1 * q2q2 + _4q1 * az;
+        float s2 = 4.0f * q0q0 * q2 + _2q0 * ax + _4q2 * q3q3 - _2q3 * ay - _4q2 + _8q2 * q1q1 + _8q2 * q2q2 + _4q2 * az;
+        float s3 = 4.0f * q1q1 * q3 - _2q1 * ax + 4.0f * q2q2 * q3 - _2q2 * ay;
+        float sn = tilt_sqrt(s0 * s0 + s1 * s1 + s2 * s2 + s3 * s3);
+        if (sn > 0.0f) {
+            qd0 -= f.beta * s0 / sn;
+            qd1 -= f.beta * s1 / sn;
+            qd2 -= f.beta * s2 / sn;
+            qd3 -= f.beta * s3 / sn;
+        }
+    }
+
+    q0 += qd0 * dt; q1 += qd1 * dt; q2 += qd2 * dt; q3 += qd3 * dt;
+    float qn = tilt_sqrt(q0 * q0 + q1 * q1 + q2 * q2 + q3 * q3);
+    f.q0 = q0 / qn; f.q1 = q1 / qn; f.q2 = q2 / qn; f.q3 = q3 / qn;
+}
+
+// 以一筆原始樣本更新姿態；t_ms 為取樣時間
+inline void orientation_update(OrientationFilter &f, int16_t ax, int16_t ay, int16_t az,
+                               int16_t gx, int16_t gy, int16_t gz, uint32_t t_ms) {
+    float acc_roll, acc_pitch;
+    accel_tilt((float)ax, (float)ay, (float)az, acc_roll, acc_pitch);
+
+#if ORIENTATION_FILTER == 0
+    (void)gx; (void)gy; (void)gz; (void)t_ms;
+    f.roll_deg = acc_roll;
+    f.pitch_deg = acc_pitch;
+#else
+    if (!f.initialized) {
+        f.roll_deg = acc_roll;
+        f.pitch_deg = acc_pitch;
+        orientation_seed(f, acc_roll, acc_pitch);
+        f.last_t_ms = t_ms;
+        f.initialized = true;
+        return;
+    }
+    float dt = (t_ms - f.last_t_ms) * 0.001f;
+    f.last_t_ms = t_ms;
+    if (dt <= 0.0f || dt > 0.5f) dt = 0.005f;   // 時間異常（例如長時間未讀）時用名目週期
+
+    float gx_dps = ((float)gx - f.gyro_bias[0]) / GYRO_LSB_PER_DPS;
+    float gy_dps = ((float)gy - f.gyro_bias[1]) / GYRO_LSB_PER_DPS;
+    float gz_dps = ((float)gz - f.gyro_bias[2]) / GYRO_LSB_PER_DPS;
+
+#if ORIENTATION_FILTER == 1
+    (void)gz_dps;
+    float a_g = tilt_sqrt((float)ax * ax + (float)ay * ay + (float)az * az) / ACCEL_LSB_PER_G;
+    bool accel_ok = fabsf(a_g - 1.0f) < f.accel_reject_g;
+    float k = dt / (f.tau_s + dt);   // 加速度計修正比例，與取樣率無關
+    f.roll_deg += gx_dps * dt;
+    f.pitch_deg += gy_dps * dt;
+    if (accel_ok) {
+        // roll 跨越 ±180 時取最短差值，避免濾波跳變
+        float d_roll = acc_roll - f.roll_deg;
+        if (d_roll > 180.0f) d_roll -= 360.0f;
+        if (d_roll < -180.0f) d_roll += 360.0f;
+        f.roll_deg += k * d_roll;
+        f.pitch_deg += k * (acc_pitch - f.pitch_deg);
+    }
+    if (f.roll_deg > 180.0f) f.roll_deg -= 360.0f;
+    if (f.roll_deg < -180.0f) f.roll_deg += 360.0f;
+#else
+    madgwick_update(f, gx_dps * DEG_TO_RAD, gy_dps * DEG_TO_RAD, gz_dps * DEG_TO_RAD,
+                    (float)ax, (float)ay, (float)az, dt);
+    f.roll_deg = tilt_atan2(2.0f * (f.q0 * f.q1 + f.q2 * f.q3),
+                             1.0f - 2.0f * (f.q1 * f.q1 + f.q2 * f.q2)) * RAD_TO_DEG;
+    float sp = 2.0f * (f.q0 * f.q2 - f.q1 * f.q3);
+    if (sp > 1.0f) sp = 1.0f;
+    if (sp < -1.0f) sp = -1.0f;
+    f.pitch_deg = asinf(sp) * RAD_TO_DEG;
+#endif
+#endif
+}
+
+#endif // ORIENTATION_H
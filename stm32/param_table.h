@@ -0,0 +1,129 @@
+// 執行期參數表：警示門檻、輸出節奏、遙測速率等可由主機以指令訊框讀寫，不必重新燒錄
+//
+// 每個參數以 id（表中索引）存取，值一律以 float 傳輸，整數參數四捨五入後寫入；
+// 超出 [min, max] 的設定會被拒絕並回覆目前值。apply 在寫入後呼叫（主迴圈），
+// 用來同步衍生值（例如遙測週期、節奏步驟表）。設定只保存在 RAM，重新開機回到預設值。
+//
+// 指令（見 telemetry_frame.h 的 FRAME_CMD_*）：
+//   PARAM_GET  id          -> 回覆一個 PARAM 訊框；id = PARAM_ID_ALL 時依序回覆整個參數表
+//                             （ParamDump 記錄進度，param_dump_step 只送出輸出佇列放得下的部分，下次從下一個 id 繼續）
+//   PARAM_SET  id value    -> 回覆 PARAM 訊框（status 表示是否採用）
+#ifndef PARAM_TABLE_H
+#define PARAM_TABLE_H
+
+#include <math.h>
+#include <stdint.h>
+#include <string.h>
+#include "telemetry_frame.h"
+
+const uint8_t PARAM_ID_ALL = 0xFF;
+const int PARAM_NAME_MAX = 24;          // 回覆訊框內名稱的最大長度
+
+enum ParamKind {
+    PARAM_FLOAT = 0,
+    PARAM_INT,
+};
+
+enum ParamStatus {
+    PARAM_OK = 0,
+    PARAM_UNKNOWN_ID,
+    PARAM_OUT_OF_RANGE,
+    PARAM_BAD_REQUEST,      // 指令長度不符
+};
+
+struct ParamDef {
+    const char *name;
+    ParamKind kind;
+    void *value;            // float* 或 int*
+    float min;
+    float max;
+    void (*apply)();        // 寫入後呼叫，可為 NULL
+};
+
+inline float param_get(const ParamDef &d) {
+    return d.kind == PARAM_FLOAT ? *(float *)d.value : (float)*(int *)d.value;
+}
+
+inline ParamStatus param_set(const ParamDef &d, float v) {
+    if (!(v >= d.min && v <= d.max)) return PARAM_OUT_OF_RANGE;   // 同時拒絕 NaN
+    if (d.kind == PARAM_FLOAT) {
+        *(float *)d.value = v;
+    } else {
+        *(int *)d.value = (int)lroundf(v);
+    }
+    if (d.apply) d.apply();
+    return PARAM_OK;
+}
+
+// 回覆訊框：id | status | value | min | max | name
+inline size_t encode_param_frame(uint8_t id, ParamStatus status, const ParamDef *d, uint8_t *out) {
+    uint8_t payload[2 + 12 + PARAM_NAME_MAX];
+    uint8_t *p = payload;
+    *p++ = id;
+    *p++ = (uint8_t)status;
+    if (d) {
+        p = put_f32(p, param_get(*d));
+        p = put_f32(p, d->min);
+        p = put_f32(p, d->max);
+        size_t n = strlen(d->name);
+        if (n > (size_t)PARAM_NAME_MAX) n = PARAM_NAME_MAX;
+        memcpy(p, d->name, n);
+        p += n;
+    }
+    return frame_encode(FRAME_TYPE_PARAM, payload, (uint8_t)(p - payload), out);
+}
+
+// 處理一個指令訊框，回覆交給 send（可能多次呼叫）；不是參數指令時回傳 false
+typedef void (*FrameSendFn)(const uint8_t *buf, size_t len);
+
+// 整表回覆的進度：下一個要送出的 id，-1 表示沒有進行中的整表回覆
+struct ParamDump {
+    int next;
+};
+
+// 送出整表回覆中 space bytes 放得下的部分；回傳 true 表示尚未送完（呼叫端在佇列有空間後再呼叫）
+inline bool param_dump_step(ParamDump &dump, const ParamDef *table, int count, size_t space, FrameSendFn send) {
+    uint8_t buf[FRAME_MAX_LEN];
+    while (dump.next >= 0 && dump.next < count) {
+        size_t n = encode_param_frame((uint8_t)dump.next, PARAM_OK, &table[dump.next], buf);
+        if (n > space) return true;
+        send(buf, n);
+        space -= n;
+        dump.next++;
+    }
+    dump.next = -1;
+    return false;
+}
+
+// PARAM_GET ALL 只從 id 0 開始（重新）記錄進度，實際回覆由 param_dump_step 送出
+inline bool param_handle_command(const ParamDef *table, int count, uint8_t type, const uint8_t *payload,
+                                 uint8_t len, FrameSendFn send, ParamDump &dump) {
+    uint8_t buf[FRAME_MAX_LEN];
+    if (type == FRAME_CMD_PARAM_GET) {
+        if (len != 1) {
+            send(buf, encode_param_frame(0xFF, PARAM_BAD_REQUEST, NULL, buf));
+        } else if (payload[0] == PARAM_ID_ALL) {
+            dump.next = 0;
+        } else if (payload[0] < count) {
+            send(buf, encode_param_frame(payload[0], PARAM_OK, &table[payload[0]], buf));
+        } else {
+            send(buf, encode_param_frame(payload[0], PARAM_UNKNOWN_ID, NULL, buf));
+        }
+        return true;
+    }
+    if (type == FRAME_CMD_PARAM_SET) {
+        if (len != 5) {
+            send(buf, encode_param_frame(len > 0 ? payload[0] : 0xFF, PARAM_BAD_REQUEST, NULL, buf));
+        } else if (payload[0] >= count) {
+            send(buf, encode_param_frame(payload[0], PARAM_UNKNOWN_ID, NULL, buf));
+        } else {
+            const ParamDef &d = table[payload[0]];
+            ParamStatus st = param_set(d, get_f32(payload + 1));
+            send(buf, encode_param_frame(payload[0], st, &d, buf));
+        }
+        return true;
+    }
+    return false;
+}
+
+#endif // PARAM_TABLE_H
@@ -0,0 +1,96 @@
+#include "mbed.h"
+#include "pattern_engine.h"
+
+struct PatternChannel {
+    PatternOutputFn out;
+    const Pattern *pattern;
+    uint8_t step;
+    bool active;
+    uint32_t next_edge_us;   // 目前步驟結束的絕對時間（us_ticker）
+};
+
+static PatternChannel channels[PATTERN_MAX_CHANNELS];
+static int channel_count = 0;
+static Timeout edge_timeout;
+
+static void on_edge();
+
+// 進入下一步；呼叫端需在中斷內或臨界區
+static void advance(PatternChannel &c) {
+    c.step++;
+    if (c.step >= c.pattern->count) {
+        if (!c.pattern->repeat) {
+            c.active = false;
+            c.out(0);
+            return;
+        }
+        c.step = 0;
+    }
+    const PatternStep &s = c.pattern->steps[c.step];
+    c.out(s.level);
+    c.next_edge_us += (uint32_t)s.duration_ms * 1000u;
+}
+
+// 依所有通道最近的邊緣重新設定 Timeout
+static void schedule_next() {
+    uint32_t now = us_ticker_read();
+    bool any = false;
+    int32_t min_delay = 0;
+    for (int i = 0; i < channel_count; i++) {
+        if (!channels[i].active) continue;
+        int32_t d = (int32_t)(channels[i].next_edge_us - now);
+        if (!any || d < min_delay) min_delay = d;
+        any = true;
+    }
+    edge_timeout.detach();
+    if (any) edge_timeout.attach_us(&on_edge, min_delay > 0 ? (uint32_t)min_delay : 0);
+}
+
+static void on_edge() {
+    uint32_t now = us_ticker_read();
+    for (int i = 0; i < channel_count; i++) {
+        PatternChannel &c = channels[i];
+        // 中斷延遲較長時一次補上所有已過的邊緣
+        while (c.active && (int32_t)(c.next_edge_us - now) <= 0) advance(c);
+    }
+    schedule_next();
+}
+
+int pattern_channel_add(PatternOutputFn out) {
+    if (channel_count >= PATTERN_MAX_CHANNELS) return -1;
+    PatternChannel &c = channels[channel_count];
+    c.out = out;
+    c.pattern = NULL;
+    c.step = 0;
+    c.active = false;
+    c.next_edge_us = 0;
+    out(0);
+    return channel_count++;
+}
+
+void pattern_play(int ch, const Pattern &p) {
+    if (ch < 0 || ch >= channel_count || p.count == 0) return;
+    core_util_critical_section_enter();
+    PatternChannel &c = channels[ch];
+    c.pattern = &p;
+    c.step = 0;
+    c.active = true;
+    c.out(p.steps[0].level);
+    c.next_edge_us = us_ticker_read() + (uint32_t)p.steps[0].duration_ms * 1000u;
+    schedule_next();
+    core_util_critical_section_exit();
+}
+
+void pattern_stop(int ch) {
+    if (ch < 0 || ch >= channel_count) return;
+    core_util_critical_section_enter();
+    channels[ch].active = false;
+    channels[ch].out(0);
+    schedule_next();
+    core_util_critical_section_exit();
+}
+
+bool pattern_active(int ch) {
+    if (ch < 0 || ch >= channel_count) return false;
+    return channels[ch].active;
+}
@@ -0,0 +1,44 @@
+// 輸出節奏引擎：蜂鳴器、馬達、心跳燈等輸出以 (level, duration) 步驟表描述
+// 所有通道共用一個 Timeout，只在「最近的下一個邊緣」觸發中斷，
+// 邊緣時間以 us_ticker 絕對時間累加，節奏不受主迴圈負載影響也不會累積誤差
+#ifndef PATTERN_ENGINE_H
+#define PATTERN_ENGINE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+const int PATTERN_MAX_CHANNELS = 4;
+
+// level：0 = 關，其他 = 開（PWM 通道可當作強度 1..255）；duration_ms 需大於 0
+struct PatternStep {
+    uint8_t level;
+    uint16_t duration_ms;
+};
+
+struct Pattern {
+    const PatternStep *steps;
+    uint8_t count;
+    bool repeat;         // true = 循環播放，false = 播完後輸出 0 並停止
+};
+
+template <size_t N>
+constexpr Pattern make_pattern(const PatternStep (&steps)[N], bool repeat) {
+    return Pattern{steps, (uint8_t)N, repeat};
+}
+
+// 通道輸出函式：在中斷內呼叫，只應寫入腳位
+typedef void (*PatternOutputFn)(uint8_t level);
+
+// 註冊一個輸出通道（開機時呼叫），回傳通道編號，滿了回傳 -1
+int pattern_channel_add(PatternOutputFn out);
+
+// 從第一步開始播放（正在播放的節奏會被取代）；p 需為靜態儲存（例如 constexpr 全域表）
+void pattern_play(int ch, const Pattern &p);
+
+// 停止並輸出 0
+void pattern_stop(int ch);
+
+// 是否正在播放（一次性節奏播完後為 false）
+bool pattern_active(int ch);
+
+#endif // PATTERN_ENGINE_H
@@ -0,0 +1,77 @@
+#include "mbed.h"
+#include "power_manager.h"
+
+static PowerMode current_mode = POWER_ACTIVE;
+static PowerModeStats mode_stats[POWER_MODE_COUNT];
+static uint32_t mode_since_ms = 0;
+static uint64_t sleep_mark_us = 0;        // 進入目前模式時的累計 Sleep / Stop 時間
+static uint64_t deep_sleep_mark_us = 0;
+
+static void read_sleep_us(uint64_t &sleep_us, uint64_t &deep_sleep_us) {
+#if MBED_CPU_STATS_ENABLED
+    mbed_stats_cpu_t cpu;
+    mbed_stats_cpu_get(&cpu);
+    sleep_us = cpu.sleep_time;
+    deep_sleep_us = cpu.deep_sleep_time;
+#else
+    sleep_us = 0;
+    deep_sleep_us = 0;
+#endif
+}
+
+// 目前這段時間（自進入目前模式起）加到 out
+static void add_current_span(uint32_t now_ms, PowerModeStats &out) {
+    uint64_t sleep_us, deep_sleep_us;
+    read_sleep_us(sleep_us, deep_sleep_us);
+    out.time_ms += now_ms - mode_since_ms;
+    out.sleep_us += sleep_us - sleep_mark_us;
+    out.deep_sleep_us += deep_sleep_us - deep_sleep_mark_us;
+}
+
+void power_init(uint32_t now_ms) {
+    for (int i = 0; i < POWER_MODE_COUNT; i++) {
+        mode_stats[i].entries = 0;
+        mode_stats[i].time_ms = 0;
+        mode_stats[i].sleep_us = 0;
+        mode_stats[i].deep_sleep_us = 0;
+    }
+    current_mode = POWER_ACTIVE;
+    mode_stats[POWER_ACTIVE].entries = 1;
+    mode_since_ms = now_ms;
+    read_sleep_us(sleep_mark_us, deep_sleep_mark_us);
+}
+
+void power_set_mode(PowerMode mode, uint32_t now_ms) {
+    if (mode == current_mode) return;
+    add_current_span(now_ms, mode_stats[current_mode]);
+    current_mode = mode;
+    mode_stats[mode].entries++;
+    mode_since_ms = now_ms;
+    read_sleep_us(sleep_mark_us, deep_sleep_mark_us);
+}
+
+PowerMode power_mode() {
+    return current_mode;
+}
+
+void power_stats(PowerMode mode, uint32_t now_ms, PowerModeStats &out) {
+    out = mode_stats[mode];
+    if (mode == current_mode) add_current_span(now_ms, out);
+}
+
+float power_estimate_ma(PowerMode mode, uint32_t now_ms) {
+    PowerModeStats s;
+    power_stats(mode, now_ms, s);
+    if (s.time_ms == 0) return 0.0f;
+    float total_us = (float)s.time_ms * 1000.0f;
+    float sleep = (float)s.sleep_us / total_us;
+    float deep = (float)s.deep_sleep_us / total_us;
+    if (sleep + deep > 1.0f) deep = 1.0f - sleep;   // 計時來源不同，避免些微超過 100%
+    float run = 1.0f - sleep - deep;
+    float mcu = POWER_RUN_MA * run + POWER_SLEEP_MA * sleep + POWER_STOP_MA * deep;
+    return mcu + (mode == POWER_ACTIVE ? POWER_PERIPH_ACTIVE_MA : POWER_PERIPH_STATIONARY_MA);
+}
+
+bool power_deep_sleep_allowed() {
+    return sleep_manager_can_deep_sleep();
+}
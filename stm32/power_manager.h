@@ -0,0 +1,68 @@
+// 電源管理：依手杖是否靜止切換工作模式，統計各模式的停留時間、睡眠比例與估計電流
+//
+// 活動模式：正常取樣率，任務之間由 RTOS idle 進入 Sleep（WFI）
+// 靜止模式：MPU6050 降速並改以動作偵測中斷喚醒，測距/IMU 降頻、心跳燈關閉，
+//           沒有驅動程式鎖住 deep sleep 時 RTOS idle 會進入 Stop
+//
+// 睡眠比例需在 mbed_app.json 開啟 "platform.cpu-stats-enabled"，否則只統計停留時間。
+// 估計電流 = MCU 各狀態電流 × 時間比例 + 周邊電流；預設值為資料手冊典型值，
+// 請以電流表串接電池實測各模式後覆寫 POWER_*_MA，回報即為該裝置的實際耗電
+#ifndef POWER_MANAGER_H
+#define POWER_MANAGER_H
+
+#include <stdint.h>
+
+// 1 = 靜止時自動切換省電模式（預設，需 IMU_FIFO_MODE），0 = 永遠為活動模式
+#ifndef POWER_MANAGEMENT
+#define POWER_MANAGEMENT 1
+#endif
+
+// STM32F401 @84MHz：執行 / Sleep / Stop（低功耗穩壓器）
+#ifndef POWER_RUN_MA
+#define POWER_RUN_MA 12.0f
+#endif
+#ifndef POWER_SLEEP_MA
+#define POWER_SLEEP_MA 5.0f
+#endif
+#ifndef POWER_STOP_MA
+#define POWER_STOP_MA 0.05f
+#endif
+// 周邊：活動模式 MPU6050 3.9mA + HC-SR04 約 4mA（20ms 間隔觸發）；靜止模式測距降頻
+#ifndef POWER_PERIPH_ACTIVE_MA
+#define POWER_PERIPH_ACTIVE_MA 8.0f
+#endif
+#ifndef POWER_PERIPH_STATIONARY_MA
+#define POWER_PERIPH_STATIONARY_MA 5.5f
+#endif
+
+enum PowerMode {
+    POWER_ACTIVE = 0,
+    POWER_STATIONARY,
+    POWER_MODE_COUNT,
+};
+
+const char *const POWER_MODE_NAMES[POWER_MODE_COUNT] = {"active", "stationary"};
+
+struct PowerModeStats {
+    uint32_t entries;
+    uint64_t time_ms;          // 停留時間
+    uint64_t sleep_us;         // 其中 Sleep 的時間（需 CPU stats）
+    uint64_t deep_sleep_us;    // 其中 Stop 的時間（需 CPU stats）
+};
+
+void power_init(uint32_t now_ms);
+
+// 切換模式並把目前這段時間計入舊模式
+void power_set_mode(PowerMode mode, uint32_t now_ms);
+PowerMode power_mode();
+
+// 取得某模式的累計統計（含目前這段尚未結算的時間）
+void power_stats(PowerMode mode, uint32_t now_ms, PowerModeStats &out);
+
+// 估計該模式的平均電流（mA）：POWER_*_MA 常數乘上實測的 Sleep/Stop 比例，並非量測值；沒有停留時間時回傳 0
+float power_estimate_ma(PowerMode mode, uint32_t now_ms);
+
+// 目前沒有驅動程式鎖住 deep sleep（RTOS idle 可進入 Stop）
+bool power_deep_sleep_allowed();
+
+#endif // POWER_MANAGER_H
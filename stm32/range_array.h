@@ -0,0 +1,85 @@
+// 超音波感測器陣列：每個感測器一個通道（Trig 腳 + Echo 捕捉槽），輪流觸發
+//
+// 同一時間只有一個感測器在量測，上一個完成（收到回波或逾時）後間隔 stagger 才觸發下一個，
+// 其他感測器不會收到彼此的殘響；每個通道另外遵守自己的最小觸發間隔。
+// 警示邏輯讀取每個通道的濾波距離（距離向量），依感測器用途判斷：
+//   RANGE_GROUND  向下斜照地面，距離「變大」超過零點 + 門檻為下陷/坑洞（經傾斜補償）
+//   RANGE_FORWARD 朝前方，距離小於門檻為前方障礙物
+#ifndef RANGE_ARRAY_H
+#define RANGE_ARRAY_H
+
+#include <stdint.h>
+#include "distance_filter.h"
+#include "scheduler.h"
+
+// 感測器數量：1 = 只有地面感測器（PB8/PA0），2 = 加上前方感測器（PB9/PB10）
+#ifndef RANGE_CHANNELS
+#define RANGE_CHANNELS 1
+#endif
+
+enum RangeRole {
+    RANGE_GROUND = 0,
+    RANGE_FORWARD,
+};
+
+struct RangeChannel {
+    const char *name;
+    RangeRole role;
+    uint32_t echo_us;        // 上一次量測的回波時間（0 表示無回波）
+    float distance_cm;       // 原始距離
+    uint32_t capture_us;     // 上一次量測完成的時間（us_ticker，延遲追蹤用）
+    float filt_cm;           // 濾波後距離（DISTANCE_FILTER=0 時等於原始距離；中值視窗未滿時為 -1）
+    DistanceFilter filter;
+    uint32_t trigger_ms;     // 上一次觸發時間
+    uint32_t count;          // 完成的量測次數
+    uint32_t timeouts;       // 逾時（無回波）次數
+};
+
+inline void range_channel_init(RangeChannel &c, const char *name, RangeRole role) {
+    c.name = name;
+    c.role = role;
+    c.echo_us = 0;
+    c.distance_cm = 0.0f;
+    c.capture_us = 0;
+    c.filt_cm = 0.0f;
+    distance_filter_init(c.filter);
+    c.trigger_ms = 0;
+    c.count = 0;
+    c.timeouts = 0;
+}
+
+// 一次量測完成：記錄回波（0 表示無回波）並更新濾波距離；motion_dps 為目前角速度大小
+inline void range_channel_record(RangeChannel &c, uint32_t echo_us, float motion_dps, uint32_t t_ms) {
+    c.count++;
+    c.echo_us = echo_us;
+    c.distance_cm = echo_us * 0.017f;  // 340 m/s -> us to cm
+#if DISTANCE_FILTER
+    if (echo_us > 0) {
+        c.filt_cm = distance_filter_update(c.filter, c.distance_cm, motion_dps, t_ms);
+    } else {
+        distance_filter_miss(c.filter, motion_dps, t_ms);
+    }
+#else
+    (void)motion_dps; (void)t_ms;
+    c.filt_cm = c.distance_cm;
+#endif
+}
+
+// 下一個通道最早可觸發的時間：自己的最小間隔，以及與上一次完成相隔 stagger_ms
+inline uint32_t range_next_due(const RangeChannel &next, uint32_t interval_ms,
+                               uint32_t last_done_ms, uint32_t stagger_ms) {
+    uint32_t due = next.trigger_ms + interval_ms;
+    uint32_t gap = last_done_ms + stagger_ms;
+    return time_reached(due, gap) ? due : gap;
+}
+
+// 通道超過警示門檻的量（cm，> 0 表示危險）；無回波或濾波尚未有效視為安全
+//   cos_pitch：地面感測器的傾斜補償；ground_zero_cm：校準的地面距離零點
+inline float range_excess_cm(const RangeChannel &c, float cos_pitch, float ground_zero_cm,
+                             float drop_margin_cm, float obstacle_cm) {
+    if (c.echo_us == 0 || c.filt_cm < 0.0f) return -1.0f;
+    if (c.role == RANGE_FORWARD) return obstacle_cm - c.filt_cm;
+    return (c.filt_cm * cos_pitch - ground_zero_cm) - drop_margin_cm;
+}
+
+#endif // RANGE_ARRAY_H
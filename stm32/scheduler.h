@@ -0,0 +1,120 @@
+// 協作式排程器：固定大小任務表，每個任務有自己的週期與截止時間
+// 任務在主迴圈中依加入順序（即優先順序）執行，不可搶佔；
+// 超過截止時間仍未完成視為 missed，落後整個週期時直接跳過並計入 missed，不補跑
+// 週期為 0 的任務為事件任務：執行一次後停止，需由 release_at() 再次釋放
+#ifndef SCHEDULER_H
+#define SCHEDULER_H
+
+#include <stdint.h>
+
+typedef void (*TaskFn)();
+typedef uint32_t (*ClockFn)();   // 回傳毫秒時間（允許溢位回繞）
+
+struct Task {
+    const char *name;
+    TaskFn fn;
+    uint32_t period_ms;      // 0 表示事件任務
+    uint32_t deadline_ms;    // 相對於釋放時間，需在此時間內完成
+    uint32_t release_ms;     // 下一次釋放時間
+    bool pending;            // 是否已釋放等待執行（週期任務恆為 true）
+    uint32_t runs;
+    uint32_t missed;         // 錯過截止時間次數（含跳過的週期）
+    uint32_t max_late_ms;    // 最大啟動延遲（釋放到開始執行）
+};
+
+// 回繞安全的時間比較：a 是否已到達 b
+inline bool time_reached(uint32_t a, uint32_t b) {
+    return (int32_t)(a - b) >= 0;
+}
+
+template <int MAX_TASKS>
+class Scheduler {
+public:
+    explicit Scheduler(ClockFn clock) : clock_(clock), count_(0) {}
+
+    // 加入任務，offset_ms 為第一次釋放的延遲；回傳任務索引，表滿回傳 -1
+    int add(const char *name, TaskFn fn, uint32_t period_ms, uint32_t deadline_ms,
+            uint32_t offset_ms = 0) {
+        if (count_ >= MAX_TASKS) return -1;
+        Task &t = tasks_[count_];
+        t.name = name;
+        t.fn = fn;
+        t.period_ms = period_ms;
+        t.deadline_ms = deadline_ms;
+        t.release_ms = clock_() + offset_ms;
+        t.pending = true;
+        t.runs = 0;
+        t.missed = 0;
+        t.max_late_ms = 0;
+        return count_++;
+    }
+
+    // 執行所有已到期的任務，回傳本次執行的任務數
+    int run_due() {
+        int ran = 0;
+        for (int i = 0; i < count_; i++) {
+            Task &t = tasks_[i];
+            uint32_t start = clock_();
+            if (!t.pending || !time_reached(start, t.release_ms)) continue;
+
+            uint32_t released = t.release_ms;
+            uint32_t late = start - released;
+            if (late > t.max_late_ms) t.max_late_ms = late;
+            if (t.period_ms == 0) t.pending = false;   // 事件任務可在 fn 內重新 release_at()
+            t.fn();
+            t.runs++;
+            ran++;
+            if (clock_() - released > t.deadline_ms) t.missed++;
+            if (t.period_ms == 0) continue;
+
+            // 下一次釋放；若已落後一個以上週期，跳過並計入 missed
+            t.release_ms += t.period_ms;
+            uint32_t now = clock_();
+            if (time_reached(now, t.release_ms)) {
+                uint32_t skipped = (now - t.release_ms) / t.period_ms + 1;
+                t.missed += skipped;
+                t.release_ms += skipped * t.period_ms;
+            }
+        }
+        return ran;
+    }
+
+    // 距離下一個任務釋放的毫秒數（0 表示已有任務到期）
+    uint32_t ms_until_next() const {
+        if (count_ == 0) return 0;
+        uint32_t now = clock_();
+        uint32_t best = UINT32_MAX;
+        for (int i = 0; i < count_; i++) {
+            if (!tasks_[i].pending) continue;
+            if (time_reached(now, tasks_[i].release_ms)) return 0;
+            uint32_t wait = tasks_[i].release_ms - now;
+            if (wait < best) best = wait;
+        }
+        return best;
+    }
+
+    // 在 at_ms 釋放任務（事件任務用；週期任務則改變下一次釋放時間）
+    // 只能在主迴圈呼叫，中斷請改用旗標通知主迴圈
+    void release_at(int index, uint32_t at_ms) {
+        if (index < 0 || index >= count_) return;
+        tasks_[index].release_ms = at_ms;
+        tasks_[index].pending = true;
+    }
+
+    // 改變週期任務的週期與截止時間（例如省電模式降低頻率），下一次釋放時間不變
+    void set_period(int index, uint32_t period_ms, uint32_t deadline_ms) {
+        if (index < 0 || index >= count_ || tasks_[index].period_ms == 0 || period_ms == 0) return;
+        tasks_[index].period_ms = period_ms;
+        tasks_[index].deadline_ms = deadline_ms;
+    }
+
+    int count() const { return count_; }
+    const Task &task(int index) const { return tasks_[index]; }
+
+private:
+    ClockFn clock_;
+    Task tasks_[MAX_TASKS];
+    int count_;
+};
+
+#endif // SCHEDULER_H
@@ -0,0 +1,57 @@
+// 單一生產者 / 單一消費者環形緩衝區：中斷（或主迴圈某一端）寫入，主迴圈讀出，不需臨界區
+// 容量於編譯期固定（N 必須為 2 的次方），不使用 heap；滿了捨棄新資料並計數
+// head 只由生產者寫、tail 只由消費者寫；單核心 Cortex-M 只需編譯器屏障確保資料先於索引寫入
+#ifndef SPSC_RING_H
+#define SPSC_RING_H
+
+#include <atomic>
+#include <stddef.h>
+#include <stdint.h>
+
+template <typename T, size_t N>
+class SpscRing {
+    static_assert(N >= 2 && (N & (N - 1)) == 0, "SpscRing size must be a power of two");
+
+public:
+    SpscRing() : head_(0), tail_(0), dropped_(0) {}
+
+    // 生產者呼叫；滿了回傳 false 並計入 dropped()
+    bool push(const T &v) {
+        uint32_t head = head_;
+        if (head - tail_ >= N) {
+            dropped_ = dropped_ + 1;
+            return false;
+        }
+        buf_[head & (N - 1)] = v;
+        std::atomic_signal_fence(std::memory_order_release);   // 資料寫入後才發布 head
+        head_ = head + 1;
+        return true;
+    }
+
+    // 消費者呼叫
+    bool pop(T &out) {
+        uint32_t tail = tail_;
+        if (tail == head_) return false;
+        std::atomic_signal_fence(std::memory_order_acquire);
+        out = buf_[tail & (N - 1)];
+        std::atomic_signal_fence(std::memory_order_release);   // 讀完才釋放槽位
+        tail_ = tail + 1;
+        return true;
+    }
+
+    // 消費者呼叫：丟棄目前所有資料
+    void clear() { tail_ = head_; }
+
+    bool empty() const { return head_ == tail_; }
+    size_t size() const { return (size_t)(head_ - tail_); }
+    static size_t capacity() { return N; }
+    uint32_t dropped() const { return dropped_; }
+
+private:
+    T buf_[N];
+    volatile uint32_t head_;      // 累計寫入數（生產者）
+    volatile uint32_t tail_;      // 累計讀出數（消費者）
+    volatile uint32_t dropped_;
+};
+
+#endif // SPSC_RING_H
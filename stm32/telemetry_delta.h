@@ -0,0 +1,130 @@
+// 差量遙測：定期送完整取樣（關鍵訊框，即 FRAME_TYPE_SAMPLE），其餘只送與「上一個已送出狀態」的差
+//
+// 差量訊框（FRAME_TYPE_DELTA）payload：
+//   seq(u16) | ref(u8) | dt_ms(varint) | mask(u8) | 各欄位差量(zigzag varint)... | flags(u8，mask bit 7)
+//   ref 為參考訊框序號的低 8 位元，主機端與自己最後套用的序號不符時（中間遺失）丟棄到下一個關鍵訊框
+//   mask bit 0..5 = ax ay az gx gy gz，bit 6 = echo_us，bit 7 = flags
+// 變化小於死區的欄位不送，主機端沿用舊值；參考值只在送出時更新，誤差不會累積、最多為死區大小。
+// 所有欄位都沒有變化時整個訊框不送（靜止時只剩關鍵訊框）。
+// 警示狀態變化另以事件訊框（FRAME_TYPE_EVENT）立即送出，不等下一個遙測週期。
+#ifndef TELEMETRY_DELTA_H
+#define TELEMETRY_DELTA_H
+
+#include <stdint.h>
+#include <stdlib.h>
+#include "telemetry_frame.h"
+
+// 1 = 預設使用差量遙測（可由參數表 telemetry_delta 切換），0 = 每筆都送完整取樣
+#ifndef TELEMETRY_DELTA
+#define TELEMETRY_DELTA 1
+#endif
+
+const uint8_t DELTA_FIELD_ECHO = 6;
+const uint8_t DELTA_MASK_FLAGS = 1 << 7;
+
+// 事件訊框 payload：t_ms(u32) | event(u8) | flags(u8，事件當下的 SAMPLE_FLAG_*)
+enum TelemetryEvent {
+    EVENT_HIT_START = 1,
+    EVENT_HIT_STOP,
+    EVENT_CALIBRATED,
+    EVENT_CALIB_REJECTED,
+    EVENT_COOLDOWN_START,
+    EVENT_COOLDOWN_END,
+};
+
+struct DeltaPolicy {
+    uint32_t keyframe_ms;       // 關鍵訊框間隔
+    uint16_t imu_deadband;      // IMU 原始值死區（LSB）
+    uint16_t echo_deadband_us;  // 回波時間死區（58us 約 1cm）
+};
+
+struct DeltaEncoder {
+    SampleFrame ref;            // 主機端目前持有的狀態
+    bool has_ref;
+    uint32_t keyframe_ms;       // 上一個關鍵訊框時間
+    uint32_t keyframes;         // 統計：關鍵 / 差量 / 省略的訊框數
+    uint32_t deltas;
+    uint32_t skipped;
+};
+
+inline void delta_encoder_init(DeltaEncoder &e) {
+    e.has_ref = false;
+    e.keyframe_ms = 0;
+    e.keyframes = 0;
+    e.deltas = 0;
+    e.skipped = 0;
+}
+
+inline uint8_t *put_varint(uint8_t *p, uint32_t v) {
+    while (v >= 0x80) {
+        *p++ = (uint8_t)(v | 0x80);
+        v >>= 7;
+    }
+    *p++ = (uint8_t)v;
+    return p;
+}
+
+inline uint32_t zigzag(int32_t v) {
+    return ((uint32_t)v << 1) ^ (uint32_t)(v >> 31);
+}
+
+// 編碼一筆取樣：回傳訊框長度，0 表示沒有變化不必送出
+// 差量訊框不比完整取樣小時改送關鍵訊框
+inline size_t delta_encode(DeltaEncoder &e, const SampleFrame &s, const DeltaPolicy &pol, uint8_t *out) {
+    if (e.has_ref && (uint32_t)(s.t_ms - e.keyframe_ms) < pol.keyframe_ms) {
+        const int16_t *cur[6] = {&s.ax, &s.ay, &s.az, &s.gx, &s.gy, &s.gz};
+        int16_t *ref[6] = {&e.ref.ax, &e.ref.ay, &e.ref.az, &e.ref.gx, &e.ref.gy, &e.ref.gz};
+        uint8_t payload[FRAME_MAX_PAYLOAD];
+        uint8_t *p = put_u16(payload, s.seq);
+        *p++ = (uint8_t)e.ref.seq;
+        p = put_varint(p, s.t_ms - e.ref.t_ms);
+        uint8_t *mask = p++;
+        *mask = 0;
+        int32_t diff[7];
+        for (int i = 0; i < 6; i++) {
+            diff[i] = (int32_t)*cur[i] - *ref[i];
+            if (abs(diff[i]) > pol.imu_deadband) *mask |= 1 << i;
+        }
+        diff[DELTA_FIELD_ECHO] = (int32_t)s.echo_us - e.ref.echo_us;
+        // 有無回波的切換一定送出
+        if (abs(diff[DELTA_FIELD_ECHO]) > pol.echo_deadband_us || (s.echo_us == 0) != (e.ref.echo_us == 0)) {
+            *mask |= 1 << DELTA_FIELD_ECHO;
+        }
+        if (s.flags != e.ref.flags) *mask |= DELTA_MASK_FLAGS;
+        if (*mask == 0) {
+            e.skipped++;
+            return 0;
+        }
+        for (int i = 0; i <= DELTA_FIELD_ECHO; i++) {
+            if (*mask & (1 << i)) p = put_varint(p, zigzag(diff[i]));
+        }
+        if (*mask & DELTA_MASK_FLAGS) *p++ = s.flags;
+        uint8_t len = (uint8_t)(p - payload);
+        if (len < SAMPLE_PAYLOAD_LEN) {
+            for (int i = 0; i < 6; i++) {
+                if (*mask & (1 << i)) *ref[i] = *cur[i];
+            }
+            if (*mask & (1 << DELTA_FIELD_ECHO)) e.ref.echo_us = s.echo_us;
+            e.ref.flags = s.flags;
+            e.ref.seq = s.seq;
+            e.ref.t_ms = s.t_ms;
+            e.deltas++;
+            return frame_encode(FRAME_TYPE_DELTA, payload, len, out);
+        }
+    }
+    e.ref = s;
+    e.has_ref = true;
+    e.keyframe_ms = s.t_ms;
+    e.keyframes++;
+    return encode_sample_frame(s, out);
+}
+
+inline size_t encode_event_frame(uint32_t t_ms, TelemetryEvent ev, uint8_t flags, uint8_t *out) {
+    uint8_t payload[6];
+    uint8_t *p = put_u32(payload, t_ms);
+    *p++ = (uint8_t)ev;
+    *p++ = flags;
+    return frame_encode(FRAME_TYPE_EVENT, payload, (uint8_t)(p - payload), out);
+}
+
+#endif // TELEMETRY_DELTA_H
@@ -0,0 +1,276 @@
+// 二進位遙測訊框（STM32 -> ESP32 -> PC），以及反方向的指令訊框（PC -> ESP32 -> STM32）
+//
+// 訊框格式（多位元組欄位皆為 little-endian）：
+//   0xA5 0x5A | type(1) | len(1) | payload[len] | crc16(2)
+// CRC16-CCITT（多項式 0x1021，初值 0xFFFF），計算範圍為 type、len 與 payload。
+// 同步字元 0xA5 不會出現在 ASCII 文字中，因此啟動訊息等文字行可與訊框混傳。
+// 指令訊框格式相同，type 使用 0x80 以上（見 FRAME_CMD_*），由 FrameParser 逐位元組解析。
+#ifndef TELEMETRY_FRAME_H
+#define TELEMETRY_FRAME_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+const uint8_t FRAME_SYNC0 = 0xA5;
+const uint8_t FRAME_SYNC1 = 0x5A;
+const int FRAME_HEADER_LEN = 4;              // sync0 sync1 type len
+const int FRAME_CRC_LEN = 2;
+const int FRAME_MAX_PAYLOAD = 96;
+const int FRAME_MAX_LEN = FRAME_HEADER_LEN + FRAME_MAX_PAYLOAD + FRAME_CRC_LEN;
+
+// 訊框種類
+const uint8_t FRAME_TYPE_SAMPLE = 0x01;      // 感測器取樣（SampleFrame）
+const uint8_t FRAME_TYPE_PROFILE = 0x02;     // 熱路徑週期統計（見 cycle_profile.h）
+const uint8_t FRAME_TYPE_RANGES = 0x03;      // 多感測器回波時間：n | n × echo_us(u16)，通道 0 同 SampleFrame
+// 0x04 保留給 ESP32 的斷線暫存訊框（BACKLOG，見 esp32/esp32_wifi_tcp.cpp），STM32 不會送出
+const uint8_t FRAME_TYPE_PARAM = 0x05;       // 參數回覆：id | status | value(f32) | min(f32) | max(f32) | name
+const uint8_t FRAME_TYPE_DELTA = 0x06;       // 差量取樣（見 telemetry_delta.h）
+const uint8_t FRAME_TYPE_EVENT = 0x07;       // 警示 / 校準事件：t_ms(u32) | event | flags
+const uint8_t FRAME_TYPE_SYNC = 0x08;        // 時鐘同步回覆：token(u32) | source | rx_us(u32) | tx_us(u32)
+const uint8_t FRAME_TYPE_TRACE = 0x09;       // 延遲追蹤：seq(u16) | capture_us(u32) | tx_us(u32)（us_ticker）
+// 0x0A 保留給 ESP32 的批次追蹤訊框（ESP_TRACE：rx_us | tx_us，見 esp32/esp32_wifi_tcp.cpp）
+// 0x0B 保留給 ESP32 連線時的識別訊框（HELLO：mac[6] | connects(u32)）
+const uint8_t SYNC_SOURCE_STM32 = 0;
+const uint8_t SYNC_SOURCE_ESP32 = 1;
+
+// 指令（PC -> STM32），參數表見 param_table.h
+const uint8_t FRAME_CMD_PARAM_GET = 0x81;    // id；PARAM_ID_ALL = 列出整個參數表
+const uint8_t FRAME_CMD_PARAM_SET = 0x82;    // id | value(f32)，回覆設定後的值
+const uint8_t FRAME_CMD_TIME_SYNC = 0x83;    // token(u32)，STM32 以 SYNC 訊框回覆收到與回覆時的 us_ticker
+const uint8_t FRAME_CMD_TIME_SYNC_ESP = 0x84; // 同上，由 ESP32 攔截回覆（不轉送給 STM32）
+
+// SampleFrame.flags 位元
+const uint8_t SAMPLE_FLAG_ECHO_VALID = 1 << 0;  // 本次有收到回波
+const uint8_t SAMPLE_FLAG_MPU_OK     = 1 << 1;  // MPU6050 讀取成功
+const uint8_t SAMPLE_FLAG_HIT        = 1 << 2;  // 已達連續觸發次數（警示中）
+const uint8_t SAMPLE_FLAG_CALIBRATED = 1 << 3;  // 本訊框完成校準
+const uint8_t SAMPLE_FLAG_BUZZER     = 1 << 4;  // 蜂鳴器目前輸出
+const uint8_t SAMPLE_FLAG_MOTOR      = 1 << 5;  // 馬達目前輸出
+const uint8_t SAMPLE_FLAG_COOLDOWN   = 1 << 6;  // 馬達冷卻期中
+
+// 感測器取樣：原始 int16 加速度/陀螺儀 + 回波時間，主機端自行換算角度與距離
+struct SampleFrame {
+    uint16_t seq;       // 序號（遞增，溢位後回到 0，用來偵測遺失）
+    uint32_t t_ms;      // 開機後毫秒數
+    int16_t ax, ay, az;
+    int16_t gx, gy, gz;
+    uint16_t echo_us;   // 回波時間（us），0 表示無回波
+    uint8_t flags;      // SAMPLE_FLAG_*
+};
+const int SAMPLE_PAYLOAD_LEN = 2 + 4 + 6 * 2 + 2 + 1;  // 21 bytes，整個訊框 27 bytes
+
+inline uint16_t crc16_ccitt(const uint8_t *data, size_t len, uint16_t crc = 0xFFFF) {
+    for (size_t i = 0; i < len; i++) {
+        crc ^= (uint16_t)data[i] << 8;
+        for (int b = 0; b < 8; b++) {
+            crc = (crc & 0x8000) ? (uint16_t)((crc << 1) ^ 0x1021) : (uint16_t)(crc << 1);
+        }
+    }
+    return crc;
+}
+
+inline uint8_t *put_u16(uint8_t *p, uint16_t v) {
+    p[0] = (uint8_t)(v & 0xFF);
+    p[1] = (uint8_t)(v >> 8);
+    return p + 2;
+}
+
+inline uint8_t *put_u32(uint8_t *p, uint32_t v) {
+    p[0] = (uint8_t)(v & 0xFF);
+    p[1] = (uint8_t)((v >> 8) & 0xFF);
+    p[2] = (uint8_t)((v >> 16) & 0xFF);
+    p[3] = (uint8_t)(v >> 24);
+    return p + 4;
+}
+
+inline uint8_t *put_f32(uint8_t *p, float v) {
+    uint32_t u;
+    memcpy(&u, &v, sizeof(u));
+    return put_u32(p, u);
+}
+
+inline uint32_t get_u32(const uint8_t *p) {
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+inline float get_f32(const uint8_t *p) {
+    uint32_t u = get_u32(p);
+    float v;
+    memcpy(&v, &u, sizeof(v));
+    return v;
+}
+
+// 將 payload 加上同步字元、表頭與 CRC 寫入 out，回傳訊框總長度（0 表示 payload 過長）
+// out 至少需 FRAME_MAX_LEN bytes
+inline size_t frame_encode(uint8_t type, const uint8_t *payload, uint8_t len, uint8_t *out) {
+    if (len > FRAME_MAX_PAYLOAD) return 0;
+    out[0] = FRAME_SYNC0;
+    out[1] = FRAME_SYNC1;
+    out[2] = type;
+    out[3] = len;
+    for (uint8_t i = 0; i < len; i++) out[FRAME_HEADER_LEN + i] = payload[i];
+    uint16_t crc = crc16_ccitt(out + 2, 2 + len);
+    put_u16(out + FRAME_HEADER_LEN + len, crc);
+    return FRAME_HEADER_LEN + len + FRAME_CRC_LEN;
+}
+
+inline size_t encode_sample_frame(const SampleFrame &s, uint8_t *out) {
+    uint8_t payload[SAMPLE_PAYLOAD_LEN];
+    uint8_t *p = payload;
+    p = put_u16(p, s.seq);
+    p = put_u32(p, s.t_ms);
+    p = put_u16(p, (uint16_t)s.ax);
+    p = put_u16(p, (uint16_t)s.ay);
+    p = put_u16(p, (uint16_t)s.az);
+    p = put_u16(p, (uint16_t)s.gx);
+    p = put_u16(p, (uint16_t)s.gy);
+    p = put_u16(p, (uint16_t)s.gz);
+    p = put_u16(p, s.echo_us);
+    *p = s.flags;
+    return frame_encode(FRAME_TYPE_SAMPLE, payload, SAMPLE_PAYLOAD_LEN, out);
+}
+
+// 各感測器回波時間（us，0 表示無回波），n 不可超過 (FRAME_MAX_PAYLOAD - 1) / 2
+inline size_t encode_ranges_frame(const uint16_t *echo_us, uint8_t n, uint8_t *out) {
+    uint8_t payload[FRAME_MAX_PAYLOAD];
+    if (1 + 2 * n > FRAME_MAX_PAYLOAD) return 0;
+    uint8_t *p = payload;
+    *p++ = n;
+    for (uint8_t i = 0; i < n; i++) p = put_u16(p, echo_us[i]);
+    return frame_encode(FRAME_TYPE_RANGES, payload, (uint8_t)(p - payload), out);
+}
+
+inline size_t encode_sync_frame(uint32_t token, uint8_t source, uint32_t rx_us, uint32_t tx_us, uint8_t *out) {
+    uint8_t payload[13];
+    uint8_t *p = put_u32(payload, token);
+    *p++ = source;
+    p = put_u32(p, rx_us);
+    p = put_u32(p, tx_us);
+    return frame_encode(FRAME_TYPE_SYNC, payload, (uint8_t)(p - payload), out);
+}
+
+// capture_us：該取樣距離的回波時間點；tx_us：訊框放入輸出佇列的時間
+inline size_t encode_trace_frame(uint16_t seq, uint32_t capture_us, uint32_t tx_us, uint8_t *out) {
+    uint8_t payload[10];
+    uint8_t *p = put_u16(payload, seq);
+    p = put_u32(p, capture_us);
+    p = put_u32(p, tx_us);
+    return frame_encode(FRAME_TYPE_TRACE, payload, (uint8_t)(p - payload), out);
+}
+
+// 接收端訊框解析：逐位元組餵入，收到通過 CRC 的完整訊框時回傳 true（type/len/payload 有效到下一次餵入）
+// 訊框以外的位元組（文字、雜訊）直接略過。候選訊框 CRC 錯誤或長度不合法時，sync 之後收到的位元組
+// 會重新掃描（與主機端 FrameDecoder 相同），藏在錯誤同步「訊框」內的真正指令不會遺失；
+// 重新掃描可能在已收到的位元組中找到訊框，呼叫端在餵入新位元組前先以 frame_parser_poll 取出
+const int FRAME_PARSER_RAW_MAX = 2 + FRAME_MAX_PAYLOAD + FRAME_CRC_LEN;  // sync 之後的 type .. crc
+
+struct FrameParser {
+    enum State { SYNC0, SYNC1, TYPE, LEN, PAYLOAD, CRC0, CRC1 };
+    State state;
+    uint8_t type;
+    uint8_t len;
+    uint8_t pos;
+    uint16_t crc;
+    uint8_t payload[FRAME_MAX_PAYLOAD];
+    uint8_t raw[FRAME_PARSER_RAW_MAX];     // 目前候選訊框 sync 之後的位元組
+    uint8_t raw_len;
+    uint8_t replay[FRAME_PARSER_RAW_MAX];  // 待重新掃描的位元組
+    uint8_t replay_pos;
+    uint8_t replay_len;
+    uint32_t crc_errors;
+};
+
+inline void frame_parser_init(FrameParser &p) {
+    p.state = FrameParser::SYNC0;
+    p.raw_len = 0;
+    p.replay_pos = 0;
+    p.replay_len = 0;
+    p.crc_errors = 0;
+}
+
+// 候選訊框不成立：把它 sync 之後的位元組放回待掃描佇列的最前面，從 SYNC0 重新開始
+inline void frame_parser_rescan(FrameParser &p) {
+    int rest = p.replay_len - p.replay_pos;
+    int n = p.raw_len;
+    if (n + rest > FRAME_PARSER_RAW_MAX) n = FRAME_PARSER_RAW_MAX - rest;  // 不會發生：兩者來自同一個候選訊框
+    memmove(p.replay + n, p.replay + p.replay_pos, rest);
+    memcpy(p.replay, p.raw + p.raw_len - n, n);
+    p.replay_pos = 0;
+    p.replay_len = (uint8_t)(n + rest);
+    p.raw_len = 0;
+    p.state = FrameParser::SYNC0;
+}
+
+inline bool frame_parser_step(FrameParser &p, uint8_t c) {
+    if (p.state >= FrameParser::TYPE) p.raw[p.raw_len++] = c;
+    switch (p.state) {
+    case FrameParser::SYNC0:
+        if (c == FRAME_SYNC0) p.state = FrameParser::SYNC1;
+        return false;
+    case FrameParser::SYNC1:
+        p.state = (c == FRAME_SYNC1) ? FrameParser::TYPE : (c == FRAME_SYNC0 ? FrameParser::SYNC1 : FrameParser::SYNC0);
+        p.raw_len = 0;
+        return false;
+    case FrameParser::TYPE:
+        p.type = c;
+        p.state = FrameParser::LEN;
+        return false;
+    case FrameParser::LEN:
+        if (c > FRAME_MAX_PAYLOAD) {
+            frame_parser_rescan(p);
+            return false;
+        }
+        p.len = c;
+        p.pos = 0;
+        p.state = c > 0 ? FrameParser::PAYLOAD : FrameParser::CRC0;
+        return false;
+    case FrameParser::PAYLOAD:
+        p.payload[p.pos++] = c;
+        if (p.pos == p.len) p.state = FrameParser::CRC0;
+        return false;
+    case FrameParser::CRC0:
+        p.crc = c;
+        p.state = FrameParser::CRC1;
+        return false;
+    case FrameParser::CRC1: {
+        p.crc |= (uint16_t)c << 8;
+        uint8_t hdr[2] = {p.type, p.len};
+        if (crc16_ccitt(p.payload, p.len, crc16_ccitt(hdr, 2)) != p.crc) {
+            p.crc_errors++;
+            frame_parser_rescan(p);
+            return false;
+        }
+        p.raw_len = 0;
+        p.state = FrameParser::SYNC0;
+        return true;
+    }
+    }
+    return false;
+}
+
+// 掃描重新排入的位元組；找到完整訊框時回傳 true（其餘位元組留到下一次）
+inline bool frame_parser_poll(FrameParser &p) {
+    while (p.replay_pos < p.replay_len) {
+        if (frame_parser_step(p, p.replay[p.replay_pos++])) return true;
+    }
+    p.replay_pos = p.replay_len = 0;
+    return false;
+}
+
+inline bool frame_parser_feed(FrameParser &p, uint8_t c) {
+    if (p.replay_pos == p.replay_len) {
+        p.replay_pos = p.replay_len = 0;
+        return frame_parser_step(p, c);
+    }
+    // 尚有待掃描的位元組（呼叫端未先 poll）：排在後面，維持位元組順序
+    if (p.replay_pos > 0) {
+        memmove(p.replay, p.replay + p.replay_pos, p.replay_len - p.replay_pos);
+        p.replay_len -= p.replay_pos;
+        p.replay_pos = 0;
+    }
+    if (p.replay_len < FRAME_PARSER_RAW_MAX) p.replay[p.replay_len++] = c;
+    return frame_parser_poll(p);
+}
+
+#endif // TELEMETRY_FRAME_H
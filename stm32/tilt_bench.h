@@ -0,0 +1,78 @@
+// 傾斜計算微基準：以 DWT 週期計數比較 fast_math.h 三種實作
+// 一個 frame = roll + pitch + 距離傾斜補償（與 accel_tilt / alert_evaluate 相同的運算）
+// 只在 TILT_MATH_BENCH=1 時由 main 於開機呼叫一次，結果以文字行輸出
+#ifndef TILT_BENCH_H
+#define TILT_BENCH_H
+
+#include "cycle_counter.h"
+#include "fast_math.h"
+#include "orientation.h"
+
+#ifndef TILT_MATH_BENCH
+#define TILT_MATH_BENCH 0
+#endif
+
+const int TILT_BENCH_SAMPLES = 64;
+const int TILT_BENCH_ROUNDS = 16;
+
+struct TiltBenchInput {
+    float ax[TILT_BENCH_SAMPLES], ay[TILT_BENCH_SAMPLES], az[TILT_BENCH_SAMPLES];
+    float dist_cm[TILT_BENCH_SAMPLES];
+};
+
+struct TiltBenchResult {
+    uint32_t cycles_per_frame;
+    float max_err_deg;      // 與 libm 相比的最大角度誤差
+    float max_err_cm;       // 補償距離的最大誤差
+};
+
+// 手杖常見姿態：pitch -60..+60 度、roll ±30 度，加一點雜訊量級的偏移
+inline void tilt_bench_input(TiltBenchInput &in) {
+    for (int i = 0; i < TILT_BENCH_SAMPLES; i++) {
+        float p = (-60.0f + 120.0f * i / (TILT_BENCH_SAMPLES - 1)) * DEG_TO_RAD;
+        float r = (30.0f * sinf(i * 0.7f)) * DEG_TO_RAD;
+        in.ax[i] = (float)(int16_t)(-sinf(p) * ACCEL_LSB_PER_G + (i % 7) * 11);
+        in.ay[i] = (float)(int16_t)(cosf(p) * sinf(r) * ACCEL_LSB_PER_G);
+        in.az[i] = (float)(int16_t)(cosf(p) * cosf(r) * ACCEL_LSB_PER_G);
+        in.dist_cm[i] = 100.0f + 3.0f * i;
+    }
+}
+
+template <float (*ATAN2)(float, float), float (*SQRT)(float), float (*COS)(float)>
+inline void tilt_bench_frame(const TiltBenchInput &in, int i, float &roll, float &pitch, float &comp) {
+    roll = ATAN2(in.ay[i], in.az[i]) * RAD_TO_DEG;
+    pitch = ATAN2(-in.ax[i], SQRT(in.ay[i] * in.ay[i] + in.az[i] * in.az[i])) * RAD_TO_DEG;
+    comp = in.dist_cm[i] * COS(pitch * DEG_TO_RAD);
+}
+
+template <float (*ATAN2)(float, float), float (*SQRT)(float), float (*COS)(float)>
+TiltBenchResult tilt_bench_run(const TiltBenchInput &in) {
+    TiltBenchResult res = {0, 0.0f, 0.0f};
+    volatile float sink = 0.0f;   // 防止編譯器把迴圈整段省略
+    float roll, pitch, comp;
+
+    uint32_t start = cyccnt_read();
+    for (int k = 0; k < TILT_BENCH_ROUNDS; k++) {
+        for (int i = 0; i < TILT_BENCH_SAMPLES; i++) {
+            tilt_bench_frame<ATAN2, SQRT, COS>(in, i, roll, pitch, comp);
+            sink = roll + pitch + comp;
+        }
+    }
+    uint32_t cycles = cyccnt_read() - start;
+    res.cycles_per_frame = cycles / (TILT_BENCH_ROUNDS * TILT_BENCH_SAMPLES);
+    (void)sink;
+
+    // 精度：與 libm 結果逐筆比較（不計入週期）
+    for (int i = 0; i < TILT_BENCH_SAMPLES; i++) {
+        float r0, p0, c0;
+        tilt_bench_frame<tilt_libm::atan2, tilt_libm::sqrt, tilt_libm::cos>(in, i, r0, p0, c0);
+        tilt_bench_frame<ATAN2, SQRT, COS>(in, i, roll, pitch, comp);
+        float e = fabsf(roll - r0);
+        if (fabsf(pitch - p0) > e) e = fabsf(pitch - p0);
+        if (e > res.max_err_deg) res.max_err_deg = e;
+        if (fabsf(comp - c0) > res.max_err_cm) res.max_err_cm = fabsf(comp - c0);
+    }
+    return res;
+}
+
+#endif // TILT_BENCH_H
@@ -0,0 +1,72 @@
+// 非阻塞 UART 輸出佇列：主迴圈寫入環形緩衝區，由 TX 中斷逐位元組送出
+// 緩衝區於編譯期固定配置（N 必須為 2 的次方），不使用 heap
+#ifndef UART_TX_QUEUE_H
+#define UART_TX_QUEUE_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+// 緩衝區滿時的處理方式
+enum TxOverflowPolicy {
+    TX_DROP_NEWEST = 0,  // 捨棄這次寫入的整筆資料（已排隊的訊框保持完整）
+    TX_DROP_OLDEST = 1,  // 捨棄最舊的位元組騰出空間（正在送出的訊框可能被截斷，由 CRC 濾除）
+};
+
+template <size_t N>
+class TxQueue {
+    static_assert(N >= 2 && (N & (N - 1)) == 0, "TxQueue size must be a power of two");
+
+public:
+    TxQueue() : head_(0), tail_(0), overflow_count_(0), dropped_bytes_(0) {}
+
+    // 主迴圈呼叫；若與 pop() 併行（中斷），呼叫端需在臨界區內執行
+    // 回傳 false 表示有資料被捨棄
+    bool push(const uint8_t *data, size_t len, TxOverflowPolicy policy) {
+        if (len > N - 1) {
+            overflow_count_++;
+            dropped_bytes_ += len;
+            return false;
+        }
+        size_t free_bytes = space();
+        bool ok = true;
+        if (len > free_bytes) {
+            overflow_count_++;
+            if (policy == TX_DROP_NEWEST) {
+                dropped_bytes_ += len;
+                return false;
+            }
+            size_t drop = len - free_bytes;
+            head_ = (head_ + drop) & (N - 1);
+            dropped_bytes_ += drop;
+            ok = false;
+        }
+        for (size_t i = 0; i < len; i++) {
+            buf_[tail_] = data[i];
+            tail_ = (tail_ + 1) & (N - 1);
+        }
+        return ok;
+    }
+
+    // TX 中斷呼叫：取出下一個要送出的位元組
+    bool pop(uint8_t &out) {
+        if (head_ == tail_) return false;
+        out = buf_[head_];
+        head_ = (head_ + 1) & (N - 1);
+        return true;
+    }
+
+    bool empty() const { return head_ == tail_; }
+    size_t used() const { return (tail_ - head_) & (N - 1); }
+    size_t space() const { return N - 1 - used(); }
+    uint32_t overflow_count() const { return overflow_count_; }
+    uint32_t dropped_bytes() const { return dropped_bytes_; }
+
+private:
+    uint8_t buf_[N];
+    volatile size_t head_;   // 下一個送出位置（中斷端）
+    volatile size_t tail_;   // 下一個寫入位置（主迴圈端）
+    uint32_t overflow_count_;
+    uint32_t dropped_bytes_;
+};
+
+#endif // UART_TX_QUEUE_H